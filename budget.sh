@@ -0,0 +1,91 @@
+#!/bin/bash
+#
+# check the size of a firmware image against budget.txt
+#
+# usage: budget.sh <elf> <budget file>
+#
+# Prints the flash and sram totals and the largest symbols in each, and
+# exits non-zero if anything is over its limit.  NM and SIZE can be set
+# to the binutils to use (avr-nm and avr-size by default).
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 <elf> <budget file>"
+	exit 1
+fi
+
+ELF="$1"
+BUDGET="$2"
+NM=${NM:-avr-nm}
+SIZE=${SIZE:-avr-size}
+
+SYMS=`$NM -S --size-sort -t d "$ELF"` || exit 1
+SECTIONS=`$SIZE -A -d "$ELF"` || exit 1
+
+section() {
+	echo "$SECTIONS" | awk -v s="$1" '$1 == s { print $2; f = 1 } END { if (!f) print 0 }'
+}
+
+TEXT=`section .text`
+DATA=`section .data`
+BSS=`section .bss`
+NOINIT=`section .noinit`
+FLASH=$((TEXT + DATA))
+SRAM=$((DATA + BSS + NOINIT))
+
+limit() {
+	awk -v k="$1" '$1 == k { print $2 }' "$BUDGET"
+}
+
+FLASH_MAX=`limit flash`
+SRAM_MAX=`limit sram`
+TOP=`limit top`
+TOP=${TOP:-10}
+FAIL=0
+
+total() {
+	local name=$1 used=$2 max=$3
+	if [ -z "$max" ]; then
+		printf "%-6s %6u\n" "$name:" "$used"
+		return
+	fi
+	printf "%-6s %6u of %6u (%3u%%), %6d left\n" "$name:" "$used" "$max" \
+		$((used * 100 / max)) $((max - used))
+	if [ "$used" -gt "$max" ]; then
+		echo "  OVER BUDGET"
+		FAIL=1
+	fi
+}
+
+# nm types: t is text (which has the progmem tables in it), d is
+# initialized data, b is bss
+largest() {
+	echo "$SYMS" | awk -v t="$1" -v n="$TOP" '
+		tolower($3) ~ t { size[++c] = $2 + 0; name[c] = $4 }
+		END {
+			for (i = c; i > 0 && i > c - n; i--)
+				printf("  %6u  %s\n", size[i], name[i])
+		}'
+}
+
+total flash $FLASH "$FLASH_MAX"
+total sram $SRAM "$SRAM_MAX"
+echo
+echo "largest in flash:"
+largest '^t$'
+echo "largest in sram:"
+largest '^[db]$'
+
+# per symbol limits; the same name can be both a static and a global in
+# different files, so every match is checked
+OVER=`echo "$SYMS" | awk '
+	NR == FNR { if ($1 == "symbol") max[$2] = $3; next }
+	($4 in max) && $2 + 0 > max[$4] + 0 {
+		printf("  %s is %u bytes, limit %u\n", $4, $2 + 0, max[$4])
+	}' "$BUDGET" -`
+if [ -n "$OVER" ]; then
+	echo
+	echo "symbols over budget:"
+	echo "$OVER"
+	FAIL=1
+fi
+exit $FAIL
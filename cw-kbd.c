@@ -27,13 +27,20 @@
 #include "util.h"
 
 #include "settings.h"
+#include "eeq.h"
+#include "memory.h"
+#include "sched.h"
+#include "stack.h"
+#include "rx.h"
+#include "pot.h"
+#include "trace.h"
 #include "ringbuffer.h"
 #include "cw-kbd.h"
+#include "hid.h"
 #include "cw.h"
 #include "timer.h"
 #include "tick.h"
 
-static void hid_nq(uint8_t c);
 void set_command_mode(bool mode);
 static void exit_command_mode(void);
 void soft_reset(void);
@@ -87,6 +94,7 @@ void _debug(PGM_P fmt, ...) {
 	if (debug_write) {
 		char _dbg_msg[100];
 		uint8_t l;
+		stack_mark(STACK_DEBUG);
 		utoa(millis, _dbg_msg, 10);
 		l = strlen(_dbg_msg);
 		_dbg_msg[l++] = ':';
@@ -100,9 +108,34 @@ void _debug(PGM_P fmt, ...) {
 	}
 }
 
+#ifdef TRACE
+/* frames sent per usb_work, so a burst can't hold up the keyboard */
+#define TRACE_DRAIN 8
+
+static void trace_drain(void) {
+	uint8_t frame[TRACE_FRAME_LEN];
+	uint8_t n;
+	if (!debug_write)
+		return;
+	for (n = 0; n < TRACE_DRAIN && trace_pop(frame); n++)
+		CDC_Device_SendString(&serial_iface, (char *)frame, sizeof(frame));
+	if (n)
+		CDC_Device_Flush(&serial_iface);
+}
+#else
+#define trace_drain() do {} while(0)
+#endif /* TRACE */
+
 void _ulog(PGM_P fmt, ...) {
 	char _dbg_msg[100];
+	uint16_t dropped;
 	va_list ap;
+	stack_mark(STACK_ULOG);
+	if ((dropped = usart_dropped())) {
+		my_snprintf(_dbg_msg, sizeof(_dbg_msg),
+			PSTR("[ulog: %u bytes dropped]\r\n"), dropped);
+		usart_print(_dbg_msg);
+	}
 	va_start(ap, fmt);
 	my_vsnprintf(_dbg_msg, sizeof(_dbg_msg), fmt, ap);
 	va_end(ap);
@@ -116,7 +149,7 @@ static uint16_t enable_usb;
 /* Event handler for the library USB Connection event. */
 void EVENT_USB_Device_Connect(void)
 {
-	ms_tick_register(usb_work, TICK_USB_WORK, 15);
+	ms_tick_register(usb_work, TICK_USB_WORK, USB_WORK_MS);
 	enable_usb = 10000;
 	usb_work();
 	ulog("USB ON\r");
@@ -165,158 +198,7 @@ void EVENT_USB_Device_UnhandledControlRequest(void)
 void EVENT_USB_Device_StartOfFrame(void) {
 }
 
-static const prog_uint8_t ascii2hid[] = {
-	/* 00 */  0,     /*  */
-	/* 01 */  0,     /*  */
-	/* 02 */  0,     /*  */
-	/* 03 */  0,     /*  */
-	/* 04 */  0,     /*  */
-	/* 05 */  0,     /*  */
-	/* 06 */  0,     /*  */
-	/* 07 */  0,     /*  */
-	/* 08 */  0x2a,  /* Backspace */
-	/* 09 */  0,     /*  */
-	/* 0a */  0x28,  /*  */
-	/* 0b */  0,     /*  */
-	/* 0c */  0,     /*  */
-	/* 0d */  0,     /*  */
-	/* 0e */  0,     /*  */
-	/* 0f */  0,     /*  */
-	/* 10 */  0,     /*  */
-	/* 11 */  0,     /*  */
-	/* 12 */  0,     /*  */
-	/* 13 */  0,     /*  */
-	/* 14 */  0,     /*  */
-	/* 15 */  0,     /*  */
-	/* 16 */  0,     /*  */
-	/* 17 */  0,     /*  */
-	/* 18 */  0,     /*  */
-	/* 19 */  0,     /*  */
-	/* 1a */  0,     /*  */
-	/* 1b */  0,     /*  */
-	/* 1c */  0,     /*  */
-	/* 1d */  0,     /*  */
-	/* 1e */  0,     /*  */
-	/* 1f */  0,     /*  */
-	/* 20 */  0x2c,  /* ' ' */
-	/* 21 */  0x1e | 0x80,  /* '!' */
-	/* 22 */  0x34 | 0x80,  /* '"' */
-	/* 23 */  0,     /* '#' */
-	/* 24 */  0x21 | 0x80,  /* '$' */
-	/* 25 */  0,     /* '%' */
-	/* 26 */  0,     /* '&' */
-	/* 27 */  0,     /* '´' */
-	/* 28 */  0x26 | 0x80,  /* '(' */
-	/* 29 */  0x27 | 0x80,  /* ')' */
-	/* 2a */  0,     /* '*' */
-	/* 2b */  0x2e | 0x80,  /* '+' */
-	/* 2c */  0x36,  /* ',' */
-	/* 2d */  0x2d,  /* '-' */
-	/* 2e */  0x37,  /* '.' */
-	/* 2f */  0x38,  /* '/' */
-	/* 30 */  0x27,  /* '0' */
-	/* 31 */  0x1e,  /* '1' */
-	/* 32 */  0x1f,  /* '2' */
-	/* 33 */  0x20,  /* '3' */
-	/* 34 */  0x21,  /* '4' */
-	/* 35 */  0x22,  /* '5' */
-	/* 36 */  0x23,  /* '6' */
-	/* 37 */  0x24,  /* '7' */
-	/* 38 */  0x25,  /* '8' */
-	/* 39 */  0x26,  /* '9' */
-	/* 3a */  0x13 | 0x80,  /* ':' */
-	/* 3b */  0x13,  /* ';' */
-	/* 3c */  0,     /* '<' */
-	/* 3d */  0x2e,  /* '=' */
-	/* 3e */  0,     /* '>' */
-	/* 3f */  0x38 | 0x80,  /* '?' */
-	/* 40 */  0,     /* '@' */
-	/* 41 */  0x04 | 0x80,  /* 'A' */
-	/* 42 */  0x05 | 0x80,  /* 'B' */
-	/* 43 */  0x06 | 0x80,  /* 'C' */
-	/* 44 */  0x0a | 0x80,  /* 'D' */
-	/* 45 */  0x0e | 0x80,  /* 'E' */
-	/* 46 */  0x08 | 0x80,  /* 'F' */
-	/* 47 */  0x17 | 0x80,  /* 'G' */
-	/* 48 */  0x0b | 0x80,  /* 'H' */
-	/* 49 */  0x0f | 0x80,  /* 'I' */
-	/* 4a */  0x1c | 0x80,  /* 'J' */
-	/* 4b */  0x11 | 0x80,  /* 'K' */
-	/* 4c */  0x18 | 0x80,  /* 'L' */
-	/* 4d */  0x10 | 0x80,  /* 'M' */
-	/* 4e */  0x0d | 0x80,  /* 'N' */
-	/* 4f */  0x33 | 0x80,  /* 'O' */
-	/* 50 */  0x15 | 0x80,  /* 'P' */
-	/* 51 */  0x14 | 0x80,  /* 'Q' */
-	/* 52 */  0x16 | 0x80,  /* 'R' */
-	/* 53 */  0x07 | 0x80,  /* 'S' */
-	/* 54 */  0x09 | 0x80,  /* 'T' */
-	/* 55 */  0x0c | 0x80,  /* 'U' */
-	/* 56 */  0x19 | 0x80,  /* 'V' */
-	/* 57 */  0x1a | 0x80,  /* 'W' */
-	/* 58 */  0x1b | 0x80,  /* 'X' */
-	/* 59 */  0x12 | 0x80,  /* 'Y' */
-	/* 5a */  0x1d | 0x80,  /* 'Z' */
-	/* 5b */  0,     /* '[' */
-	/* 5c */  0,     /* '\' */
-	/* 5d */  0,     /* ']' */
-	/* 5e */  0,     /* '^' */
-	/* 5f */  0x2d | 0x80,  /* '_' */
-	/* 60 */  0x34,  /* '`' */
-	/* 61 */  0x04,  /* 'a' */
-	/* 62 */  0x05,  /* 'b' */
-	/* 63 */  0x06,  /* 'c' */
-	/* 64 */  0x0a,  /* 'd' */
-	/* 65 */  0x0e,  /* 'e' */
-	/* 66 */  0x08,  /* 'f' */
-	/* 67 */  0x17,  /* 'g' */
-	/* 68 */  0x0b,  /* 'h' */
-	/* 69 */  0x0f,  /* 'i' */
-	/* 6a */  0x1c,  /* 'j' */
-	/* 6b */  0x11,  /* 'k' */
-	/* 6c */  0x18,  /* 'l' */
-	/* 6d */  0x10,  /* 'm' */
-	/* 6e */  0x0d,  /* 'n' */
-	/* 6f */  0x33,  /* 'o' */
-	/* 70 */  0x15,  /* 'p' */
-	/* 71 */  0x14,  /* 'q' */
-	/* 72 */  0x16,  /* 'r' */
-	/* 73 */  0x07,  /* 's' */
-	/* 74 */  0x09,  /* 't' */
-	/* 75 */  0x0c,  /* 'u' */
-	/* 76 */  0x19,  /* 'v' */
-	/* 77 */  0x1a,  /* 'w' */
-	/* 78 */  0x1b,  /* 'x' */
-	/* 79 */  0x12,  /* 'y' */
-	/* 7a */  0x1d,  /* 'z' */
-	/* 7b */  0,     /* '{' */
-	/* 7c */  0,     /* '|' */
-	/* 7d */  0,     /* '}' */
-	/* 7e */  0,     /* '~' */
-	/* 7f */  0,     /* DEL */
-};
-
-DECLARE_RINGBUFFER(hid_q, 8);
-static void hid_nq(uint8_t c) {
-	debug("hid_nq(%d)\r\n", c);
-	ringbuffer_push(&hid_q, c);
-}
-
-static inline uint8_t hid_dq(void) {
-	return ringbuffer_pop(&hid_q);
-}
-
-static inline uint8_t hid_peek(void) {
-	return ringbuffer_peek(&hid_q);
-}
-
-
-/* This is called periodically to let us report keys if we have any.
- * We only report one key at a time because the report buffer is a
- * list of keys currently pressed, not keys to add to the queue.  So
- * if we want to add a whole bunch of key presses, we add them one
- * at a time in subsequent HID reports.
- */
+/* This is called periodically to let us report keys if we have any. */
 bool CALLBACK_HID_Device_CreateHIDReport(
 	USB_ClassInfo_HID_Device_t* const iface,
 	uint8_t* const report_id,
@@ -324,30 +206,8 @@ bool CALLBACK_HID_Device_CreateHIDReport(
 	void* report_data,
 	uint16_t* report_size)
 {
-	static uint8_t last_key = 0;
-	USB_KeyboardReport_Data_t* report = (USB_KeyboardReport_Data_t*)report_data;
-	uint8_t key_count = 0;
-	uint8_t c;
-	
-	/* report->Modifier = HID_KEYBOARD_MODIFER_LEFTSHIFT; */
-	
-	c = hid_peek();
-	if (c && (last_key != c)) {
-		uint8_t v;
-		last_key = c = hid_dq();
-		v = pgm_read_byte(&ascii2hid[c]);
-		debug("hid_dq() => %#x -> %#x\r\n", c, v);
-		if (v & 0x80) {
-			report->Modifier = HID_KEYBOARD_MODIFER_LEFTSHIFT;
-			v &= 0x7f;
-		} else
-			report->Modifier = 0;
-		report->KeyCode[key_count++] = v;
-	} else
-		last_key = 0;
-
 	*report_size = sizeof(USB_KeyboardReport_Data_t);
-	return key_count != 0;
+	return hid_report((USB_KeyboardReport_Data_t*)report_data);
 }
 
 void CALLBACK_HID_Device_ProcessHIDReport(
@@ -382,12 +242,14 @@ void power_down(void) {
 }
 
 static void usb_work(void) {
+	stack_mark(STACK_USB);
 	HID_Device_MillisecondElapsed(&kbd_iface);
 	HID_Device_USBTask(&kbd_iface);
 #ifdef DEBUG
 	/* Must throw away unused bytes from the host, or
 	 * it will lock up while waiting for the device */
 	CDC_Device_ReceiveByte(&serial_iface);
+	trace_drain();
 	CDC_Device_USBTask(&serial_iface);
 #endif /* DEBUG */
 
@@ -398,66 +260,111 @@ static void usb_work(void) {
 static void console_control(uint8_t b) {
 	switch (b) {
 	case 's': settings_dump(); break;
+	case 'm': {
+		char buf[48];
+		stack_report(buf, sizeof(buf));
+		ulog("stack: %u bytes, free %s\r\n", stack_size(), buf);
+		break;
+	}
 	default: break;
 	}
 }
 #endif /* DEBUG */
 
-static struct {
-	uint8_t next;
-	uint8_t freq;
-} repeat_q[MEMORY_COUNT];
-static uint8_t this_minute;
-static uint8_t string_inject_count;
-
-static void inject_string(void);
-
-static void set_memory_repeat(uint8_t mid, uint8_t freq) {
-	settings_set_memory_repeat(mid, freq);
-	if (freq) {
-		debug("adding inject %u @ %u (%u total)\n", mid, freq, string_inject_count);
-		if (!string_inject_count) {
-			debug("ms_tick_register(TICK_INJECT_STR)\n");
-			ms_tick_register(inject_string, TICK_INJECT_STR, 60000);
-		}
-		if (!repeat_q[mid].next)
-			string_inject_count++;
-	} else if (repeat_q[mid].freq) {
-		string_inject_count--;
-		if (!string_inject_count) {
-			debug("ms_tick_unregister(TICK_INJECT_STR)\n");
-			ms_tick_unregister(TICK_INJECT_STR);
-		}
-	}
-	repeat_q[mid].freq = freq;
-	repeat_q[mid].next = this_minute + freq;
+/* bit n set: memory n repeats on the second radio, the one it was set
+ * up on.  Not saved; after a reset they all go out on the first. */
+static uint16_t repeat_radio;
+
+static void set_memory_repeat(uint8_t mid, uint16_t period, uint16_t phase) {
+	debug("repeat %u every %us at %us\r\n", mid, period, phase);
+	settings_set_memory_repeat(mid, period, phase);
+	if (cw_get_radio())
+		repeat_radio |= 1 << mid;
+	else
+		repeat_radio &= ~(1 << mid);
+	sched_set(mid, period, phase);
 }
 
-static void inject_string_init(void) {
-	uint8_t i, f;
-	for (i=0; i<MEMORY_COUNT; i++) {
-		f = settings_get_memory_repeat(i);
-		set_memory_repeat(i, f);
-	}
+static void repeat_fire(uint8_t mid) {
+	uint8_t radio = cw_get_radio();
+	cw_set_radio((repeat_radio >> mid) & 1);
+	memory_play(mid);
+	cw_set_radio(radio);
 }
 
-static void inject_string(void) {
+/* repeats wait while the operator is sending or in command mode */
+static bool repeat_busy(void) {
+	return command_mode || cw_busy();
+}
+
+static void repeat_init(void) {
 	uint8_t i;
-	uint8_t msg[65];
+	sched_init(repeat_fire, repeat_busy);
+	for (i=0; i<MEMORY_COUNT; i++)
+		sched_set(i, settings_get_memory_repeat(i),
+			settings_get_memory_phase(i));
+}
 
-	if (command_mode)
-		return;
-	this_minute++;
-	debug("inject_string: this_minute=%u\n", this_minute);
-	for (i=0; i<MEMORY_COUNT; i++) {
-		debug("%i: freq=%u, next=%u\n", i, repeat_q[i].freq, repeat_q[i].next);
-		if (repeat_q[i].freq && repeat_q[i].next == this_minute) {
-			repeat_q[i].next += repeat_q[i].freq;
-			settings_get_memory(i, msg);
-			debug("cw_string(%s)\n", msg);
-			cw_string((char*)msg);
-		}
+/* repeat is given as <n>[s][p<phase>]: minutes, or seconds with the s,
+ * optionally followed by a phase in the same units.  0 turns it off. */
+static bool parse_repeat(char *str, uint16_t *period, uint16_t *phase) {
+	uint32_t per, ph = 0;
+	uint8_t unit = 60;
+	if (*str < '0' || *str > '9')
+		return false;
+	per = strtoul(str, &str, 10);
+	if (*str == 's') {
+		unit = 1;
+		str++;
 	}
+	if (*str == 'p') {
+		if (str[1] < '0' || str[1] > '9')
+			return false;
+		ph = strtoul(str + 1, &str, 10);
+	}
+	per *= unit;
+	ph *= unit;
+	if (*str || per > 0xffff || (per && ph >= per))
+		return false;
+	*period = per;
+	*phase = ph;
+	return true;
+}
+
+/* ptt is given as <lead>t<tail>: ms before the first mark, then 10ms
+ * units after the last */
+static bool parse_ptt(char *str, uint8_t *lead, uint8_t *tail) {
+	unsigned long l, t;
+	if (*str < '0' || *str > '9')
+		return false;
+	l = strtoul(str, &str, 10);
+	if (*str++ != 't' || *str < '0' || *str > '9')
+		return false;
+	t = strtoul(str, &str, 10);
+	if (*str || l > 0xff || t > 0xff)
+		return false;
+	*lead = l;
+	*tail = t;
+	return true;
+}
+
+/* weighting is given as <weight>c<comp>: the mark to space weight, 50
+ * for even, then what to add to each mark in 0.1ms (which may be less
+ * than nothing) */
+static bool parse_weighting(char *str, uint8_t *weight, int8_t *comp) {
+	unsigned long w;
+	long c;
+	if (*str < '0' || *str > '9')
+		return false;
+	w = strtoul(str, &str, 10);
+	if (*str++ != 'c' || ((*str < '0' || *str > '9') && *str != '-'))
+		return false;
+	c = strtol(str, &str, 10);
+	if (*str || w < 10 || w > 90 || c < -127 || c > 127)
+		return false;
+	*weight = w;
+	*comp = c;
+	return true;
 }
 
 static void clear_led(void) {
@@ -520,27 +427,66 @@ Things we do in command mode:
 		prompt ':t'
 		read $tone
 		play '== $tone'
+	repeat: (command mode, key r)
+		prompt ':r'
+		read $mid
+		prompt ':$mid'
+		read $repeat ($min, ${sec}s, optionally followed by p$phase)
+		play '== r$mid$repeat'
 	message: (command mode, key m)
 		prompt ':m'
 		read $mid
 		prompt ':$mid'
-		read $msg
+		read $msg (with MEMORY_SERIAL where the serial number goes)
 		play '== $msg'
 	preset: (command mode, key p)
 		promp ':p'
 		read $preset
 		play == $preset
+	callsign: (command mode, key c)
+		prompt ':c'
+		read $call
+		play == $call
+	serial number: (command mode, key n)
+		prompt ':n'
+		read $serial (the number of digits given is the width it
+		is zero padded to when sent)
+		play '== n$serial'
+	cut numbers: (command mode, key x)
+		prompt ':x'
+		read $digits (the digits to send cut, none for no cuts)
+		play '== x$digits'
+	ptt: (command mode, key w)
+		prompt ':w'
+		read ${lead}t${tail} (ms before the first mark, and 10ms
+		units after the last)
+		play '== w${lead}t${tail}'
+	so2r: (command mode, key o)
+		prompt ':o'
+		read $radio (1 or 2) and optionally m or w, for turns
+		between the radios at the end of each message or each word
+		play '== o${radio}${turns}'
+	weighting: (command mode, key g)
+		prompt ':g'
+		read ${weight}c${comp} (mark to space weight, 50 for even,
+		then 0.1ms units added to every mark, - to take away)
+		play '== g${weight}c${comp}'
+	stack headroom: (command mode, key h)
+		play '== $unused' then '$site$free' for each stack_mark
+		site, and '!$site' if the last reset was a stack trip
+		(see stack.h)
 
 */
 void command_mode_cb(uint8_t v) {
 	static enum command_mode_state cm_state;
 	static uint8_t cmd_bytes;
-	static uint8_t msg[65];
+	static uint8_t msg[MEMORY_TEXT_LEN + 1];
 	static uint8_t idx;
 	static uint8_t mid;
 	static uint8_t next_action;
 	static uint8_t command;
 
+	stack_mark(STACK_COMMAND);
 	debug("**** command_mode(%S) <- %d\r\n",
 		&command_mode_state_s[cm_state], v);
 	debug("\tcmd_bytes=%u, mid=%u, cmd=%u, na=%u, idx=%u\r\n", cmd_bytes, mid, command, next_action, idx);
@@ -561,13 +507,19 @@ void command_mode_cb(uint8_t v) {
 		command = v;
 		next_action = 0;
 		switch (v) {
+		case 'c': /* callsign */
 		case 'd': /* dit paddle */
+		case 'g': /* weighting */
 		case 'k': /* keyer mode */
 		case 'm': /* message mode */
+		case 'n': /* serial number */
+		case 'o': /* so2r radio */
 		case 'p': /* load preset */
 		case 'r': /* repeat mode */
 		case 's': /* speed setting */
 		case 't': /* tone setting */
+		case 'w': /* ptt lead and tail */
+		case 'x': /* cut numbers */
 			cm_state = command_output;
 			cmd_bytes = 2;
 			cw_char(':');
@@ -590,6 +542,13 @@ void command_mode_cb(uint8_t v) {
 			cw_char('=');
 			cw_char('=');
 			break;
+		case 'h': /* stack headroom */
+			msg[0] = '='; msg[1] = '='; msg[2] = ' ';
+			stack_report((char*)msg + 3, sizeof(msg) - 3);
+			cm_state = command_output;
+			cmd_bytes = strlen((char*)msg);
+			cw_string((char*)msg);
+			break;
 		case 'e':
 			v = '0';
 		case '0':
@@ -604,9 +563,7 @@ void command_mode_cb(uint8_t v) {
 		case '9':
 			debug("play memory %d\r\n", v-'0');
 			set_command_mode(false);
-			settings_get_memory(v-'0', msg);
-			msg[64] = 0;
-			cw_string((char*)msg);
+			memory_play(v-'0');
 			break;
 		default:
 			debug("unknown command: %v\r\n", v);
@@ -773,7 +730,7 @@ void command_mode_cb(uint8_t v) {
 				uint8_t speed = atoi((char*)msg);
 				if (speed > 4 && speed < 100) {
 					next_action = 2;
-					cw_set_speed(speed);
+					cw_set_speed(speed, true);
 					msg[3] = msg[0]; msg[4] = msg[1];
 					msg[0] = '='; msg[1] = '='; msg[2] = ' ';
 					msg[5] = 0;
@@ -816,7 +773,147 @@ void command_mode_cb(uint8_t v) {
 				cm_state = command_done;
 			}
 			break;
+		case 'c':
+			if (next_action == 0) {
+				next_action = 1;
+				cmd_bytes = CALLSIGN_LEN;
+				cm_state = command_input;
+			} else if (next_action == 1) {
+				next_action = 2;
+				settings_set_callsign((char*)msg);
+				cmd_bytes = strlen((char*)msg) + 3;
+				cw_char('=');
+				cw_char('=');
+				cw_char(' ');
+				cw_string((char*)msg);
+			} else {
+				cm_state = command_done;
+			}
+			break;
+		case 'n':
+		case 'x':
+			if (next_action == 0) {
+				next_action = 1;
+				cmd_bytes = command == 'n' ? 4 : 10;
+				cm_state = command_input;
+			} else if (next_action == 1) {
+				uint8_t len = strlen((char*)msg);
+				if (strspn((char*)msg, "0123456789") == len &&
+						(len || command == 'x')) {
+					next_action = 2;
+					if (command == 'n') {
+						settings_set_serial(atoi((char*)msg),
+							len);
+					} else {
+						uint16_t cuts = 0;
+						while (len--)
+							cuts |= 1 << (msg[len] - '0');
+						settings_set_cuts(cuts);
+					}
+					memmove(msg + 4, msg, strlen((char*)msg) + 1);
+					msg[0] = '='; msg[1] = '='; msg[2] = ' ';
+					msg[3] = command;
+					cmd_bytes = strlen((char*)msg);
+					cw_string((char*)msg);
+				} else {
+					next_action = 0;
+					cw_char('!');
+					cw_char(':');
+					cw_char(command);
+					cmd_bytes = 3;
+				}
+			} else {
+				cm_state = command_done;
+			}
+			break;
+		case 'w':
+			if (next_action == 0) {
+				next_action = 1;
+				cmd_bytes = 8;
+				cm_state = command_input;
+			} else if (next_action == 1) {
+				uint8_t lead, tail;
+				if (parse_ptt((char*)msg, &lead, &tail)) {
+					next_action = 2;
+					cw_set_ptt(lead, tail, true);
+					memmove(msg + 4, msg, strlen((char*)msg) + 1);
+					msg[0] = '='; msg[1] = '='; msg[2] = ' ';
+					msg[3] = command;
+					cmd_bytes = strlen((char*)msg);
+					cw_string((char*)msg);
+				} else {
+					next_action = 0;
+					cw_char('!');
+					cw_char(':');
+					cw_char(command);
+					cmd_bytes = 3;
+				}
+			} else {
+				cm_state = command_done;
+			}
+			break;
+		case 'o':
+			if (next_action == 0) {
+				next_action = 1;
+				cmd_bytes = 2;
+				cm_state = command_input;
+			} else if (next_action == 1) {
+				if ((msg[0] == '1' || msg[0] == '2') &&
+						(!msg[1] || msg[1] == 'm' ||
+						 msg[1] == 'w')) {
+					next_action = 2;
+					cw_set_radio(msg[0] - '1');
+					if (msg[1])
+						cw_set_so2r_policy(msg[1] == 'w' ?
+							so2r_word : so2r_message);
+					msg[0] = '='; msg[1] = '='; msg[2] = ' ';
+					msg[3] = command;
+					msg[4] = '1' + cw_get_radio();
+					msg[5] = cw_get_so2r_policy() == so2r_word ?
+						'w' : 'm';
+					msg[6] = 0;
+					cmd_bytes = 6;
+					cw_string((char*)msg);
+				} else {
+					next_action = 0;
+					cw_char('!');
+					cw_char(':');
+					cw_char(command);
+					cmd_bytes = 3;
+				}
+			} else {
+				cm_state = command_done;
+			}
+			break;
+		case 'g':
+			if (next_action == 0) {
+				next_action = 1;
+				cmd_bytes = 7;
+				cm_state = command_input;
+			} else if (next_action == 1) {
+				uint8_t weight;
+				int8_t comp;
+				if (parse_weighting((char*)msg, &weight, &comp)) {
+					next_action = 2;
+					cw_set_weighting(weight, comp);
+					memmove(msg + 4, msg, strlen((char*)msg) + 1);
+					msg[0] = '='; msg[1] = '='; msg[2] = ' ';
+					msg[3] = command;
+					cmd_bytes = strlen((char*)msg);
+					cw_string((char*)msg);
+				} else {
+					next_action = 0;
+					cw_char('!');
+					cw_char(':');
+					cw_char(command);
+					cmd_bytes = 3;
+				}
+			} else {
+				cm_state = command_done;
+			}
+			break;
 		case 'q':
+		case 'h':
 			cm_state = command_done;
 			break;
 		case 'm':
@@ -843,21 +940,20 @@ void command_mode_cb(uint8_t v) {
 				cm_state = command_output;
 			} else if (next_action == 2) {
 				if (command == 'r')
-					cmd_bytes = 2;
+					cmd_bytes = 12;
 				else
-					cmd_bytes = 64;
+					cmd_bytes = MEMORY_TEXT_LEN;
 				cm_state = command_input;
 				next_action = 3;
 			} else if (next_action == 3) {
 				if (command == 'r') {
-					uint8_t r = atoi((char*)msg);
-					if ((msg[0] == '0' || r > 0) && r < 100) {
+					uint16_t period, phase;
+					if (parse_repeat((char*)msg, &period, &phase)) {
 						next_action = 4;
-						set_memory_repeat(mid, r);
-						msg[5] = msg[0]; msg[6] = msg[1];
+						set_memory_repeat(mid, period, phase);
+						memmove(msg + 5, msg, strlen((char*)msg) + 1);
 						msg[0] = '='; msg[1] = '='; msg[2] = ' ';
 						msg[3] = 'r'; msg[4] = '0'+mid;
-						msg[7] = 0;
 						cmd_bytes = strlen((char*)msg);
 						cw_string((char*)msg);
 					} else {
@@ -868,9 +964,17 @@ void command_mode_cb(uint8_t v) {
 						cw_char(command);
 						cw_char('0'+mid);
 					}
+				} else if (!memory_save(mid, (char*)msg)) {
+					/* no room left for it, or the last
+					 * save is still being written */
+					next_action = 2;
+					cmd_bytes = 4;
+					cw_char('!');
+					cw_char(':');
+					cw_char(command);
+					cw_char('0'+mid);
 				} else {
 					next_action = 4;
-					settings_set_memory(mid, msg);
 					/* play back message */
 					cmd_bytes = strlen((char*)msg) + 3;
 					cw_char('=');
@@ -916,17 +1020,19 @@ void set_command_mode(bool mode) {
 	command_mode = mode;
 	if (command_mode) {
 		cw_set_word_space(false, false);
-		cw_disable_outputs(CW_ENABLE_KEYER|CW_ENABLE_DIDAH);
+		cw_disable_outputs(CW_ENABLE_KEYER|CW_ENABLE_DIDAH|CW_ENABLE_PTT);
 		ms_tick_register(toggle_led, TICK_TOGGLE_LED, 250);
 		ms_tick_register(exit_command_mode, TICK_FAUX_WDT, 30000);
 		command_mode_cb(0);
+		cw_set_lane(cw_lane_reply);
 		cw_set_dq_callback(command_mode_cb);
 	} else {
 		cw_set_word_space(settings_get_autospace(), false);
-		cw_enable_outputs(CW_ENABLE_KEYER|CW_ENABLE_DIDAH);
+		cw_enable_outputs(CW_ENABLE_KEYER|CW_ENABLE_DIDAH|CW_ENABLE_PTT);
 		ms_tick_unregister(TICK_TOGGLE_LED);
 		ms_tick_unregister(TICK_FAUX_WDT);
 		set_led();
+		cw_set_lane(cw_lane_text);
 		cw_set_dq_callback(hid_nq);
 	}
 	cw_clear_queues();
@@ -993,14 +1099,35 @@ __attribute__((naked)) void soft_reset(void) {
 	int6_disable();
 	clear_led();
 	ms_tick_stop();
+	/* don't leave settings half written */
+	eeq_flush();
+#ifdef DEBUG
+	usart_flush();
+#endif /* DEBUG */
 	asm volatile ("jmp %0" : : "i"(BOOT_START_ADDR));
 #endif /* HARD_RESET */
 }
 
 void sw_init(void) {
+#ifdef DEBUG
+	uint16_t t;
+#endif /* DEBUG */
+	stack_init();
+#ifdef DEBUG
+	/* time the settings rebuild with the (otherwise unused) timer1;
+	 * clk/64 is 4us per count, so 50ms is 12500 counts */
+	TCNT1 = 0;
+	TCCR1B = _BV(CS11) | _BV(CS10);
+	settings_init();
+	t = TCNT1;
+	TCCR1B = 0;
+	ulog("settings_init: %u us%s\r\n", t > 16383 ? 65535 : t * 4,
+		t > 12500 ? " (over 50ms budget)" : "");
+#else
 	settings_init();
+#endif /* DEBUG */
 	ms_tick_init();
-	inject_string_init();
+	repeat_init();
 }
 
 /* Configures the board hardware and chip peripherals for the demo's functionality. */
@@ -1036,6 +1163,13 @@ void hw_init(void)
 
 	ms_tick_start();
 	cw_init(settings_get_wpm(), (cw_dq_cb_t)&hid_nq);
+	cw_set_source(memory_src_open, memory_src_next);
+#ifdef RX
+	rx_init();
+#endif /* RX */
+#ifdef POT
+	pot_init();
+#endif /* POT */
 
 	/* enable blinky led */
 	DDRD |= _BV(PD6);
@@ -1071,6 +1205,12 @@ int main(void)
 			_delay_ms(1);
 			enable_usb--;
 		}
+#ifdef RX
+		rx_work();
+#endif /* RX */
+#ifdef POT
+		pot_work();
+#endif /* POT */
 		if (waiting_events) {
 			idle();
 			ulog_limited('.');
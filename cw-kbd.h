@@ -43,6 +43,10 @@ bool CALLBACK_HID_Device_CreateHIDReport(
 	void* report_data,
 	uint16_t* report_size);
 
+/* usb_work runs the usb tasks this often (ms) once we are connected;
+ * that is also how often a keyboard report can go out */
+#define USB_WORK_MS 15
+
 void power_down(void);
 void idle(void);
 
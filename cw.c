@@ -26,27 +26,153 @@
 #include "timer.h"
 #include "tick.h"
 #include "ringbuffer.h"
+#include "trace.h"
+#include "stack.h"
+#include "decode.h"
 
 
 void didah_enqueue(didah_queue_t what);
 uint8_t didah_dequeue(didah_queue_t *didah);
-void didah_decode(didah_queue_t next);
+static void didah_key(didah_queue_t what);
+static void didah_drop(void);
 static void cw_out_hyper_tick(void);
+static void cw_switch(uint8_t radio);
+static void cw_retime(uint8_t wpm);
 
 static cw_dq_cb_t cw_dq_cb;
-static uint8_t dit_len;
+/* a unit is 1200/wpm ms: dit_len whole ms, with the remainder spread
+ * over the units by cw_unit so the average comes out right */
+static uint16_t dit_len;
+static uint8_t dit_rem, dit_wpm, dit_frac;
+/* a new speed, held for the next element boundary, or 0 */
+static uint8_t next_wpm;
+/* what the weighting adds to every mark, in 0.1ms.  Only whole ms can
+ * be keyed, so mark_ms is this plus whatever was left over from the
+ * marks before it, and the space after each mark is that much shorter */
+static uint8_t weight;
+static int8_t comp;
+static int16_t mark_adj, mark_ms;
+static int8_t mark_rem;
 static keying_mode_t keying_mode;
+/* the operator is on the paddles: set on the first press and cleared
+ * once a word space has gone by with them idle */
+static bool cw_keying;
+
+/* straight key: the contacts drive the keyer output and sidetone from
+ * the edge interrupt itself, with no tick or queue in the way, and the
+ * lengths of the marks are handed on to the timing decoder from the
+ * tick afterwards */
+static bool sk_down;
+static bool sk_held;       /* a mark the decoder has not had yet */
+static uint16_t sk_late;   /* one that the tick missed, or 0 */
+static uint16_t sk_start, sk_end; /* millis at the press and release */
+/* ptt went on with a press: the output waits out the lead, and until
+ * then only the sidetone follows the contact */
+static bool sk_lead;
+static uint16_t sk_lead_start;
+/* a break shorter than this is contact bounce, not a space */
+#define SK_BRIDGE 3
+
+static inline bool sk_busy(void) {
+	return keying_mode == keying_mode_straight && cw_keying;
+}
 static bool word_space;
 
-DECLARE_RINGBUFFER(cw_q, 128);
-static void cw_nq(uint8_t c) {
-	ringbuffer_push(&cw_q, c);
+DECLARE_RINGBUFFER(cw_q, CW_Q_LEN);
+DECLARE_RINGBUFFER(cw_q2, CW2_Q_LEN);
+DECLARE_RINGBUFFER(cw_reply_q, CW_REPLY_Q_LEN);
+#define DIDAH_Q_LEN 16
+DECLARE_RINGBUFFER(cw_didah_q, DIDAH_Q_LEN);
+/* set on elements from the paddles, which were decoded as they were
+ * keyed and are only played from the queue */
+#define DIDAH_KEYED 0x80
+
+/* a character being put together from its elements.  What comes in (the
+ * paddles and everything else that calls didah_decode) and the text
+ * being played out each have their own, so neither breaks up the
+ * other's characters. */
+struct didah_decoder {
+	uint16_t bits;
+	uint8_t last_decoded;
+};
+static struct didah_decoder in_dec = { 0x01, 0 };
+static struct didah_decoder out_dec = { 0x01, 0 };
+static void didah_decode_on(struct didah_decoder *d, didah_queue_t next);
+
+/* so2r: text, memories and the paddles go to cw_radio, and cw_on_air
+ * is the radio being keyed.  Only one of them sends at a time, so they
+ * share the element engine and take turns at it; each has its own
+ * queue, key and ptt, and a sidetone pitch of its own. */
+static struct ringbuffer *const cw_qs[CW_RADIOS] = { &cw_q, &cw_q2 };
+static uint8_t cw_radio, cw_on_air;
+static so2r_policy_t so2r_policy;
+static bool so2r_at_word; /* the last character sent ended a word */
+
+/* cw_lane is where text goes, out_lane the lane of the character being
+ * sent */
+static cw_lane_t cw_lane, out_lane;
+
+static void cw_nq(struct ringbuffer *q, uint8_t c) {
+	ringbuffer_push(q, c);
 	if (!ms_tick_registered(TICK_CW_ADVANCE))
 		cw_out_hyper_tick();
 }
 
 static inline uint8_t cw_dq(void) {
-	return ringbuffer_pop(&cw_q);
+	return ringbuffer_pop(cw_qs[cw_on_air]);
+}
+
+/* hand over to the other radio if it has something waiting and this one
+ * is done with its turn.  A memory that is playing is always finished
+ * first, there is only the one of those. */
+static void cw_take_turns(void) {
+	uint8_t other = cw_on_air ^ 1;
+	if (ringbuffer_empty(cw_qs[other]))
+		return;
+	if (ringbuffer_empty(cw_qs[cw_on_air]) ||
+			(so2r_policy == so2r_word && so2r_at_word))
+		cw_switch(other);
+}
+
+static cw_src_open_t cw_src_open;
+static cw_src_next_t cw_src_next;
+static bool cw_src_playing;
+
+void cw_set_source(cw_src_open_t open, cw_src_next_t next) {
+	cw_src_playing = false;
+	cw_src_open = open;
+	cw_src_next = next;
+}
+
+void cw_play(uint8_t id) {
+	cw_nq(cw_qs[cw_radio], 0x80 | id);
+}
+
+/* next character to send: a reply, if there is one, then from the
+ * source that is playing, if any, otherwise from cw_q, where a marker
+ * starts a source playing */
+static uint8_t cw_next(void) {
+	uint8_t c;
+	if (!ringbuffer_empty(&cw_reply_q)) {
+		out_lane = cw_lane_reply;
+		return ringbuffer_pop(&cw_reply_q);
+	}
+	out_lane = cw_lane_text;
+	for (;;) {
+		if (cw_src_playing) {
+			c = cw_src_next();
+			if (c)
+				return c;
+			cw_src_playing = false;
+		}
+		cw_take_turns();
+		c = cw_dq();
+		so2r_at_word = c == ' ';
+		if (c < 0x80 || !cw_src_open)
+			return c;
+		cw_src_open(c & 0x7f);
+		cw_src_playing = true;
+	}
 }
 
 /* encoding of the morse code is as follows:
@@ -351,25 +477,84 @@ static const prog_uint8_t cw[] = {
 static void beeper_on(void);
 static void beeper_off(void);
 
+/* the transmitter is switched over ptt_lead ms before the first mark
+ * and back ptt_tail ms after the last, so that it stays on through the
+ * gaps while the operator is still sending.  Once nothing is queued,
+ * playing or being keyed there is no more to wait for, and it goes off
+ * right away.  Either way it is only let go between characters, once
+ * the sender is idle. */
+static uint8_t ptt_lead;
+static uint16_t ptt_tail;
+static bool ptt_on;
+static uint16_t ptt_since; /* millis at the end of the last mark */
+
+static void ptt_set(bool on) {
+	if (cw_on_air) {
+		if (on)
+			PTT2_PORT |= PTT2_BIT;
+		else
+			PTT2_PORT &= ~PTT2_BIT;
+	} else {
+		if (on)
+			PTT_PORT |= PTT_BIT;
+		else
+			PTT_PORT &= ~PTT_BIT;
+	}
+	ptt_on = on;
+	trace(TR_PTT, on, cw_on_air);
+}
+
+/* the sidetone for each radio; the second is a third above the first so
+ * the two can be told apart */
+static clock_select16_t beeper_clock[CW_RADIOS];
+static uint16_t beeper_top[CW_RADIOS];
+
+/* only ever between marks, so the ptt that is on belongs to the radio
+ * that was sending */
+static void cw_switch(uint8_t radio) {
+	if (radio == cw_on_air)
+		return;
+	if (ptt_on)
+		ptt_set(false);
+	cw_on_air = radio;
+	so2r_at_word = false;
+	timer3_set_top(beeper_top[radio]);
+	trace(TR_CW_RADIO, radio, 0);
+}
+
+static void cw_key_on(void) {
+	if (cw_on_air)
+		CW2_PORT |= CW2_BIT;
+	else
+		CW_PORT |= CW_BIT;
+}
+
 static void cw_led_on(void) {
 	// turn on led
-	CW_PORT |= CW_BIT;
+	cw_key_on();
 	// turn on beeper
 	beeper_on();
 }
 
 static void cw_led_off(void) {
+	/* not from under the straight key */
+	if (sk_down)
+		return;
 	// turn off led
-	CW_PORT &= ~CW_BIT;
+	if (cw_on_air)
+		CW2_PORT &= ~CW2_BIT;
+	else
+		CW_PORT &= ~CW_BIT;
 	// turn off beeper
 	beeper_off();
+	ptt_since = millis;
 }
 
 void cw_char(char c) {
 	if (c == '\'') {
 		c = '`';
 	}
-	cw_nq(c);
+	cw_nq(cw_lane == cw_lane_reply ? &cw_reply_q : cw_qs[cw_radio], c);
 }
 
 void cw_string(const char* str) {
@@ -390,37 +575,44 @@ enum cw_state {
 		cws_word_sp,
 		cws_word_sp2,
 		cws_word_sp3,
+		cws_lead,
 } __attribute__((packed));
 
-#ifdef DEBUG
-prog_char cw_state_0[] PROGMEM = "cws_hyper";
-prog_char cw_state_1[] PROGMEM = "cws_idle";
-prog_char cw_state_2[] PROGMEM = "cws_send_bit";
-prog_char cw_state_3[] PROGMEM = "cws_dah";
-prog_char cw_state_4[] PROGMEM = "cws_dah2";
-prog_char cw_state_5[] PROGMEM = "cws_bit_sp";
-prog_char cw_state_6[] PROGMEM = "cws_char_sp";
-prog_char cw_state_7[] PROGMEM = "cws_word_sp";
-prog_char cw_state_8[] PROGMEM = "cws_word_sp2";
-prog_char cw_state_9[] PROGMEM = "cws_word_sp3";
-prog_char *cw_state_s[] PROGMEM = {
-	cw_state_0,
-	cw_state_1,
-	cw_state_2,
-	cw_state_3,
-	cw_state_4,
-	cw_state_5,
-	cw_state_6,
-	cw_state_7,
-	cw_state_8,
-	cw_state_9,
-};
-#endif /* DEBUG */
+static uint16_t cw_unit(void) {
+	dit_frac += dit_rem;
+	if (dit_frac >= dit_wpm) {
+		dit_frac -= dit_wpm;
+		return dit_len + 1;
+	}
+	return dit_len;
+}
+
+/* how much longer the next mark is, in ms */
+static int16_t cw_mark_adj(void) {
+	int16_t a = mark_adj + mark_rem;
+	mark_ms = a / 10;
+	mark_rem = a - mark_ms * 10;
+	return mark_ms;
+}
+
+/* work out mark_adj for the speed and weighting, short of leaving a
+ * mark or the space after it with nothing */
+static void cw_weigh(void) {
+	int16_t max = (dit_len - 1) * 10;
+	int32_t a = comp + ((int32_t)weight - 50) * (12000 / dit_wpm) / 50;
+	if (a > max)
+		a = max;
+	else if (a < -max)
+		a = -max;
+	mark_adj = a;
+	mark_rem = mark_ms = 0;
+}
 
 static void cw_out_advance_tick(void);
-static void cw_out_normal_tick(void) {
-	/* return to normal speed */
-	ms_tick_register(cw_out_advance_tick, TICK_CW_ADVANCE, dit_len);
+static void cw_out_normal_tick(int16_t adj) {
+	/* return to normal speed; the tick is always registered by the
+	 * time we get here, this just sets the length of the next unit */
+	ms_tick_set_freq(TICK_CW_ADVANCE, cw_unit() + adj);
 }
 
 static void cw_out_hyper_tick(void) {
@@ -437,14 +629,20 @@ static void cw_out_advance_tick(void) {
 	static enum cw_state state = cws_idle;
 	static uint8_t byte, bit, orig_byte, idle_count;
 	didah_queue_t didah;
+	int16_t adj = 0;
 
-#ifdef DEBUG
+#ifdef TRACE
 	static enum cw_state lstate = cws_send_bit;
 	if (lstate != state)
-		debug("cw_out: state %S\r\n", &cw_state_s[state]);
+		trace(TR_CW_STATE, state, 0);
 	lstate = state;
-#endif /* DEBUG */
-	if (state > cws_idle) {
+#endif /* TRACE */
+	/* between elements, a new speed can take over */
+	if (next_wpm && (state == cws_idle || state == cws_send_bit)) {
+		cw_retime(next_wpm);
+		next_wpm = 0;
+	}
+	if (state > cws_idle || ptt_on) {
 		idle_count = 0;
 	} else {
 		idle_count++;
@@ -455,22 +653,32 @@ static void cw_out_advance_tick(void) {
 	}
 	switch (state) {
 		case cws_hyper:
+			/* the last unit of a space is over; start on what
+			 * is next right away, or poll for it */
 			cw_out_hyper_tick();
 			state = cws_idle;
-			break;
+			return cw_out_advance_tick();
 		case cws_idle:
 			if (didah_dequeue(NULL)) {
-				debug("have didahs to dequeue\r\n");
-				cw_out_normal_tick();
+				/* the paddles key the radio they are on */
+				cw_switch(cw_radio);
 				state = cws_send_bit;
 				return cw_out_advance_tick();
 			}
-			if ((byte = cw_dq())) {
-				debug("cw_dq byte %d\r\n", byte);
+			/* text waits for the straight key to be done */
+			if (!sk_busy() && (byte = cw_next())) {
+				trace(TR_CW_BYTE, byte, 0);
+				if (byte == CW_SRC_WAIT) {
+					/* don't go to sleep on a slow source */
+					idle_count = 0;
+					break;
+				}
 				if (byte > 127) break;
 				orig_byte = byte;
 				if (byte == 32) {
-					didah_enqueue(SPACE);
+					/* the character space is already
+					 * done, four more units make a word */
+					didah_decode_on(&out_dec, SPACE);
 					state = cws_word_sp;
 					break;
 				}
@@ -490,17 +698,39 @@ static void cw_out_advance_tick(void) {
 				}
 				didah_enqueue(SPACE);
 				state = cws_send_bit;
-				cw_out_normal_tick();
 				return cw_out_advance_tick();
 			}
+			if (ptt_on && !sk_down && (!cw_busy() ||
+					(uint16_t)(millis - ptt_since) >= ptt_tail))
+				ptt_set(false);
 			break;
 
 		case cws_send_bit:
+			if (sk_busy()) {
+				/* the straight key has taken over, the rest
+				 * of the character is dropped */
+				didah_drop();
+				state = cws_hyper;
+				return cw_out_advance_tick();
+			}
+			if (!ptt_on && didah_dequeue(NULL) &&
+					(ringbuffer_peek(&cw_didah_q) &
+						~DIDAH_KEYED) != SPACE) {
+				/* the first mark waits out the lead, and only
+				 * that, before it goes */
+				ptt_set(true);
+				if (ptt_lead) {
+					state = cws_lead;
+					ms_tick_set_freq(TICK_CW_ADVANCE, ptt_lead);
+					return;
+				}
+			}
 			if (didah_dequeue(&didah)) {
 				switch (didah) {
 				case DIT:
 					state = cws_bit_sp;
 					cw_led_on();
+					adj = cw_mark_adj();
 					break;
 
 				case DAH:
@@ -519,12 +749,16 @@ static void cw_out_advance_tick(void) {
 			break;
 
 		case cws_dah: state = cws_dah2; break;
-		case cws_dah2: state = cws_bit_sp; break;
+		case cws_dah2:
+			state = cws_bit_sp;
+			adj = cw_mark_adj();
+			break;
 
 		case cws_bit_sp:
 			// turn off the bit
 			cw_led_off();
 			state = cws_send_bit;
+			adj = -mark_ms;
 			break;
 
 		case cws_char_sp: state = cws_hyper; break;
@@ -532,7 +766,15 @@ static void cw_out_advance_tick(void) {
 		case cws_word_sp: state = cws_word_sp2; break;
 		case cws_word_sp2: state = cws_word_sp3; break;
 		case cws_word_sp3: state = cws_hyper; break;
+
+		case cws_lead:
+			state = cws_send_bit;
+			return cw_out_advance_tick();
 	}
+	/* everything but idle polling runs a unit at a time, give or take
+	 * the weighting at the end of a mark */
+	if (state != cws_idle)
+		cw_out_normal_tick(adj);
 }
 
 enum keying_state {
@@ -550,45 +792,20 @@ enum keying_transition_events {
 	keying_x_right_key_release,
 } __attribute__((packed));
 
-#ifdef DEBUG
-prog_char key_state_0[] PROGMEM = "keying_idle";
-prog_char key_state_1[] PROGMEM = "keying_left_press";
-prog_char key_state_2[] PROGMEM = "keying_right_press";
-prog_char key_state_3[] PROGMEM = "keying_both_press";
-prog_char *keying_state_s[] PROGMEM = {
-	key_state_0,
-	key_state_1,
-	key_state_2,
-	key_state_3,
-};
-
-prog_char key_evt_0[] PROGMEM = "keying_x_no_event";
-prog_char key_evt_1[] PROGMEM = "keying_x_tick";
-prog_char key_evt_2[] PROGMEM = "keying_x_left_key_press";
-prog_char key_evt_3[] PROGMEM = "keying_x_left_key_release";
-prog_char key_evt_4[] PROGMEM = "keying_x_right_key_press";
-prog_char key_evt_5[] PROGMEM = "keying_x_right_key_release";
-prog_char *keying_transition_events_s[] PROGMEM = {
-	key_evt_0,
-	key_evt_1,
-	key_evt_2,
-	key_evt_3,
-	key_evt_4,
-	key_evt_5,
-};
-
-#endif /* DEBUG */
-
-#define DIDAH_Q_LEN 16
-DECLARE_RINGBUFFER(cw_didah_q, DIDAH_Q_LEN);
-
 void didah_enqueue(didah_queue_t what) {
 	if (!ms_tick_registered(TICK_CW_ADVANCE))
 		cw_out_hyper_tick();
-	debug("enqueue %d\r\n", what);
+	trace(TR_DIDAH_NQ, what & ~DIDAH_KEYED, what >> 7);
 	ringbuffer_push(&cw_didah_q, what);
 }
 
+/* the paddles: the host gets what they send as soon as it is keyed, not
+ * once it has been played out after whatever was queued ahead of it */
+static void didah_key(didah_queue_t what) {
+	didah_enqueue(what | DIDAH_KEYED);
+	didah_decode(what);
+}
+
 uint8_t didah_dequeue(didah_queue_t *didah) {
 	uint8_t have_didahs;
 	have_didahs = !ringbuffer_empty(&cw_didah_q);
@@ -596,9 +813,11 @@ uint8_t didah_dequeue(didah_queue_t *didah) {
 		return have_didahs;
 	}
 	if (have_didahs) {
-		*didah = (didah_queue_t)ringbuffer_pop(&cw_didah_q);
-		debug("dequeue %d\r\n", *didah);
-		didah_decode(*didah);
+		uint8_t v = ringbuffer_pop(&cw_didah_q);
+		*didah = (didah_queue_t)(v & ~DIDAH_KEYED);
+		trace(TR_DIDAH_DQ, *didah, v >> 7);
+		if (!(v & DIDAH_KEYED))
+			didah_decode_on(&out_dec, *didah);
 		return 1;
 	}
 	return 0;
@@ -606,54 +825,72 @@ uint8_t didah_dequeue(didah_queue_t *didah) {
 
 void cw_clear_queues(void) {
 	ringbuffer_clear(&cw_q);
-	if (!ringbuffer_empty(&cw_didah_q)) {
-		ringbuffer_clear(&cw_didah_q);
-		didah_decode(SPACE);
-	}
+	ringbuffer_clear(&cw_q2);
+	ringbuffer_clear(&cw_reply_q);
+	cw_src_playing = false;
+	didah_drop();
+}
+
+/* throw away what is left to play, and finish off the character it
+ * cut short, if it was text */
+static void didah_drop(void) {
+	if (ringbuffer_empty(&cw_didah_q))
+		return;
+	ringbuffer_clear(&cw_didah_q);
+	if (out_dec.bits != 0x01)
+		didah_decode_on(&out_dec, SPACE);
+}
+
+bool cw_busy(void) {
+	return cw_keying || cw_src_playing || !ringbuffer_empty(&cw_q) ||
+		!ringbuffer_empty(&cw_q2) || !ringbuffer_empty(&cw_reply_q) ||
+		!ringbuffer_empty(&cw_didah_q);
 }
 
 void didah_decode(didah_queue_t next) {
-	static uint16_t bits = 0x01;
-	static uint8_t last_decoded;
+	didah_decode_on(&in_dec, next);
+}
+
+static void didah_decode_on(struct didah_decoder *d, didah_queue_t next) {
+	/* what is sent is only echoed from the lane text is going to */
+	cw_dq_cb_t cb = d == &out_dec && out_lane != cw_lane ? NULL : cw_dq_cb;
 	uint8_t c;
 	switch (next) {
 	case DIT:
-		bits <<= 1;
-		debug("bits = %#x\r\n", bits);
+		d->bits <<= 1;
+		trace16(TR_BITS, d->bits);
 		break;
 	case DAH:
-		bits <<= 1;
-		bits |= 1;
-		debug("bits = %#x\r\n", bits);
+		d->bits <<= 1;
+		d->bits |= 1;
+		trace16(TR_BITS, d->bits);
 		break;
 	case SPACE:
-		debug("decoding %#x\r\n", bits);
-		if (bits == 0x01 && last_decoded > ' ') {
-			last_decoded = ' ';
-			if (cw_dq_cb)
-				cw_dq_cb(' ');
-			debug("decode: space\r\n");
+		if (d->bits == 0x01 && d->last_decoded > ' ') {
+			d->last_decoded = ' ';
+			if (cb)
+				cb(' ');
+			trace(TR_DECODE, ' ', d->bits);
 		/* find bits in a table */
-		} else if (bits < 127 && (c = pgm_read_byte(&cw2ascii[bits]))) {
-			debug("decode: %#x -> %d\r\n", bits&0xff, c);
-			if (cw_dq_cb)
-				cw_dq_cb(c);
-			last_decoded = c;
+		} else if (d->bits < 127 &&
+				(c = pgm_read_byte(&cw2ascii[d->bits]))) {
+			trace(TR_DECODE, c, d->bits);
+			if (cb)
+				cb(c);
+			d->last_decoded = c;
 		} else {
 			uint8_t i, j;
-			last_decoded = 0;
-			debug("prosign: bits = %#b\r\n", bits);
+			d->last_decoded = 0;
+			trace16(TR_PROSIGN, d->bits);
 			for (i=0; i<(sizeof(prosigns)/sizeof(struct prosign)); i++) {
-				debug("prosign_lookup: %#b\r\n",
-				      pgm_read_word(&prosigns[i].bits));
-				if (bits == pgm_read_word(&prosigns[i].bits)) {
+				if (d->bits == pgm_read_word(&prosigns[i].bits)) {
 					j = 0;
 					while ((c = pgm_read_byte(&prosigns[i].value[j]))) {
-						if (cw_dq_cb) {
+						if (cb) {
 							if (j == 0 && c != '\b')
-								cw_dq_cb('/');
-							cw_dq_cb(c);
-							last_decoded = c;
+								cb('/');
+							cb(c);
+							d->last_decoded = c;
 						}
 						j++;
 					}
@@ -661,7 +898,7 @@ void didah_decode(didah_queue_t next) {
 				}
 			}
 		}
-		bits = 0x01;
+		d->bits = 0x01;
 		break;
 	}
 }
@@ -697,13 +934,14 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		if (tick_events == 1024) {
 			ulog("**** skipped 1024 idle tick events, going to sleep\r\n");
 			tick_events = 0;
+			cw_keying = false;
 			ms_tick_unregister(TICK_CW_PARSE);
 		}
 	} else if (event != keying_x_tick) {
 		if (tick_events > 0)
-			debug("**** skipped %u tick events\r\n", tick_events);
+			trace16(TR_KEY_IDLE, tick_events);
 		tick_events = 0;
-		debug("cw_in: state %S (%S)\r\n", &keying_state_s[cstate], &keying_transition_events_s[event]);
+		trace(TR_KEY_STATE, cstate, event);
 	}
 
 	/* figure out what happened to get us here */
@@ -717,32 +955,35 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 				keyed_ticks[SPACE]++;
 				if (keyed_ticks[SPACE] == didah_len[SPACE]) {
 					if (word_space)
-						didah_enqueue(SPACE);
+						didah_key(SPACE);
 					enqueued_spaces++;
 					keyed_ticks[SPACE] = 0;
+					cw_keying = false;
 				} else if (keyed_ticks[SPACE] == didah_len[DIT]) {
-					didah_enqueue(SPACE);
+					didah_key(SPACE);
 					enqueued_spaces++;
 				}
 			}
 			break;
 		case keying_x_left_key_press:
+			cw_keying = true;
 			nstate = keying_left_press;
 			keyed_ticks[left_didah] = 0;
-			didah_enqueue(left_didah);
+			didah_key(left_didah);
 			last_keyed = left_didah;
 			break;
 		case keying_x_left_key_release:
-			debug("BAD!!! keying_x_left_key_release in idle\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_right_key_press:
+			cw_keying = true;
 			nstate = keying_right_press;
 			keyed_ticks[right_didah] = 0;
-			didah_enqueue(right_didah);
+			didah_key(right_didah);
 			last_keyed = right_didah;
 			break;
 		case keying_x_right_key_release:
-			debug("BAD!!! keying_x_right_key_release in idle\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		}
 		break;
@@ -754,17 +995,17 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		case keying_x_tick:
 			if (keying_mode == keying_mode_paddle)
 				break;
-			if (keyed_ticks[left_didah]++ == didah_len[left_didah]) {
+			if (keyed_ticks[left_didah]++ >= didah_len[left_didah]) {
 				keyed_ticks[left_didah] = 0;
-				didah_enqueue(left_didah);
+				didah_key(left_didah);
 				last_keyed = left_didah;
 			}
 			break;
 		case keying_x_left_key_press:
-			debug("BAD!!! keying_x_left_key_release in keying_left_press\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_left_key_release:
-			debug("keying_x_left_key_release: mode = %u, last_keyed = %d\r\n", keying_mode, last_keyed);
+			trace(TR_KEY_UP, keying_mode, last_keyed);
 			nstate = keying_idle;
 			enqueued_spaces = 0;
 			keyed_ticks[SPACE] = 0;
@@ -775,7 +1016,7 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 			} else {
 				nstate = keying_both_press;
 			}
-			didah_enqueue(right_didah);
+			didah_key(right_didah);
 			if (keying_mode & keying_mode_iambic) {
 				last_keyed = left_didah;
 			} else {
@@ -786,7 +1027,7 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		case keying_x_right_key_release:
 			if (keying_mode & keying_mode_dumb)
 				break;
-			debug("BAD!!! keying_x_right_key_release in keying_left_press\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		}
 		break;
@@ -798,9 +1039,9 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		case keying_x_tick:
 			if (keying_mode == keying_mode_paddle)
 				break;
-			if (keyed_ticks[right_didah]++ == didah_len[right_didah]) {
+			if (keyed_ticks[right_didah]++ >= didah_len[right_didah]) {
 				keyed_ticks[right_didah] = 0;
-				didah_enqueue(right_didah);
+				didah_key(right_didah);
 				last_keyed = right_didah;
 			}
 			break;
@@ -810,7 +1051,7 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 			} else {
 				nstate = keying_both_press;
 			}
-			didah_enqueue(left_didah);
+			didah_key(left_didah);
 			if (keying_mode & keying_mode_iambic) {
 				last_keyed = right_didah;
 			} else {
@@ -821,13 +1062,13 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		case keying_x_left_key_release:
 			if (keying_mode & keying_mode_dumb)
 				break;
-			debug("BAD!!! keying_x_left_key_release in keying_right_press\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_right_key_press:
-			debug("BAD!!! keying_x_right_key_release in keying_right_press\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_right_key_release:
-			debug("keying_x_right_key_release: mode = %u, last_keyed = %d\r\n", keying_mode, last_keyed);
+			trace(TR_KEY_UP, keying_mode, last_keyed);
 			nstate = keying_idle;
 			enqueued_spaces = 0;
 			keyed_ticks[SPACE] = 0;
@@ -839,8 +1080,8 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 		/* if we have a key release, go back to keying_*_press */
 		switch (event) {
 		case keying_x_tick:
-			if (keyed_ticks[last_keyed]++ == didah_len[last_keyed]) {
-				didah_enqueue(last_keyed);
+			if (keyed_ticks[last_keyed]++ >= didah_len[last_keyed]) {
+				didah_key(last_keyed);
 				if (keying_mode & keying_mode_iambic) {
 					last_keyed = other_didah(last_keyed);
 				}
@@ -848,22 +1089,22 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 			}
 			break;
 		case keying_x_left_key_press:
-			debug("BAD!!! keying_x_left_key_press in keying_both_ready\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_left_key_release:
 			keyed_ticks[right_didah] = didah_len[right_didah] - didah_len[DIT];
 			if (keying_mode & keying_mode_iambic_b) {
-				didah_enqueue(last_keyed);
+				didah_key(last_keyed);
 			}
 			nstate = keying_right_press;
 			break;
 		case keying_x_right_key_press:
-			debug("BAD!!! keying_x_right_key_press in keying_both_ready\r\n");
+			trace(TR_KEY_BAD, cstate, event);
 			break;
 		case keying_x_right_key_release:
 			keyed_ticks[left_didah] = didah_len[left_didah] - didah_len[DIT];
 			if (keying_mode & keying_mode_iambic_b) {
-				didah_enqueue(last_keyed);
+				didah_key(last_keyed);
 			}
 			nstate = keying_left_press;
 			break;
@@ -874,9 +1115,8 @@ static void cw_in_advance_tick(enum keying_transition_events event) {
 	sreg(iv);
 }
 
-static clock_select16_t beeper_clock;
 static void beeper_on(void) {
-	timer3_set_scale(beeper_clock);
+	timer3_set_scale(beeper_clock[cw_on_air]);
 }
 static void beeper_off(void) {
 	timer3_set_scale(t16_stopped);
@@ -889,10 +1129,19 @@ void cw_set_word_space(bool spaces, bool save) {
 	word_space = spaces;
 }
 
-void cw_set_frequency(uint8_t hz) {
-	uint16_t top;
-	uint32_t tmp;
+/* cycles is the cpu clock over twice the tone, the timer toggles the
+ * pin at each compare match */
+static void beeper_tune(uint8_t radio, uint32_t cycles) {
+	if (cycles - 1 <= 0xffff) {
+		beeper_top[radio] = cycles - 1;
+		beeper_clock[radio] = t16_no_prescaling;
+	} else {
+		beeper_top[radio] = cycles / 64 - 1;
+		beeper_clock[radio] = t16_divide_by_64;
+	}
+}
 
+void cw_set_frequency(uint8_t hz) {
 	debug("cw_set_frequency(%u)\r\n", hz);
 	if (hz < 8) {
 		debug("hz out of range\r\n");
@@ -900,46 +1149,146 @@ void cw_set_frequency(uint8_t hz) {
 	}
 
 	settings_set_frequency(hz);
-	tmp = (F_CPU/10) / hz / 2 - 1;
-
-	if (tmp <= 0xffff) {
-		top = (uint16_t)tmp;
-		beeper_clock = t16_no_prescaling;
-	} else {
-		top = (F_CPU/10) / hz / 2 / 64 - 1;
-		beeper_clock = t16_divide_by_64;
-	}
+	beeper_tune(0, (F_CPU/10) / hz / 2);
+	beeper_tune(1, (F_CPU/10) * 4 / 5 / hz / 2);
 	// we turn the beeper on independently with beeper_on
-	timer3_set_top(top);
+	timer3_set_top(beeper_top[cw_on_air]);
 }
 
-void cw_set_speed(uint8_t wpm) {
+/* the unit, and everything worked out from it */
+static void cw_retime(uint8_t wpm) {
+	dit_len = 1200 / wpm;
+	dit_rem = 1200 % wpm;
+	dit_wpm = wpm;
+	dit_frac = 0;
+	didah_len[DIT] = 2*dit_len;
+	didah_len[DAH] = 4*dit_len;
+	didah_len[SPACE] = 6*dit_len;
+	cw_weigh();
+}
+
+void cw_set_speed(uint8_t wpm, bool save) {
 	debug("cw_set_speed(%u)\r\n", wpm);
 	if (wpm < 3 || wpm > 99) {
 		debug("wpm out of range\r\n");
 		wpm = 13;
 	}
-	settings_set_wpm(wpm);
-	dit_len = 1200 / wpm;
-	didah_len[DIT] = 2*(uint16_t)dit_len;
-	didah_len[DAH] = 4*(uint16_t)dit_len;
-	didah_len[SPACE] = 6*(uint16_t)dit_len;
+	if (save)
+		settings_set_wpm(wpm);
+	/* an element that is going out finishes at the speed it started */
 	if (ms_tick_registered(TICK_CW_ADVANCE))
-		cw_out_normal_tick();
+		next_wpm = wpm;
+	else
+		cw_retime(wpm);
+}
+
+void cw_set_weighting(uint8_t w, int8_t c) {
+	debug("cw_set_weighting(%u, %d)\r\n", w, c);
+	if (w < 10 || w > 90) {
+		debug("weight out of range\r\n");
+		w = 50;
+	}
+	settings_set_weighting(w, c);
+	weight = w;
+	comp = c;
+	cw_weigh();
+}
+
+void cw_set_ptt(uint8_t lead, uint8_t tail, bool save) {
+	debug("cw_set_ptt(%u, %u)\r\n", lead, tail);
+	if (save)
+		settings_set_ptt(lead, tail);
+	ptt_lead = lead;
+	ptt_tail = tail * 10;
+}
+
+void cw_set_radio(uint8_t radio) {
+	debug("cw_set_radio(%u)\r\n", radio);
+	if (radio >= CW_RADIOS)
+		return;
+	cw_radio = radio;
+}
+
+uint8_t cw_get_radio(void) {
+	return cw_radio;
+}
+
+void cw_set_lane(cw_lane_t lane) {
+	debug("cw_set_lane(%u)\r\n", lane);
+	if (lane >= CW_LANES)
+		return;
+	cw_lane = lane;
+}
+
+cw_lane_t cw_get_lane(void) {
+	return cw_lane;
+}
+
+void cw_set_so2r_policy(so2r_policy_t policy) {
+	debug("cw_set_so2r_policy(%u)\r\n", policy);
+	so2r_policy = policy;
+}
+
+so2r_policy_t cw_get_so2r_policy(void) {
+	return so2r_policy;
 }
 
 void cw_set_keying_mode(keying_mode_t mode) {
 	debug("cw_set_keying_mode(%u)\r\n", mode);
 	keying_mode = mode;
 	settings_set_keying_mode(mode);
+	if (mode == keying_mode_straight)
+		decode_init(dit_len);
 }
 
 void toggle_bit(void) {
 	BEEPER_PORT ^= BEEPER_BIT;
 }
 
+/* hand the straight key's marks and spaces to the decoder, until a
+ * good long while after the last one */
+static void sk_tick(void) {
+	uint16_t now = millis, len = 0, quiet = 0;
+	uint8_t iv = rcli();
+	/* the press came part way through a ms, so the transmitter has
+	 * only had the whole lead on the tick after; what is left of the
+	 * mark goes out then */
+	if (sk_lead && (uint16_t)(now - sk_lead_start) > ptt_lead) {
+		sk_lead = false;
+		if (sk_down)
+			cw_key_on();
+	}
+	if (sk_late) {
+		len = sk_late;
+		sk_late = 0;
+	} else if (!sk_down && sk_held &&
+			(uint16_t)(now - sk_end) >= SK_BRIDGE) {
+		len = sk_end - sk_start;
+		sk_held = false;
+	}
+	if (!sk_down && !sk_held)
+		quiet = now - sk_end;
+	sreg(iv);
+	if (len)
+		decode_mark(len);
+	if (!quiet)
+		return;
+	if (quiet < 10 * decode_dit()) {
+		decode_quiet(quiet);
+		return;
+	}
+	cw_keying = false;
+	ms_tick_unregister(TICK_CW_PARSE);
+	/* anything typed meanwhile can go now */
+	if (cw_busy() && !ms_tick_registered(TICK_CW_ADVANCE))
+		cw_out_hyper_tick();
+}
+
 void cw_tick(void) {
-	cw_in_advance_tick(keying_x_tick);
+	if (keying_mode == keying_mode_straight)
+		sk_tick();
+	else
+		cw_in_advance_tick(keying_x_tick);
 }
 
 void cw_set_dq_callback(cw_dq_cb_t cb) {
@@ -953,8 +1302,9 @@ void cw_enable_outputs(uint8_t enable_what) {
 	}
 
 	if (enable_what & CW_ENABLE_KEYER) {
-		debug("+++ enable keyer bit\r\n");
+		debug("+++ enable keyer bits\r\n");
 		CW_DDR |= CW_BIT;
+		CW2_DDR |= CW2_BIT;
 	}
 
 	if (enable_what & CW_ENABLE_DIDAH) {
@@ -962,6 +1312,12 @@ void cw_enable_outputs(uint8_t enable_what) {
 		DIT_DDR |= DIT_BIT;
 		DAH_DDR |= DAH_BIT;
 	}
+
+	if (enable_what & CW_ENABLE_PTT) {
+		debug("+++ enable ptt bits\r\n");
+		PTT_DDR |= PTT_BIT;
+		PTT2_DDR |= PTT2_BIT;
+	}
 }
 
 void cw_disable_outputs(uint8_t disable_what) {
@@ -973,6 +1329,7 @@ void cw_disable_outputs(uint8_t disable_what) {
 	if (disable_what & CW_ENABLE_KEYER) {
 		debug("--- disable keyer bits\r\n");
 		CW_DDR &= ~CW_BIT;
+		CW2_DDR &= ~CW2_BIT;
 	}
 
 	if (disable_what & CW_ENABLE_DIDAH) {
@@ -980,6 +1337,12 @@ void cw_disable_outputs(uint8_t disable_what) {
 		DIT_DDR &= ~DIT_BIT;
 		DAH_DDR &= ~DAH_BIT;
 	}
+
+	if (disable_what & CW_ENABLE_PTT) {
+		debug("--- disable ptt bits\r\n");
+		PTT_DDR &= ~PTT_BIT;
+		PTT2_DDR &= ~PTT2_BIT;
+	}
 }
 
 static void output_didah(didah_queue_t didah, bool pressed) {
@@ -998,27 +1361,93 @@ static void output_didah(didah_queue_t didah, bool pressed) {
 	}
 }
 
+/* either contact keys, so a sideswiper works as well as a straight key.
+ * The output goes first, everything else can wait until it is done. */
+static void sk_edge(void) {
+	bool down = (PIND & (_BV(PD0) | _BV(PD1))) != (_BV(PD0) | _BV(PD1));
+	uint16_t now = millis;
+
+	if (down == sk_down)
+		return;
+	if (down) {
+		if (cw_radio != cw_on_air) {
+			/* the engine may be part way through a mark on the
+			 * other radio; cw_switch is only for between marks,
+			 * so that mark ends here, with the rest of its
+			 * character */
+			if (cw_on_air)
+				CW2_PORT &= ~CW2_BIT;
+			else
+				CW_PORT &= ~CW_BIT;
+			didah_drop();
+			cw_switch(cw_radio);
+		}
+		/* the transmitter is switched over before it is keyed,
+		 * and the first mark gives up the lead to it */
+		if (!ptt_on) {
+			ptt_set(true);
+			sk_lead = ptt_lead != 0;
+			sk_lead_start = now;
+		}
+		if (sk_lead)
+			beeper_on();
+		else
+			cw_led_on();
+		sk_down = true;
+		if (sk_held && (uint16_t)(now - sk_end) >= SK_BRIDGE) {
+			/* the tick has not got to the last one yet */
+			sk_late = sk_end - sk_start;
+			sk_held = false;
+		}
+		/* after a bounce, the mark carries on from where it was */
+		if (!sk_held)
+			sk_start = now;
+		sk_held = true;
+		cw_keying = true;
+		/* for the ptt tail, and text that is waiting */
+		if (!ms_tick_registered(TICK_CW_ADVANCE))
+			cw_out_hyper_tick();
+		if (!ms_tick_registered(TICK_CW_PARSE))
+			ms_tick_register(cw_tick, TICK_CW_PARSE, 1);
+	} else {
+		sk_down = false;
+		cw_led_off();
+		sk_end = now;
+	}
+	trace(TR_KEY_STRAIGHT, down, PIND);
+}
+
 ISR(INT0_vect) {
 	enum keying_transition_events event;
+	if (keying_mode == keying_mode_straight) {
+		sk_edge();
+		return;
+	}
 	if (!ms_tick_registered(TICK_CW_PARSE)) {
 		ms_tick_register(cw_tick, TICK_CW_PARSE, 1);
 	}
 	event = (PIND & _BV(PD0)) ?
 	        keying_x_left_key_release : keying_x_left_key_press;
+	stack_mark(STACK_PADDLE);
 	output_didah(left_didah, event == keying_x_left_key_press);
-	debug("key_left_%s (%d)\r\n", ((event==keying_x_left_key_press)?"press":"release"), PIND);
+	trace(TR_KEY_LEFT, event, PIND);
 	cw_in_advance_tick(event);
 }
 
 ISR(INT1_vect) {
 	enum keying_transition_events event;
+	if (keying_mode == keying_mode_straight) {
+		sk_edge();
+		return;
+	}
 	if (!ms_tick_registered(TICK_CW_PARSE)) {
 		ms_tick_register(cw_tick, TICK_CW_PARSE, 1);
 	}
 	event = (PIND & _BV(PD1)) ?
 	        keying_x_right_key_release : keying_x_right_key_press;
+	stack_mark(STACK_PADDLE);
 	output_didah(right_didah, event == keying_x_right_key_press);
-	debug("key_right_%s (%d)\r\n", ((event==keying_x_right_key_press)?"press":"release"), PIND);
+	trace(TR_KEY_RIGHT, event, PIND);
 	cw_in_advance_tick(event);
 }
 
@@ -1040,9 +1469,17 @@ void cw_set_beeper(bool beep) {
 void cw_init(uint8_t wpm, cw_dq_cb_t cb) {
 	timer3_set_compare_a_callback(&toggle_bit);
 	cw_set_dq_callback(cb);
+	/* routing is not saved, everything starts out on the first radio */
+	cw_radio = cw_on_air = 0;
+	cw_lane = out_lane = cw_lane_text;
+	so2r_policy = so2r_message;
+	sk_down = sk_held = sk_lead = false;
+	sk_late = 0;
+	sk_end = millis;
 
 	/* load all the settings */
 	restore_preset(settings_get_preset());
+	cw_set_ptt(settings_get_ptt_lead(), settings_get_ptt_tail(), false);
 
 	/* setup the output pins/ports */
 	cw_enable_outputs(CW_ENABLE_ALL);
@@ -1060,4 +1497,5 @@ void cw_fini(void) {
 	cw_set_dq_callback(NULL);
 	cw_clear_queues();
 	timer3_stop();
+	ptt_set(false);
 }
@@ -45,6 +45,29 @@
 #define CW_DDR  _DDR(CW_PORT_LETTER)
 #define CW_BIT  _BV(CW_BIT_NUMBER)
 
+/* push to talk for the transmitter, high while it should be on */
+#define PTT_PORT_LETTER F
+#define PTT_BIT_NUMBER 4
+
+#define PTT_PORT _PORT(PTT_PORT_LETTER)
+#define PTT_DDR  _DDR(PTT_PORT_LETTER)
+#define PTT_BIT  _BV(PTT_BIT_NUMBER)
+
+/* the second radio's key and ptt, for so2r */
+#define CW2_PORT_LETTER B
+#define CW2_BIT_NUMBER 5
+
+#define CW2_PORT _PORT(CW2_PORT_LETTER)
+#define CW2_DDR  _DDR(CW2_PORT_LETTER)
+#define CW2_BIT  _BV(CW2_BIT_NUMBER)
+
+#define PTT2_PORT_LETTER B
+#define PTT2_BIT_NUMBER 6
+
+#define PTT2_PORT _PORT(PTT2_PORT_LETTER)
+#define PTT2_DDR  _DDR(PTT2_PORT_LETTER)
+#define PTT2_BIT  _BV(PTT2_BIT_NUMBER)
+
 #define BEEPER_PORT_LETTER B
 #define BEEPER_BIT_NUMBER 4
 
@@ -52,13 +75,32 @@
 #define BEEPER_DDR  _DDR(BEEPER_PORT_LETTER)
 #define BEEPER_BIT  _BV(BEEPER_BIT_NUMBER)
 
+/* characters waiting to be sent, on the first radio and the second;
+ * the second only has to hold what is typed ahead while the first one
+ * sends */
+#define CW_Q_LEN 128
+#define CW2_Q_LEN 48
+/* replies to the operator in command mode, which only ever has one
+ * waiting at a time */
+#define CW_REPLY_Q_LEN 48
+
 #define CW_ENABLE_BEEPER 0x01
 #define CW_ENABLE_KEYER  0x02
 #define CW_ENABLE_DIDAH  0x04
-#define CW_ENABLE_ALL    (CW_ENABLE_BEEPER|CW_ENABLE_KEYER|CW_ENABLE_DIDAH)
+#define CW_ENABLE_PTT    0x08
+#define CW_ENABLE_ALL    (CW_ENABLE_BEEPER|CW_ENABLE_KEYER|CW_ENABLE_DIDAH|\
+			  CW_ENABLE_PTT)
 
 typedef void(*cw_dq_cb_t)(uint8_t);
 
+/* a source of characters that is read as they are sent (memories).
+ * cw_play queues a marker that starts source id when it comes up in
+ * cw_q; from then on next is asked for each character until it returns
+ * 0.  next may return CW_SRC_WAIT to be asked again on the next tick. */
+typedef void(*cw_src_open_t)(uint8_t id);
+typedef uint8_t(*cw_src_next_t)(void);
+#define CW_SRC_WAIT 0xff
+
 typedef enum {
 	keying_mode_unset = 0,
 	keying_mode_straight,
@@ -71,6 +113,27 @@ typedef enum {
 	keying_mode_iambic_b = 0x12,
 } __attribute__((packed)) keying_mode_t;
 
+/* with two radios, only one sends at a time; when both have something
+ * to send, the one sending hands over once it runs out (so2r_message)
+ * or at the end of each word (so2r_word) */
+typedef enum {
+	so2r_message,
+	so2r_word,
+} __attribute__((packed)) so2r_policy_t;
+
+#define CW_RADIOS 2
+
+/* what is sent comes from two lanes.  Replies to the operator cut in
+ * ahead of the text lane (type-ahead, memories and repeats) at the next
+ * character boundary, even part way through a memory, so they never
+ * wait on a backlog. */
+typedef enum {
+	cw_lane_reply,
+	cw_lane_text,
+} __attribute__((packed)) cw_lane_t;
+
+#define CW_LANES 2
+
 typedef enum {
 	DIT,
 	DAH,
@@ -79,7 +142,9 @@ typedef enum {
 
 void cw_char(char c);
 void cw_string(const char* str);
-void cw_set_speed(uint8_t wpm);
+/* takes over between elements if anything is being sent; save keeps it
+ * in the current preset */
+void cw_set_speed(uint8_t wpm, bool save);
 void cw_set_left_key(didah_queue_t didah);
 didah_queue_t cw_get_left_key(void);
 void cw_init(uint8_t wpm, cw_dq_cb_t cb);
@@ -88,9 +153,34 @@ void cw_set_word_space(bool spaces, bool save);
 void cw_set_frequency(uint8_t hz);
 void cw_set_keying_mode(keying_mode_t mode);
 void cw_set_dq_callback(cw_dq_cb_t cb);
+void cw_set_source(cw_src_open_t open, cw_src_next_t next);
+void cw_play(uint8_t id);
+bool cw_busy(void);
 void cw_enable_outputs(uint8_t enable_what);
 void cw_disable_outputs(uint8_t enable_what);
 void cw_clear_queues(void);
 void cw_set_beeper(bool beep);
+/* ptt goes on lead ms before the first mark and off tail*10 ms after
+ * the last, or as soon as there is nothing left to send.  The straight
+ * key's first mark can't be seen coming, so ptt goes on with the press
+ * and the output follows lead ms into it. */
+void cw_set_ptt(uint8_t lead, uint8_t tail, bool save);
+/* marks are weight/50 of a unit long, plus comp tenths of a ms, and the
+ * space after each one gives up what the mark gained */
+void cw_set_weighting(uint8_t weight, int8_t comp);
+/* text, memories and the paddles go to radio (0 or 1) from here on */
+void cw_set_radio(uint8_t radio);
+uint8_t cw_get_radio(void);
+void cw_set_so2r_policy(so2r_policy_t policy);
+so2r_policy_t cw_get_so2r_policy(void);
+/* cw_char and cw_string go to lane from here on (cw_play is always
+ * text), and what is sent is only echoed to cw_dq_cb from that lane, so
+ * the echo of a reply can be counted on */
+void cw_set_lane(cw_lane_t lane);
+cw_lane_t cw_get_lane(void);
+/* the decoder behind cw_dq_cb for what comes in.  The paddles go
+ * through it as they are keyed, and elements from anywhere else (see
+ * rx.c) can be fed in here too; text gets its own as it is sent. */
+void didah_decode(didah_queue_t next);
 
 #endif
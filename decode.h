@@ -0,0 +1,40 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+/* the timing decoder: mark and space lengths in, elements out to
+ * didah_decode.  thresh.c, or hmm.c when built with HMM (make HMM=1);
+ * the receive decoder (rx.c) and the straight key (cw.c) share it. */
+#ifdef HMM
+#include "hmm.h"
+#define decode_init hmm_init
+#define decode_mark hmm_mark
+#define decode_quiet hmm_quiet
+#define decode_dit hmm_dit
+#else
+#include "thresh.h"
+#define decode_init thresh_init
+#define decode_mark thresh_mark
+#define decode_quiet thresh_quiet
+#define decode_dit thresh_dit
+#endif /* HMM */
+
+#endif /* _DECODE_H_ */
@@ -0,0 +1,441 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include "eeq.h"
+
+/* pointers into EEMEM are eeprom addresses on the avr */
+#ifndef EE_ADDR
+#define EE_ADDR(P) ((uint16_t)(P))
+#endif
+
+/* how many unchanged bytes to skip over per interrupt before giving
+ * the rest of the system a chance to run */
+#define EEQ_SCAN 8
+
+enum eeq_src {
+	eeq_src_data,  /* up to four bytes carried in the job */
+	eeq_src_fill,  /* data[0], len times */
+	eeq_src_flash, /* program memory */
+	eeq_src_ram,   /* the staging buffer */
+	eeq_src_live,  /* caller's ram, read as it is written out */
+	eeq_src_copy,  /* another part of the eeprom, low to high */
+	eeq_src_rcopy, /* another part of the eeprom, high to low */
+} __attribute__((packed));
+
+struct eeq_job {
+	uint16_t addr;
+	uint16_t len;
+	uint16_t done;
+	enum eeq_src type;
+	uint8_t period;    /* source repeats every period bytes (0: never) */
+	union {
+		const uint8_t *src;
+		uint16_t from;
+		uint8_t data[4];
+	} u;
+};
+
+static struct eeq_job eeq_jobs[EEQ_LEN];
+static uint8_t eeq_head;
+static volatile uint8_t eeq_count;
+static uint8_t eeq_stage[EEQ_STAGE_LEN];
+static bool eeq_staged;
+/* a write was turned away for want of room, so eeq_drained is to be
+ * told once there is some */
+static bool eeq_refused;
+static void (*eeq_drained)(void);
+
+/* a byte eeq_try_read_byte found the eeprom busy for.  The writer reads
+ * it for the reader before it starts its next write, so the reader gets
+ * its turn without the writer ever having to be stopped. */
+static uint16_t eeq_want_addr;
+static uint8_t eeq_want_val;
+static enum {
+	eeq_want_none,
+	eeq_want_asked,
+	eeq_want_read,
+} __attribute__((packed)) eeq_want;
+
+/* raw register access; the caller makes sure the eeprom is idle */
+static inline uint8_t ee_get(uint16_t addr) {
+	EEAR = addr;
+	EECR |= _BV(EERE);
+	return EEDR;
+}
+
+static inline void ee_put(uint16_t addr, uint8_t val) {
+	EEAR = addr;
+	EEDR = val;
+	EECR |= _BV(EEMPE);
+	EECR |= _BV(EEPE);
+}
+
+static inline struct eeq_job *eeq_job_at(uint8_t n) {
+	uint8_t i = eeq_head + n;
+	if (i >= EEQ_LEN)
+		i -= EEQ_LEN;
+	return &eeq_jobs[i];
+}
+
+/* offset within the job of the next byte to write */
+static inline uint16_t eeq_job_pos(const struct eeq_job *job) {
+	if (job->type == eeq_src_rcopy)
+		return job->len - 1 - job->done;
+	return job->done;
+}
+
+static inline bool eeq_job_written(const struct eeq_job *job, uint16_t off) {
+	if (job->type == eeq_src_rcopy)
+		return off >= job->len - job->done;
+	return off < job->done;
+}
+
+/* copy jobs read the eeprom here, so they may only be asked about
+ * once they are at the head of the queue and the eeprom is idle */
+static uint8_t eeq_job_byte(const struct eeq_job *job, uint16_t off) {
+	if (job->period)
+		off %= job->period;
+	switch (job->type) {
+	case eeq_src_data:
+		return job->u.data[off];
+	case eeq_src_fill:
+		return job->u.data[0];
+	case eeq_src_flash:
+		return pgm_read_byte(job->u.src + off);
+	case eeq_src_copy:
+	case eeq_src_rcopy:
+		return ee_get(job->u.from + off);
+	default:
+		return job->u.src[off];
+	}
+}
+
+/* newest queued job that will write addr, if any */
+static struct eeq_job *eeq_find(uint16_t addr) {
+	struct eeq_job *job;
+	uint8_t n;
+	for (n = eeq_count; n > 0; n--) {
+		job = eeq_job_at(n - 1);
+		if ((uint16_t)(addr - job->addr) < job->len)
+			return job;
+	}
+	return NULL;
+}
+
+/* work out what *addr will hold once everything queued is written.
+ * Returns true with *v set if a queued job supplies the byte, otherwise
+ * false with *addr set to the eeprom location that holds it now (a
+ * copy job sends us off to its source, as seen by the jobs before it). */
+static bool eeq_lookup(uint16_t *addr, uint8_t *v) {
+	struct eeq_job *job;
+	uint16_t off;
+	uint8_t n = eeq_count;
+	while (n--) {
+		job = eeq_job_at(n);
+		off = *addr - job->addr;
+		if (off >= job->len)
+			continue;
+		/* older jobs are all done, so it is in the eeprom */
+		if (eeq_job_written(job, off))
+			break;
+		if (job->type == eeq_src_copy || job->type == eeq_src_rcopy) {
+			*addr = job->u.from + off;
+			continue;
+		}
+		*v = eeq_job_byte(job, off);
+		return true;
+	}
+	return false;
+}
+
+/* write at most one byte of the job at the head of the queue.
+ * Called from EE_READY, or polled with interrupts off. */
+static void eeq_service(void) {
+	struct eeq_job *job;
+	uint16_t addr, off;
+	uint8_t v, scan = EEQ_SCAN;
+
+	if (eeq_want == eeq_want_asked) {
+		eeq_want_val = ee_get(eeq_want_addr);
+		eeq_want = eeq_want_read;
+	}
+	while (eeq_count) {
+		job = &eeq_jobs[eeq_head];
+		while (job->done < job->len) {
+			off = eeq_job_pos(job);
+			addr = job->addr + off;
+			v = eeq_job_byte(job, off);
+			job->done++;
+			if (ee_get(addr) != v) {
+				/* keep a byte read for the reader up to date */
+				if (addr == eeq_want_addr)
+					eeq_want_val = v;
+				ee_put(addr, v);
+				return;
+			}
+			if (--scan == 0)
+				return;
+		}
+		if (job->type == eeq_src_ram)
+			eeq_staged = false;
+		if (++eeq_head == EEQ_LEN)
+			eeq_head = 0;
+		eeq_count--;
+	}
+	if (eeq_refused && eeq_drained) {
+		eeq_refused = false;
+		eeq_drained();
+		if (eeq_count)
+			return;
+	}
+	EECR &= ~_BV(EERIE);
+}
+
+ISR(EE_READY_vect) {
+	eeq_service();
+}
+
+/* push one write out by hand; interrupts must be off */
+static void eeq_poll(void) {
+	eeprom_busy_wait();
+	eeq_service();
+}
+
+/* reserve the next job slot; interrupts must be off.  NULL if the
+ * queue is full. */
+static struct eeq_job *eeq_alloc(void *dst, uint16_t len,
+		enum eeq_src type, uint8_t period) {
+	struct eeq_job *job;
+	if (eeq_count == EEQ_LEN) {
+		eeq_refused = true;
+		return NULL;
+	}
+	job = eeq_job_at(eeq_count);
+	job->addr = EE_ADDR(dst);
+	job->len = len;
+	job->done = 0;
+	job->type = type;
+	job->period = period;
+	return job;
+}
+
+static void eeq_commit(void) {
+	eeq_count++;
+	EECR |= _BV(EERIE);
+}
+
+bool eeq_write_byte(uint8_t *dst, uint8_t val) {
+	struct eeq_job *job;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		job = eeq_find(EE_ADDR(dst));
+		if (job && job->type == eeq_src_data &&
+				job->len == 1 && job->done == 0) {
+			/* not written yet, just change what gets written */
+			job->u.data[0] = val;
+		} else {
+			if (!(job = eeq_alloc(dst, 1, eeq_src_data, 0)))
+				return false;
+			job->u.data[0] = val;
+			eeq_commit();
+		}
+	}
+	return true;
+}
+
+bool eeq_write_block(void *dst, const void *src, uint8_t len) {
+	struct eeq_job *job;
+	if (len <= sizeof(job->u.data)) {
+		/* small enough to carry in the job itself */
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			if (!(job = eeq_alloc(dst, len, eeq_src_data, 0)))
+				return false;
+			memcpy(job->u.data, src, len);
+			eeq_commit();
+		}
+		return true;
+	}
+	if (len > EEQ_STAGE_LEN)
+		len = EEQ_STAGE_LEN;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		/* only one staged block at a time */
+		if (eeq_staged) {
+			eeq_refused = true;
+			return false;
+		}
+		if (!(job = eeq_alloc(dst, len, eeq_src_ram, 0)))
+			return false;
+		memcpy(eeq_stage, src, len);
+		eeq_staged = true;
+		job->u.src = eeq_stage;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_write_live(void *dst, const void *src, uint16_t len) {
+	struct eeq_job *job;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!(job = eeq_alloc(dst, len, eeq_src_live, 0)))
+			return false;
+		job->u.src = src;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_repeat_P(void *dst, const void *src, uint8_t len, uint8_t count) {
+	struct eeq_job *job;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		job = eeq_alloc(dst, (uint16_t)len * count, eeq_src_flash, len);
+		if (!job)
+			return false;
+		job->u.src = src;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_write_block_P(void *dst, const void *src, uint16_t len) {
+	struct eeq_job *job;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!(job = eeq_alloc(dst, len, eeq_src_flash, 0)))
+			return false;
+		job->u.src = src;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_fill(void *dst, uint8_t val, uint16_t len) {
+	struct eeq_job *job;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (!(job = eeq_alloc(dst, len, eeq_src_fill, 0)))
+			return false;
+		job->u.data[0] = val;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_copy(void *dst, const void *src, uint16_t len) {
+	struct eeq_job *job;
+	uint16_t from = EE_ADDR(src);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		/* copy away from the overlap so the source is read before
+		 * it gets written over */
+		job = eeq_alloc(dst, len,
+			EE_ADDR(dst) > from ? eeq_src_rcopy : eeq_src_copy, 0);
+		if (!job)
+			return false;
+		job->u.from = from;
+		eeq_commit();
+	}
+	return true;
+}
+
+bool eeq_room(uint8_t jobs, bool stage) {
+	bool room;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		room = EEQ_LEN - eeq_count >= jobs && !(stage && eeq_staged);
+		if (!room)
+			eeq_refused = true;
+	}
+	return room;
+}
+
+void eeq_set_drained(void (*drained)(void)) {
+	eeq_drained = drained;
+}
+
+uint8_t eeq_read_byte(const uint8_t *src) {
+	uint16_t addr = EE_ADDR(src);
+	uint8_t v;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (eeq_lookup(&addr, &v))
+			return v;
+		/* hold off the writer so we are not starved by it */
+		EECR &= ~_BV(EERIE);
+	}
+	/* now only a write already in flight can keep us waiting */
+	eeprom_busy_wait();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		addr = EE_ADDR(src);
+		if (!eeq_lookup(&addr, &v)) {
+			eeprom_busy_wait();
+			v = ee_get(addr);
+		}
+		if (eeq_count)
+			EECR |= _BV(EERIE);
+	}
+	return v;
+}
+
+bool eeq_try_read_byte(const uint8_t *src, uint8_t *v) {
+	uint16_t addr = EE_ADDR(src);
+	bool ok = true;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if (eeq_lookup(&addr, v))
+			return true;
+		if (eeq_want == eeq_want_read && addr == eeq_want_addr) {
+			*v = eeq_want_val;
+			eeq_want = eeq_want_none;
+		} else if (eeprom_is_ready()) {
+			*v = ee_get(addr);
+		} else {
+			/* a write is in flight, and the writer will go
+			 * straight on to the next one when it is done, so
+			 * ask it to read this first */
+			eeq_want_addr = addr;
+			eeq_want = eeq_want_asked;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+void eeq_read_block(void *dst, const void *src, uint16_t len) {
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	while (len--)
+		*d++ = eeq_read_byte(s++);
+}
+
+uint32_t eeq_read_dword(const uint32_t *src) {
+	uint32_t v;
+	eeq_read_block(&v, src, sizeof(v));
+	return v;
+}
+
+bool eeq_busy(void) {
+	return eeq_count != 0;
+}
+
+void eeq_flush(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		while (eeq_count)
+			eeq_poll();
+	}
+}
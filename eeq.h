@@ -0,0 +1,96 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _EEQ_H_
+#define _EEQ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* eeprom write queue
+ *
+ * An eeprom byte write takes ~3.4ms, so instead of spinning on EEPE,
+ * writes are queued as jobs and trickled out one byte at a time from
+ * the EE_READY interrupt.  Unchanged bytes are skipped (update
+ * semantics).  All eeprom reads should go through eeq_read_* so that
+ * they see queued-but-unwritten data.
+ *
+ * Writes are queued from interrupts (command mode, the memory player),
+ * so they never wait for room.  If the queue is full, or eeq_write_block
+ * finds the staging buffer still in use, nothing is queued and false is
+ * returned; eeq_drained is called from EE_READY once the queue has run
+ * empty, so the caller can have another go.
+ */
+
+/* number of outstanding write jobs */
+#define EEQ_LEN 8
+/* largest block that can be copied out of ram by eeq_write_block;
+ * enough for a whole encoded memory */
+#define EEQ_STAGE_LEN 72
+
+/* queue a single byte; a still pending write of the same byte is
+ * replaced rather than queued again */
+bool eeq_write_byte(uint8_t *dst, uint8_t val);
+
+/* queue len bytes from ram; src is copied so it may be reused at once */
+bool eeq_write_block(void *dst, const void *src, uint8_t len);
+
+/* queue len bytes from ram without copying them: src must stay valid
+ * until the write is done, and whatever it holds at that point is what
+ * ends up in the eeprom */
+bool eeq_write_live(void *dst, const void *src, uint16_t len);
+
+/* queue len bytes from flash */
+bool eeq_write_block_P(void *dst, const void *src, uint16_t len);
+
+/* queue count back-to-back copies of a len byte pattern from flash */
+bool eeq_repeat_P(void *dst, const void *src, uint8_t len, uint8_t count);
+
+/* queue len copies of val */
+bool eeq_fill(void *dst, uint8_t val, uint16_t len);
+
+/* queue a move of len bytes within the eeprom; the regions may overlap.
+ * src is read as it is when the copy gets to it, after anything queued
+ * before it has been written. */
+bool eeq_copy(void *dst, const void *src, uint16_t len);
+
+/* true if jobs more writes, and a block through the staging buffer if
+ * stage, can be queued now; for changes that have to go in whole */
+bool eeq_room(uint8_t jobs, bool stage);
+
+/* called from EE_READY when the queue runs empty after a write was
+ * turned away */
+void eeq_set_drained(void (*drained)(void));
+
+uint8_t eeq_read_byte(const uint8_t *src);
+/* like eeq_read_byte, but gives up instead of waiting for the eeprom.
+ * The byte is then read as soon as the write in flight is done, ahead
+ * of the next one, so asking again a little later gets it. */
+bool eeq_try_read_byte(const uint8_t *src, uint8_t *v);
+uint32_t eeq_read_dword(const uint32_t *src);
+void eeq_read_block(void *dst, const void *src, uint16_t len);
+
+/* true while there are writes waiting for the eeprom */
+bool eeq_busy(void);
+
+/* write out everything that is queued, polling the eeprom.  This is
+ * safe with interrupts disabled, so it can be used on the way out. */
+void eeq_flush(void);
+
+#endif /* _EEQ_H_ */
@@ -0,0 +1,190 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include "ringbuffer.h"
+#include "trace.h"
+#include "hid.h"
+
+static const prog_uint8_t ascii2hid[] = {
+	/* 00 */  0,     /*  */
+	/* 01 */  0,     /*  */
+	/* 02 */  0,     /*  */
+	/* 03 */  0,     /*  */
+	/* 04 */  0,     /*  */
+	/* 05 */  0,     /*  */
+	/* 06 */  0,     /*  */
+	/* 07 */  0,     /*  */
+	/* 08 */  0x2a,  /* Backspace */
+	/* 09 */  0,     /*  */
+	/* 0a */  0x28,  /*  */
+	/* 0b */  0,     /*  */
+	/* 0c */  0,     /*  */
+	/* 0d */  0,     /*  */
+	/* 0e */  0,     /*  */
+	/* 0f */  0,     /*  */
+	/* 10 */  0,     /*  */
+	/* 11 */  0,     /*  */
+	/* 12 */  0,     /*  */
+	/* 13 */  0,     /*  */
+	/* 14 */  0,     /*  */
+	/* 15 */  0,     /*  */
+	/* 16 */  0,     /*  */
+	/* 17 */  0,     /*  */
+	/* 18 */  0,     /*  */
+	/* 19 */  0,     /*  */
+	/* 1a */  0,     /*  */
+	/* 1b */  0,     /*  */
+	/* 1c */  0,     /*  */
+	/* 1d */  0,     /*  */
+	/* 1e */  0,     /*  */
+	/* 1f */  0,     /*  */
+	/* 20 */  0x2c,  /* ' ' */
+	/* 21 */  0x1e | 0x80,  /* '!' */
+	/* 22 */  0x34 | 0x80,  /* '"' */
+	/* 23 */  0,     /* '#' */
+	/* 24 */  0x21 | 0x80,  /* '$' */
+	/* 25 */  0,     /* '%' */
+	/* 26 */  0,     /* '&' */
+	/* 27 */  0,     /* '´' */
+	/* 28 */  0x26 | 0x80,  /* '(' */
+	/* 29 */  0x27 | 0x80,  /* ')' */
+	/* 2a */  0,     /* '*' */
+	/* 2b */  0x2e | 0x80,  /* '+' */
+	/* 2c */  0x36,  /* ',' */
+	/* 2d */  0x2d,  /* '-' */
+	/* 2e */  0x37,  /* '.' */
+	/* 2f */  0x38,  /* '/' */
+	/* 30 */  0x27,  /* '0' */
+	/* 31 */  0x1e,  /* '1' */
+	/* 32 */  0x1f,  /* '2' */
+	/* 33 */  0x20,  /* '3' */
+	/* 34 */  0x21,  /* '4' */
+	/* 35 */  0x22,  /* '5' */
+	/* 36 */  0x23,  /* '6' */
+	/* 37 */  0x24,  /* '7' */
+	/* 38 */  0x25,  /* '8' */
+	/* 39 */  0x26,  /* '9' */
+	/* 3a */  0x13 | 0x80,  /* ':' */
+	/* 3b */  0x13,  /* ';' */
+	/* 3c */  0,     /* '<' */
+	/* 3d */  0x2e,  /* '=' */
+	/* 3e */  0,     /* '>' */
+	/* 3f */  0x38 | 0x80,  /* '?' */
+	/* 40 */  0,     /* '@' */
+	/* 41 */  0x04 | 0x80,  /* 'A' */
+	/* 42 */  0x05 | 0x80,  /* 'B' */
+	/* 43 */  0x06 | 0x80,  /* 'C' */
+	/* 44 */  0x0a | 0x80,  /* 'D' */
+	/* 45 */  0x0e | 0x80,  /* 'E' */
+	/* 46 */  0x08 | 0x80,  /* 'F' */
+	/* 47 */  0x17 | 0x80,  /* 'G' */
+	/* 48 */  0x0b | 0x80,  /* 'H' */
+	/* 49 */  0x0f | 0x80,  /* 'I' */
+	/* 4a */  0x1c | 0x80,  /* 'J' */
+	/* 4b */  0x11 | 0x80,  /* 'K' */
+	/* 4c */  0x18 | 0x80,  /* 'L' */
+	/* 4d */  0x10 | 0x80,  /* 'M' */
+	/* 4e */  0x0d | 0x80,  /* 'N' */
+	/* 4f */  0x33 | 0x80,  /* 'O' */
+	/* 50 */  0x15 | 0x80,  /* 'P' */
+	/* 51 */  0x14 | 0x80,  /* 'Q' */
+	/* 52 */  0x16 | 0x80,  /* 'R' */
+	/* 53 */  0x07 | 0x80,  /* 'S' */
+	/* 54 */  0x09 | 0x80,  /* 'T' */
+	/* 55 */  0x0c | 0x80,  /* 'U' */
+	/* 56 */  0x19 | 0x80,  /* 'V' */
+	/* 57 */  0x1a | 0x80,  /* 'W' */
+	/* 58 */  0x1b | 0x80,  /* 'X' */
+	/* 59 */  0x12 | 0x80,  /* 'Y' */
+	/* 5a */  0x1d | 0x80,  /* 'Z' */
+	/* 5b */  0,     /* '[' */
+	/* 5c */  0,     /* '\' */
+	/* 5d */  0,     /* ']' */
+	/* 5e */  0,     /* '^' */
+	/* 5f */  0x2d | 0x80,  /* '_' */
+	/* 60 */  0x34,  /* '`' */
+	/* 61 */  0x04,  /* 'a' */
+	/* 62 */  0x05,  /* 'b' */
+	/* 63 */  0x06,  /* 'c' */
+	/* 64 */  0x0a,  /* 'd' */
+	/* 65 */  0x0e,  /* 'e' */
+	/* 66 */  0x08,  /* 'f' */
+	/* 67 */  0x17,  /* 'g' */
+	/* 68 */  0x0b,  /* 'h' */
+	/* 69 */  0x0f,  /* 'i' */
+	/* 6a */  0x1c,  /* 'j' */
+	/* 6b */  0x11,  /* 'k' */
+	/* 6c */  0x18,  /* 'l' */
+	/* 6d */  0x10,  /* 'm' */
+	/* 6e */  0x0d,  /* 'n' */
+	/* 6f */  0x33,  /* 'o' */
+	/* 70 */  0x15,  /* 'p' */
+	/* 71 */  0x14,  /* 'q' */
+	/* 72 */  0x16,  /* 'r' */
+	/* 73 */  0x07,  /* 's' */
+	/* 74 */  0x09,  /* 't' */
+	/* 75 */  0x0c,  /* 'u' */
+	/* 76 */  0x19,  /* 'v' */
+	/* 77 */  0x1a,  /* 'w' */
+	/* 78 */  0x1b,  /* 'x' */
+	/* 79 */  0x12,  /* 'y' */
+	/* 7a */  0x1d,  /* 'z' */
+	/* 7b */  0,     /* '{' */
+	/* 7c */  0,     /* '|' */
+	/* 7d */  0,     /* '}' */
+	/* 7e */  0,     /* '~' */
+	/* 7f */  0,     /* DEL */
+};
+
+DECLARE_RINGBUFFER(hid_q, 8);
+
+void hid_nq(uint8_t c) {
+	trace(TR_HID_NQ, c, 0);
+	ringbuffer_push(&hid_q, c);
+}
+
+/* We only report one key at a time because the report buffer is a
+ * list of keys currently pressed, not keys to add to the queue.  So
+ * if we want to add a whole bunch of key presses, we add them one
+ * at a time in subsequent HID reports, with a report of no keys in
+ * between two of the same.
+ */
+bool hid_report(USB_KeyboardReport_Data_t *report) {
+	static uint8_t last_key = 0;
+	uint8_t c, v;
+
+	c = ringbuffer_peek(&hid_q);
+	if (!c || last_key == c) {
+		last_key = 0;
+		return false;
+	}
+	last_key = c = ringbuffer_pop(&hid_q);
+	v = pgm_read_byte(&ascii2hid[c]);
+	trace(TR_HID_KEY, c, v);
+	if (v & 0x80) {
+		report->Modifier = HID_KEYBOARD_MODIFER_LEFTSHIFT;
+		v &= 0x7f;
+	} else
+		report->Modifier = 0;
+	report->KeyCode[0] = v;
+	return true;
+}
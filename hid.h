@@ -0,0 +1,39 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _HID_H_
+#define _HID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include <LUFA/Drivers/USB/Class/HID.h>
+
+/* keyboard output
+ *
+ * Decoded characters are queued by hid_nq and typed one per report as
+ * the usb side asks for them.
+ */
+
+void hid_nq(uint8_t c);
+
+/* fill in the next keyboard report; true if it has a key down */
+bool hid_report(USB_KeyboardReport_Data_t *report);
+
+#endif /* _HID_H_ */
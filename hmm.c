@@ -0,0 +1,290 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+#include "cw.h"
+#include "trace.h"
+#include "hmm.h"
+
+/* lengths are compared as 16 log2(ms), so a dah (3 dits) is 25 above a
+ * dit whatever the speed, and each speed is 4 (a fourth root of 2, 19%)
+ * faster than the next */
+#define HMM_LG_MIN 64 /* 16ms */
+#define HMM_STEP 4
+#define HMM_DIT_MAX 215
+
+/* costs are -log of the probability, in quarters */
+#define HMM_STAY 1  /* the speed holds from one mark or space to the next */
+#define HMM_MOVE 9  /* or moves a step */
+#define HMM_INF 0xffff
+#define HMM_CAP 0x3fff
+
+/* labels as they go in the history, marks and spaces each from 0 */
+#define HMM_DIT 0
+#define HMM_DAH 1
+#define HMM_EG 0 /* between elements */
+#define HMM_CG 1 /* between characters */
+#define HMM_WG 2 /* between words */
+
+/* what each kind of space costs up front; dits and dahs come as they
+ * come */
+static const uint8_t hmm_space_prior[3] PROGMEM = { 2, 5, 12 };
+
+/* where a dah and a character gap sit over a dit is learned from the
+ * sender, starting from 3 dits (25); a word gap is taken to be 7/3 of
+ * a character gap, and a space that gets to HMM_END over a character
+ * gap (2.2 times it) ends the word */
+#define HMM_DAH_OFF 25
+#define HMM_CG_OFF 25
+#define HMM_OFF_MIN 16 /* 2 dits */
+#define HMM_OFF_MAX 40 /* 5.7 dits */
+#define HMM_WG_CG 20
+#define HMM_END 18
+#define HMM_LEARN 3 /* 1/8 of the way with each one */
+
+/* the dit of each speed, in ms */
+static const uint16_t hmm_dits[HMM_SPEEDS] PROGMEM = {
+	16, 19, 23, 27, 32, 38, 45, 54, 64, 76, 91, 108, 128, 152, 181, 215,
+};
+
+enum hmm_obs {
+	hmm_obs_mark,
+	hmm_obs_space,
+	hmm_obs_word, /* a space that has gone on long enough to be a word gap */
+};
+
+struct hmm_hyp {
+	uint16_t cost;
+	uint16_t hist; /* the labels, two bits each, newest at the bottom */
+	uint8_t speed;
+};
+
+static struct hmm_hyp hmm_beam[HMM_BEAM]; /* best first */
+static uint8_t hmm_n;
+static uint8_t hmm_pending; /* labels in hist not yet settled */
+static uint8_t hmm_seq;     /* labels since the last word; marks are even */
+static uint16_t hmm_base;   /* space before a mark that was too short */
+static uint16_t hmm_space;  /* the space so far */
+static uint8_t hmm_lgs[HMM_LAG]; /* what was seen for each pending label */
+static uint8_t hmm_dah, hmm_cg;  /* learned offsets, see HMM_DAH_OFF */
+
+/* 16 log2(x), with the four bits after the top one as the fraction */
+static uint8_t hmm_lg(uint16_t x) {
+	uint8_t l = 15 * 16;
+	if (!x)
+		return 0;
+	while (!(x & 0x8000)) {
+		x <<= 1;
+		l -= 16;
+	}
+	return l + ((x >> 11) & 0xf);
+}
+
+/* the best label at speed s for what was seen, and what it costs */
+static uint8_t hmm_emit(uint8_t lg, uint8_t s, enum hmm_obs obs,
+		uint16_t *cost) {
+	uint8_t k, n, off, best = 0;
+	int16_t d;
+	uint16_t c;
+
+	if (obs == hmm_obs_word) {
+		/* it is still going, so only the word gap fits */
+		*cost = pgm_read_byte(&hmm_space_prior[HMM_WG]);
+		return HMM_WG;
+	}
+	n = obs == hmm_obs_mark ? 2 : 3;
+	*cost = HMM_INF;
+	for (k = 0; k < n; k++) {
+		if (obs == hmm_obs_mark)
+			off = k ? hmm_dah : 0;
+		else
+			off = k ? hmm_cg + (k - 1) * HMM_WG_CG : 0;
+		d = (int16_t)lg - (HMM_LG_MIN + HMM_STEP * s + off);
+		if (d > 63)
+			d = 63;
+		else if (d < -63)
+			d = -63;
+		/* spaces are let stray further than marks */
+		if (obs == hmm_obs_mark)
+			c = (d * d) >> 3;
+		else
+			c = ((d * d) >> 4) + pgm_read_byte(&hmm_space_prior[k]);
+		if (c < *cost) {
+			*cost = c;
+			best = k;
+		}
+	}
+	return best;
+}
+
+/* keep the HMM_BEAM cheapest of next, best first, with the best at 0 */
+static void hmm_select(struct hmm_hyp *next) {
+	uint8_t s, m;
+	uint16_t base = 0, c;
+
+	for (hmm_n = 0; hmm_n < HMM_BEAM; hmm_n++) {
+		m = 0;
+		for (s = 1; s < HMM_SPEEDS; s++)
+			if (next[s].cost < next[m].cost)
+				m = s;
+		if (next[m].cost == HMM_INF)
+			break;
+		if (!hmm_n)
+			base = next[m].cost;
+		c = next[m].cost - base;
+		hmm_beam[hmm_n] = next[m];
+		hmm_beam[hmm_n].cost = c > HMM_CAP ? HMM_CAP : c;
+		next[m].cost = HMM_INF;
+	}
+}
+
+/* follow the sender's own idea of a dah or a character gap */
+static uint8_t hmm_learn(uint8_t off, uint8_t lg) {
+	int16_t d = (int16_t)lg - (HMM_LG_MIN + HMM_STEP * hmm_beam[0].speed);
+	if (d < HMM_OFF_MIN)
+		d = HMM_OFF_MIN;
+	else if (d > HMM_OFF_MAX)
+		d = HMM_OFF_MAX;
+	return off + ((d - off) >> HMM_LEARN);
+}
+
+/* settle the oldest pending label as the best guess has it, and drop
+ * the guesses that had it otherwise */
+static void hmm_commit(void) {
+	uint8_t shift = 2 * (hmm_pending - 1);
+	uint8_t label = (hmm_beam[0].hist >> shift) & 3;
+	uint8_t old = hmm_seq - hmm_pending;
+	bool mark = !(old & 1);
+	uint8_t i, n = 0;
+
+	for (i = 0; i < hmm_n; i++)
+		if (((hmm_beam[i].hist >> shift) & 3) == label)
+			hmm_beam[n++] = hmm_beam[i];
+	hmm_n = n;
+	hmm_pending--;
+	if (mark && label == HMM_DAH)
+		hmm_dah = hmm_learn(hmm_dah, hmm_lgs[old % HMM_LAG]);
+	else if (!mark && label == HMM_CG)
+		hmm_cg = hmm_learn(hmm_cg, hmm_lgs[old % HMM_LAG]);
+	if (mark) {
+		didah_decode(label == HMM_DAH ? DAH : DIT);
+	} else if (label != HMM_EG) {
+		didah_decode(SPACE);
+		if (label == HMM_WG)
+			didah_decode(SPACE);
+	}
+}
+
+/* one Viterbi step: each guess may keep its speed or move a step, and
+ * for each speed only the cheapest way there is kept */
+static void hmm_step(uint8_t lg, enum hmm_obs obs) {
+	struct hmm_hyp next[HMM_SPEEDS];
+	struct hmm_hyp *h;
+	uint8_t i, s, lo, hi, label;
+	uint16_t c;
+
+	if (hmm_pending == HMM_LAG)
+		hmm_commit();
+	for (s = 0; s < HMM_SPEEDS; s++)
+		next[s].cost = HMM_INF;
+	for (i = 0; i < hmm_n; i++) {
+		h = &hmm_beam[i];
+		lo = h->speed ? h->speed - 1 : 0;
+		hi = h->speed < HMM_SPEEDS - 1 ? h->speed + 1 : h->speed;
+		for (s = lo; s <= hi; s++) {
+			c = h->cost + (s == h->speed ? HMM_STAY : HMM_MOVE);
+			if (c < next[s].cost) {
+				next[s].cost = c;
+				next[s].hist = h->hist;
+			}
+		}
+	}
+	for (s = 0; s < HMM_SPEEDS; s++) {
+		if (next[s].cost == HMM_INF)
+			continue;
+		label = hmm_emit(lg, s, obs, &c);
+		next[s].cost += c;
+		next[s].hist = next[s].hist << 2 | label;
+		next[s].speed = s;
+	}
+	hmm_select(next);
+	hmm_lgs[hmm_seq % HMM_LAG] = lg;
+	hmm_pending++;
+	hmm_seq++;
+}
+
+void hmm_init(uint16_t dit) {
+	struct hmm_hyp next[HMM_SPEEDS];
+	uint8_t s, s0, lg = hmm_lg(dit);
+
+	s0 = lg > HMM_LG_MIN ? (lg - HMM_LG_MIN + HMM_STEP / 2) / HMM_STEP : 0;
+	if (s0 >= HMM_SPEEDS)
+		s0 = HMM_SPEEDS - 1;
+	for (s = 0; s < HMM_SPEEDS; s++) {
+		next[s].cost = (s > s0 ? s - s0 : s0 - s) * HMM_MOVE;
+		next[s].hist = 0;
+		next[s].speed = s;
+	}
+	hmm_select(next);
+	hmm_pending = hmm_seq = 0;
+	hmm_base = hmm_space = 0;
+	hmm_dah = HMM_DAH_OFF;
+	hmm_cg = HMM_CG_OFF;
+}
+
+void hmm_mark(uint16_t len) {
+	uint16_t dit = hmm_dit();
+
+	/* a spike in the middle of a space is part of the space */
+	if (len * 4 < dit) {
+		hmm_base = hmm_space + len;
+		return;
+	}
+	/* and a mark too long to be a dah at any speed is not one */
+	if (len > 3 * HMM_DIT_MAX)
+		return;
+	/* the space before it, unless it began a word */
+	if (hmm_seq & 1)
+		hmm_step(hmm_lg(hmm_space), hmm_obs_space);
+	hmm_step(hmm_lg(len), hmm_obs_mark);
+	hmm_base = hmm_space = 0;
+	trace(TR_RX_MARK, len / 4, hmm_dit());
+}
+
+void hmm_quiet(uint16_t len) {
+	uint8_t i;
+
+	hmm_space = hmm_base + len;
+	if (!(hmm_seq & 1) || hmm_lg(hmm_space) < HMM_LG_MIN +
+			HMM_STEP * hmm_beam[0].speed + hmm_cg + HMM_END)
+		return;
+	/* the end of a word: nothing to wait for, so settle it all */
+	hmm_step(0, hmm_obs_word);
+	while (hmm_pending)
+		hmm_commit();
+	for (i = 0; i < hmm_n; i++)
+		hmm_beam[i].hist = 0;
+	hmm_seq = 0;
+}
+
+uint16_t hmm_dit(void) {
+	return pgm_read_word(&hmm_dits[hmm_beam[0].speed]);
+}
@@ -0,0 +1,55 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _HMM_H_
+#define _HMM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* hidden Markov model timing decoder
+ *
+ * Takes the same marks and spaces as the threshold decoder (thresh.h)
+ * but, instead of deciding each one on its own, keeps a small beam of
+ * guesses at the sender's speed and labels every mark as a dit or a
+ * dah and every space as an element, character or word gap by how
+ * likely the whole run of them is (Viterbi, in fixed point, on the log
+ * of the lengths).  A label is only settled HMM_LAG labels later, or
+ * once the space after a character has gone on long enough to be a
+ * word gap, so an odd long dit or short gap is read in the light of
+ * the ones around it.  RAM and time per mark are fixed by HMM_BEAM.
+ */
+
+#define HMM_SPEEDS 16 /* dits of 16ms (75 wpm) up to 215ms (5.6 wpm) */
+#define HMM_BEAM 8    /* speeds followed at once */
+#define HMM_LAG 8     /* labels held back before they are settled */
+
+/* start over, expecting dits of dit ms */
+void hmm_init(uint16_t dit);
+
+/* a mark of len ms has ended */
+void hmm_mark(uint16_t len);
+
+/* the space since the last mark has gone on for len ms */
+void hmm_quiet(uint16_t len);
+
+/* the dit length of the best guess at the speed, in ms */
+uint16_t hmm_dit(void);
+
+#endif /* _HMM_H_ */
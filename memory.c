@@ -0,0 +1,350 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "settings.h"
+#include "cw.h"
+#include "memory.h"
+
+/* symbol 0 ends the message (and pads out the last byte) */
+static const prog_char memory_chars[] =
+	"\0 abcdefghijklmnopqrstuvwxyz0123456789!\"$()+,-./:;=?_'";
+
+/* the dictionary follows on from the characters, longest first so
+ * that the encoder prefers them; the callsign and serial number come
+ * last */
+#define MEMORY_SYM_TOKEN (sizeof(memory_chars) - 1)
+#define MEMORY_TOKEN_LEN 5
+static const prog_char memory_tokens[][MEMORY_TOKEN_LEN] = {
+	"test",
+	"5nn",
+	"cq",
+	"de",
+	"tu",
+};
+#define MEMORY_TOKENS (sizeof(memory_tokens)/MEMORY_TOKEN_LEN)
+#define MEMORY_SYM_CALL (MEMORY_SYM_TOKEN + MEMORY_TOKENS)
+#define MEMORY_SYM_SERIAL (MEMORY_SYM_CALL + 1)
+
+/* cut numbers, by digit; 4 and 6 have no cut in common use */
+static const prog_char memory_cuts[] = "tauv4e6bdn";
+
+static inline char memory_lower(char c) {
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	return c;
+}
+
+static uint8_t memory_char_sym(char c) {
+	uint8_t i;
+	c = memory_lower(c);
+	/* cw_char sends ' as ` */
+	if (c == '`')
+		c = '\'';
+	for (i=1; i<MEMORY_SYM_TOKEN; i++)
+		if (pgm_read_byte(&memory_chars[i]) == c)
+			return i;
+	return 0;
+}
+
+/* how much of text (up to end) matches tok, which is at most len chars
+ * and nul padded; 0 unless all of it matches */
+static uint8_t memory_match(const char *text, const char *end,
+		const char *tok, uint8_t len, bool flash) {
+	uint8_t i;
+	char t;
+	for (i=0; i<len; i++) {
+		t = flash ? pgm_read_byte(&tok[i]) : tok[i];
+		if (!t)
+			break;
+		if (text + i >= end || memory_lower(text[i]) != memory_lower(t))
+			return 0;
+	}
+	return i;
+}
+
+static void memory_put(uint8_t *out, uint8_t n, uint8_t sym) {
+	uint16_t bit = (uint16_t)n * 6;
+	uint8_t shift = bit & 7;
+	out += bit >> 3;
+	out[0] |= sym << shift;
+	if (shift > 2)
+		out[1] |= sym >> (8 - shift);
+}
+
+uint8_t memory_encode(const char *text, uint8_t *out) {
+	const char *end = text + strnlen(text, MEMORY_TEXT_LEN);
+	uint8_t n = 0, sym, len, i;
+
+	memset(out, 0, MEMORY_BYTES);
+	while (text < end) {
+		sym = 0;
+		len = memory_match(text, end, settings_get_callsign(),
+			CALLSIGN_LEN, false);
+		if (len)
+			sym = MEMORY_SYM_CALL;
+		else if (*text == MEMORY_SERIAL) {
+			sym = MEMORY_SYM_SERIAL;
+			len = 1;
+		}
+		for (i=0; !sym && i<MEMORY_TOKENS; i++) {
+			len = memory_match(text, end, memory_tokens[i],
+				MEMORY_TOKEN_LEN, true);
+			if (len)
+				sym = MEMORY_SYM_TOKEN + i;
+		}
+		if (!sym) {
+			/* anything cw can't send is dropped */
+			sym = memory_char_sym(*text);
+			len = 1;
+		}
+		text += len;
+		if (sym)
+			memory_put(out, n++, sym);
+	}
+	return ((uint16_t)n * 6 + 7) / 8;
+}
+
+bool memory_save(uint8_t id, const char *text) {
+	uint8_t data[MEMORY_BYTES];
+	uint8_t len = memory_encode(text, data);
+	return settings_set_memory(id, data, len);
+}
+
+void memory_open(struct memory_cursor *mc, uint8_t id) {
+	mc->off = settings_get_memory(id, &mc->left);
+	mc->nbits = 0;
+	mc->acc = 0;
+	mc->token = 0;
+	mc->serial = false;
+	mc->seek = 0;
+}
+
+/* the walk over the pool that settings_get_memory does, a byte at a
+ * time and without waiting on the eeprom, for the player.  False while
+ * the eeprom is busy. */
+static bool memory_seek(struct memory_cursor *mc) {
+	uint8_t b;
+	while (mc->seek) {
+		if (!settings_try_memory_byte(mc->off, &b))
+			return false;
+		if (--mc->seek) {
+			mc->off += 1 + b;
+			if (mc->off >= MEMORY_POOL_LEN)
+				mc->seek = 0;
+			continue;
+		}
+		/* don't wander off the end of a damaged pool */
+		if (mc->off + 1 + b <= MEMORY_POOL_LEN)
+			mc->left = b;
+		mc->off++;
+	}
+	return true;
+}
+
+/* next symbol, or CW_SRC_WAIT if !wait and the eeprom is busy */
+static uint8_t memory_sym(struct memory_cursor *mc, bool wait) {
+	uint8_t sym, b;
+	if (mc->seek && !memory_seek(mc))
+		return CW_SRC_WAIT;
+	if (mc->nbits < 6) {
+		if (!mc->left)
+			return 0;
+		if (wait)
+			b = settings_get_memory_byte(mc->off);
+		else if (!settings_try_memory_byte(mc->off, &b))
+			return CW_SRC_WAIT;
+		mc->acc |= (uint16_t)b << mc->nbits;
+		mc->off++;
+		mc->nbits += 8;
+		mc->left--;
+	}
+	sym = mc->acc & 0x3f;
+	mc->acc >>= 6;
+	mc->nbits -= 6;
+	return sym;
+}
+
+/* digit i of the serial number as it is sent, or 0 past the end */
+static char memory_serial_digit(uint8_t i) {
+	uint16_t n = settings_get_serial(), t;
+	uint8_t len;
+	for (len=1, t=n; t>=10; len++)
+		t /= 10;
+	if (len < settings_get_serial_width())
+		len = settings_get_serial_width();
+	if (i >= len)
+		return 0;
+	for (i=len-1-i; i; i--)
+		n /= 10;
+	return '0' + n % 10;
+}
+
+static char memory_cut(char c) {
+	if (c >= '0' && c <= '9' && (settings_get_cuts() & (1 << (c - '0'))))
+		c = pgm_read_byte(&memory_cuts[c - '0']);
+	return c;
+}
+
+/* memory_next (wait) is reading the text back, so the serial number
+ * stays a token there; the player expands it and counts it as sent */
+static char memory_step(struct memory_cursor *mc, bool wait) {
+	uint8_t sym;
+	char c;
+	for (;;) {
+		if (mc->token) {
+			c = 0;
+			if (mc->token == MEMORY_SYM_SERIAL) {
+				c = memory_serial_digit(mc->token_idx);
+			} else if (mc->token == MEMORY_SYM_CALL) {
+				if (mc->token_idx < CALLSIGN_LEN)
+					c = settings_get_callsign()[mc->token_idx];
+			} else if (mc->token_idx < MEMORY_TOKEN_LEN) {
+				c = pgm_read_byte(&memory_tokens
+					[mc->token - MEMORY_SYM_TOKEN][mc->token_idx]);
+			}
+			mc->token_idx++;
+			if (c)
+				return c;
+			mc->token = 0;
+		}
+		sym = memory_sym(mc, wait);
+		if (sym == CW_SRC_WAIT)
+			return CW_SRC_WAIT;
+		if (sym == 0) {
+			/* stay at the end */
+			mc->left = 0;
+			mc->nbits = 0;
+			if (mc->serial) {
+				mc->serial = false;
+				settings_set_serial(settings_get_serial() + 1,
+					settings_get_serial_width());
+			}
+			return 0;
+		}
+		if (sym < MEMORY_SYM_TOKEN)
+			return pgm_read_byte(&memory_chars[sym]);
+		/* skip anything this firmware doesn't know about */
+		if (sym > MEMORY_SYM_SERIAL)
+			continue;
+		if (sym == MEMORY_SYM_SERIAL) {
+			if (wait)
+				return MEMORY_SERIAL;
+			mc->serial = true;
+		}
+		mc->token = sym;
+		mc->token_idx = 0;
+	}
+}
+
+char memory_next(struct memory_cursor *mc) {
+	return memory_step(mc, true);
+}
+
+/* the memory being sent; it is read a character at a time by the cw
+ * output tick, so only ever as much as one character is decoded ahead.
+ * That is in the timer interrupt, so opening it only sets up the walk
+ * to where it starts, and the first few calls to next do that walk. */
+static struct memory_cursor memory_playing;
+
+/* what is known of the word being sent, for cut numbers: only numbers,
+ * words of nothing but digits and the serial number, are cut, so a
+ * callsign like n0ab keeps its zero */
+enum memory_word {
+	memory_word_new,    /* nothing known yet */
+	memory_word_number,
+	memory_word_other,
+};
+static enum memory_word memory_word;
+/* a digit read but not sent, while the rest of its word is read ahead
+ * to see if it is a number */
+static char memory_held;
+
+static inline bool memory_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+/* read ahead to the end of the word the held digit is in, without
+ * moving the player: memory_word_other if there is anything but digits
+ * in it, or memory_word_new if the eeprom is busy */
+static enum memory_word memory_ahead(void) {
+	struct memory_cursor mc = memory_playing;
+	char c;
+	for (;;) {
+		/* reaching the end must not count the serial number sent */
+		mc.serial = false;
+		c = memory_step(&mc, false);
+		if (c == (char)CW_SRC_WAIT)
+			return memory_word_new;
+		if (!c || c == ' ')
+			return memory_word_number;
+		if (!memory_digit(c) ||
+				(mc.token && mc.token != MEMORY_SYM_SERIAL))
+			return memory_word_other;
+	}
+}
+
+void memory_src_open(uint8_t id) {
+	memory_playing.off = 0;
+	memory_playing.left = memory_playing.nbits = 0;
+	memory_playing.acc = 0;
+	memory_playing.seek = id < MEMORY_COUNT ? id + 1 : 0;
+	memory_playing.token = 0;
+	memory_playing.serial = false;
+	memory_word = memory_word_new;
+	memory_held = 0;
+}
+
+uint8_t memory_src_next(void) {
+	char c = memory_held;
+
+	if (!c) {
+		c = memory_step(&memory_playing, false);
+		if (c == (char)CW_SRC_WAIT)
+			return CW_SRC_WAIT;
+		if (!c || c == ' ') {
+			memory_word = memory_word_new;
+			return c;
+		}
+		/* the serial number always goes out cut; the callsign
+		 * and the other tokens never do */
+		if (memory_playing.token == MEMORY_SYM_SERIAL)
+			return memory_cut(c);
+		if (memory_playing.token || !memory_digit(c)) {
+			memory_word = memory_word_other;
+			return c;
+		}
+	}
+	if (memory_word == memory_word_new) {
+		memory_word = memory_ahead();
+		if (memory_word == memory_word_new) {
+			memory_held = c;
+			return CW_SRC_WAIT;
+		}
+	}
+	memory_held = 0;
+	return memory_word == memory_word_number ? memory_cut(c) : c;
+}
+
+void memory_play(uint8_t id) {
+	cw_play(id);
+}
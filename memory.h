@@ -0,0 +1,84 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* message memory codec
+ *
+ * Memories are stored as 6 bit symbols, four to every three bytes.  A
+ * symbol is a character cw can send, or one of a handful of dictionary
+ * tokens for things that turn up in every other message (CQ, TEST, 5NN,
+ * DE, TU and the callsign).  The callsign token is expanded from the
+ * current callsign setting when the message is played, not when it is
+ * saved.
+ *
+ * For contests there is also a serial number token, written as
+ * MEMORY_SERIAL.  It is sent as the current serial number, zero padded
+ * to the serial width, and the serial number goes up by one once the
+ * message has been sent all the way through.  Numbers in a message that
+ * is played, the serial number and any word of nothing but digits, go
+ * out as cut numbers for the digits set in the cuts setting: 599 as
+ * 5NN, 001 as TTA and so on.  Digits in a word with letters in it, and
+ * in the callsign, are sent as they are.
+ *
+ * Only memories are cut.  Text typed to the keyer comes a key at a time
+ * and command mode replies have to read back as they were typed, so
+ * cw_string sends digits as digits.
+ */
+
+/* the serial number token as text */
+#define MEMORY_SERIAL '$'
+
+struct memory_cursor {
+	uint16_t off;      /* next byte in the memory pool */
+	uint8_t left;      /* bytes left in the message */
+	uint8_t nbits;     /* bits waiting in acc */
+	uint16_t acc;
+	uint8_t token;     /* dictionary token being expanded, or 0 */
+	uint8_t token_idx; /* next char of it */
+	bool serial;       /* the serial number token has been sent */
+	uint8_t seek;      /* memories still to step over to find this
+	                    * one, plus one for its length, or 0 */
+};
+
+/* encode nul terminated text (at most MEMORY_TEXT_LEN chars are used)
+ * into out, which must hold MEMORY_BYTES.  Returns the encoded length. */
+uint8_t memory_encode(const char *text, uint8_t *out);
+
+/* encode and save text as memory id; false if there is no room, or
+ * the eeprom is still busy with the last save */
+bool memory_save(uint8_t id, const char *text);
+
+/* decode memory id a character at a time; memory_next returns 0 at
+ * the end of the message */
+void memory_open(struct memory_cursor *mc, uint8_t id);
+char memory_next(struct memory_cursor *mc);
+
+/* queue memory id to be sent; it is read out of the eeprom as it goes */
+void memory_play(uint8_t id);
+
+/* the cw source callbacks for memory_play (see cw_set_source) */
+void memory_src_open(uint8_t id);
+uint8_t memory_src_next(void);
+
+#endif /* _MEMORY_H_ */
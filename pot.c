@@ -0,0 +1,114 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "cw.h"
+#include "trace.h"
+#include "pot.h"
+
+#define POT_FULL (POT_OVERSAMPLE * 256)
+
+static uint16_t pot_acc;
+static uint8_t pot_n;
+/* the last full reading, for pot_work */
+static uint16_t pot_sum;
+static volatile bool pot_ready;
+
+static uint8_t pot_wpm;  /* the speed the pot last set, 0 at first */
+static uint8_t pot_next; /* a new speed seen once, or 0 */
+
+void pot_sample(uint8_t v) {
+	pot_acc += v;
+	if (++pot_n < POT_OVERSAMPLE)
+		return;
+	pot_sum = pot_acc;
+	pot_ready = true;
+	pot_acc = 0;
+	pot_n = 0;
+}
+
+#ifndef RX
+ISR(ADC_vect) {
+	pot_sample(ADCH);
+}
+#endif /* RX */
+
+static uint8_t pot_to_wpm(int16_t r) {
+	if (r < 0)
+		r = 0;
+	else if (r >= POT_FULL)
+		r = POT_FULL - 1;
+	return POT_WPM_MIN + (uint32_t)r *
+		(POT_WPM_MAX - POT_WPM_MIN + 1) / POT_FULL;
+}
+
+void pot_work(void) {
+	int16_t r;
+	uint8_t wpm;
+
+	if (!pot_ready)
+		return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		r = pot_sum;
+		pot_ready = false;
+	}
+	/* close enough to where we are not to move */
+	if (pot_wpm >= pot_to_wpm(r - POT_HYST) &&
+			pot_wpm <= pot_to_wpm(r + POT_HYST)) {
+		pot_next = 0;
+		return;
+	}
+	wpm = pot_to_wpm(r);
+	if (wpm != pot_next) {
+		pot_next = wpm;
+		return;
+	}
+	pot_wpm = wpm;
+	pot_next = 0;
+	trace(TR_POT, wpm, 0);
+	cw_set_speed(wpm, false);
+}
+
+void pot_init(void) {
+	pot_acc = 0;
+	pot_n = 0;
+	pot_ready = false;
+	pot_wpm = pot_next = 0;
+
+	DIDR0 |= _BV(POT_ADC_CHANNEL);
+#ifndef RX
+	/* avcc reference, left adjusted so ADCH is all we read, started
+	 * by the tick's compare match */
+	ADMUX = _BV(REFS0) | _BV(ADLAR) | POT_ADC_CHANNEL;
+	ADCSRB = _BV(ADTS1) | _BV(ADTS0);
+	ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) |
+		_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif /* RX */
+}
+
+void pot_fini(void) {
+#ifndef RX
+	ADCSRA = 0;
+#endif /* RX */
+	pot_ready = false;
+}
@@ -0,0 +1,63 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _POT_H_
+#define _POT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* speed pot
+ *
+ * A pot across the supply with its wiper on ADC1 (PF1) sets the speed.
+ * Built without RX, the adc is the pot's alone: each 1ms tick (the
+ * timer0 compare match) starts a conversion in hardware, so it takes
+ * no tick slot and no cpu until the result is in.  With RX, the
+ * receive decoder has the adc free running, and lends us the slot
+ * after each of its blocks, one sample every 6.8ms (see rx.c).
+ *
+ * The ADC interrupt sums POT_OVERSAMPLE samples into each reading and
+ * pot_work, from the main loop, turns that into a speed.  The reading
+ * has to move POT_HYST past the edges of the speed we are at, and the
+ * new speed has to come out the same twice running, before
+ * cw_set_speed is called, which takes it up at the next element.  The
+ * speed is not saved; the pot is where it is kept, and it sets the
+ * speed again at power on.
+ *
+ * This is only built in with POT (make POT=1).
+ */
+
+#define POT_ADC_CHANNEL 1
+/* 8 bit samples per reading, which is then 12 bits */
+#define POT_OVERSAMPLE 16
+#define POT_WPM_MIN 5
+#define POT_WPM_MAX 50
+/* in reading steps, 16 to one adc count */
+#define POT_HYST 32
+
+void pot_init(void);
+void pot_fini(void);
+
+/* set the speed if the pot has moved; call it from the main loop */
+void pot_work(void);
+
+/* one sample, the top 8 bits of the conversion; from the ADC interrupt */
+void pot_sample(uint8_t v);
+
+#endif /* _POT_H_ */
@@ -0,0 +1,303 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "cw-kbd.h"
+#include "cw.h"
+#include "settings.h"
+#include "timer.h"
+#include "tick.h"
+#include "trace.h"
+#include "rx.h"
+#include "decode.h"
+#ifdef POT
+#include "pot.h"
+#endif /* POT */
+
+/* 2 cos(2 pi f / rate) in Q14 for bin i, worked out by the compiler */
+#define RX_COEFF(I) ((int16_t)(2 * 16384 * __builtin_cos(2 * \
+	3.14159265358979 * RX_BIN_HZ(I) * RX_DECIMATE / RX_RATE) + 0.5))
+
+static const int16_t rx_coeff[RX_BINS] PROGMEM = {
+	RX_COEFF(0), RX_COEFF(1), RX_COEFF(2), RX_COEFF(3),
+	RX_COEFF(4), RX_COEFF(5), RX_COEFF(6), RX_COEFF(7),
+};
+
+/* levels are 8 log2(power), times 16; 8 (128) is 3dB */
+#define RX_SNR (28 * 16)
+#define RX_SIG_SHIFT 3    /* the mark level follows 1/8 of the way */
+#define RX_NOISE_SHIFT 4  /* and the noise level 1/16 */
+
+/* avcc reference, left adjusted so ADCH is all we read */
+#define RX_ADMUX(CH) (_BV(REFS0) | _BV(ADLAR) | (CH))
+
+/* conversions per block: with the pot, the one after each block is
+ * its sample */
+#ifdef POT
+#define RX_SLOTS (RX_BLOCK + 1)
+#else
+#define RX_SLOTS RX_BLOCK
+#endif /* POT */
+
+/* blocks to ms */
+#define RX_MS(N) ((uint16_t)((uint32_t)(N) * RX_SLOTS * 1000 / RX_RATE))
+/* a mark this many dits long is a carrier, or noise we are stuck on */
+#define RX_MARK_MAX 6
+/* the most space, in blocks, that a fade within a mark is taken for */
+#define RX_BRIDGE 2
+/* how far (3dB) another bin has to be above ours to take over */
+#define RX_LOCK 128
+/* a bin's peak hold comes down 1/32 of the way on each of its turns */
+#define RX_HOLD_SHIFT 5
+
+/* samples, averaged in pairs, go into one buffer while rx_work runs the
+ * bank over the other */
+static int8_t rx_buf[2][RX_BLOCK / RX_DECIMATE];
+static uint8_t rx_fill;      /* the buffer the isr is filling */
+static uint8_t rx_n;
+static int8_t rx_half;       /* the first of a pair */
+static volatile bool rx_full; /* the other buffer is waiting for rx_work */
+
+/* what rx_work makes of a block, for rx_tick */
+static uint32_t rx_power;
+static volatile bool rx_ready;
+
+ISR(ADC_vect) {
+	uint8_t v = ADCH;
+	int8_t x = v - 128;
+	uint8_t n = rx_n++;
+#ifdef POT
+	/* the mux is taken as each conversion starts, which is as the one
+	 * before it ends, so switching it two samples ahead gets the pot
+	 * the slot after the block and no other */
+	if (n == RX_BLOCK - 2) {
+		ADMUX = RX_ADMUX(POT_ADC_CHANNEL);
+	} else if (n == RX_BLOCK - 1) {
+		ADMUX = RX_ADMUX(RX_ADC_CHANNEL);
+	} else if (n == RX_BLOCK) {
+		rx_n = 0;
+		pot_sample(v);
+		return;
+	}
+#endif /* POT */
+	if (!(n & 1)) {
+		rx_half = x;
+		return;
+	}
+	/* the bank runs on the mean of each pair */
+	rx_buf[rx_fill][n / 2] = (rx_half + x) >> 1;
+	if (n == RX_BLOCK - 1) {
+#ifndef POT
+		rx_n = 0;
+#endif /* POT */
+		/* if the last block is still waiting, this one is lost */
+		if (!rx_full) {
+			rx_fill ^= 1;
+			rx_full = true;
+		}
+	}
+}
+
+static uint16_t rx_avg[RX_BINS]; /* a peak hold of each bin's level */
+static uint8_t rx_bin;           /* the one we are listening to */
+static uint8_t rx_sweep;         /* the one looked at this block */
+
+static uint32_t rx_p1;            /* the power in the last block */
+static uint16_t rx_sig, rx_noise; /* average levels of marks and spaces */
+static bool rx_mark;
+static uint8_t rx_len;    /* blocks into the current mark or space */
+static uint8_t rx_held;   /* a mark that may yet carry on, or 0 */
+static uint8_t rx_fresh;  /* blocks until the smoothing is filled */
+
+/* 8 log2(p) times 16, with the four bits after the top one as the
+ * fraction */
+static uint16_t rx_level(uint32_t p) {
+	uint16_t l = 31 * 128;
+	if (!p)
+		return 0;
+	while (!(p & 0x80000000UL)) {
+		p <<= 1;
+		l -= 128;
+	}
+	return l + ((p >> 27) & 0xf) * 8;
+}
+
+/* mark or space, against the average levels of each.  Each average only
+ * follows its own half of the signal, except that a mark which goes on
+ * for too long is taken as the new noise level. */
+static bool rx_detect(uint16_t l) {
+	uint16_t span, mid;
+
+	/* start from wherever the input sits, once there is a full
+	 * window of it */
+	if (rx_fresh) {
+		rx_fresh--;
+		rx_noise = l;
+		return false;
+	}
+	if (!rx_mark || RX_MS(rx_len) > RX_MARK_MAX * decode_dit())
+		rx_noise += ((int16_t)(l - rx_noise)) >> RX_NOISE_SHIFT;
+	else
+		rx_sig += ((int16_t)(l - rx_sig)) >> RX_SIG_SHIFT;
+	span = rx_sig > rx_noise ? rx_sig - rx_noise : 0;
+	if (span < RX_SNR)
+		span = RX_SNR;
+	mid = rx_noise + span / 2;
+	/* a little hysteresis either side of the middle */
+	if (rx_mark)
+		return l > mid - span / 8;
+	return l > mid + span / 8;
+}
+
+/* time the marks and spaces.  A mark is held until a little space has
+ * gone by after it (a third of a dit, or RX_BRIDGE blocks if that is
+ * less), so a fade in the middle of a dah does not make two dits of it. */
+static void rx_timing(bool mark) {
+	uint16_t len;
+	if (mark != rx_mark) {
+		rx_mark = mark;
+		if (mark && rx_held) {
+			rx_len += rx_held;
+			rx_held = 0;
+		} else {
+			if (!mark)
+				rx_held = rx_len;
+			rx_len = 0;
+		}
+	}
+	if (rx_len < 0xff)
+		rx_len++;
+	if (rx_mark)
+		return;
+	len = RX_MS(rx_len);
+	if (rx_held && (len * 3 >= decode_dit() || rx_len >= RX_BRIDGE)) {
+		decode_mark(RX_MS(rx_held));
+		rx_held = 0;
+	}
+	if (!rx_held)
+		decode_quiet(len);
+}
+
+/* one Goertzel filter over the block, and the power it found */
+static uint32_t rx_goertzel(const int8_t *x, int16_t c) {
+	int16_t s, s1 = 0, s2 = 0;
+	int32_t p;
+	uint8_t i;
+	for (i = 0; i < RX_BLOCK / RX_DECIMATE; i++) {
+		s = x[i] - s2 + (int16_t)(((int32_t)c * s1) >> 14);
+		s2 = s1;
+		s1 = s;
+	}
+	p = (int32_t)s1 * s1 + (int32_t)s2 * s2 -
+		(((int32_t)c * s1) >> 14) * s2;
+	return p < 0 ? 0 : p;
+}
+
+/* a peak hold of the bin's level: up at once, down slowly, so the bin
+ * with the signal in it stays ahead through the spaces */
+static void rx_hold(uint8_t i, uint32_t p, uint8_t shift) {
+	uint16_t l = rx_level(p);
+	if (l > rx_avg[i])
+		rx_avg[i] = l;
+	else
+		rx_avg[i] -= (rx_avg[i] - l) >> shift;
+}
+
+/* the bin we are listening to gets every block, and the sweep one other
+ * in turn, which is two filters' worth.  Ours comes down 1/8 as far
+ * each block, so they all come down alike over a sweep. */
+void rx_work(void) {
+	const int8_t *x;
+	uint32_t mine;
+	uint8_t i;
+
+	if (!rx_full)
+		return;
+	x = rx_buf[rx_fill ^ 1];
+	mine = rx_goertzel(x, pgm_read_word(&rx_coeff[rx_bin]));
+	rx_hold(rx_bin, mine, RX_HOLD_SHIFT + 3);
+	i = rx_sweep;
+	rx_sweep = (i + 1) % RX_BINS;
+	if (i != rx_bin)
+		rx_hold(i, rx_goertzel(x, pgm_read_word(&rx_coeff[i])),
+			RX_HOLD_SHIFT);
+	rx_full = false;
+	if (rx_avg[i] > rx_avg[rx_bin] + RX_LOCK) {
+		rx_bin = i;
+		trace(TR_RX_BIN, i, RX_BIN_HZ(i) / 10);
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		rx_power = mine;
+		rx_ready = true;
+	}
+}
+
+static void rx_tick(void) {
+	uint32_t p;
+
+	if (!rx_ready)
+		return;
+	p = rx_power;
+	rx_ready = false;
+	if (cw_busy()) {
+		/* our own sending is not for decoding */
+		rx_mark = false;
+		rx_len = rx_held = 0;
+		return;
+	}
+	/* over two blocks, which evens out the noise a lot for a little
+	 * smearing of the edges (it is the same at both ends) */
+	rx_timing(rx_detect(rx_level(p + rx_p1)));
+	rx_p1 = p;
+}
+
+void rx_init(void) {
+	rx_p1 = 0;
+	rx_sig = rx_noise = 0;
+	rx_mark = false;
+	rx_len = rx_held = 0;
+	decode_init(1200 / settings_get_wpm());
+	rx_fresh = 2;
+	memset(rx_avg, 0, sizeof(rx_avg));
+	/* the middle, near the usual 700Hz */
+	rx_bin = RX_BINS / 2;
+	rx_sweep = 0;
+	rx_n = 0;
+	rx_fill = 0;
+	rx_full = false;
+	rx_ready = false;
+
+	DIDR0 |= _BV(RX_ADC_CHANNEL);
+	ADMUX = RX_ADMUX(RX_ADC_CHANNEL);
+	ADCSRB = 0;
+	ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) |
+		_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	ms_tick_register(rx_tick, TICK_RX, 1);
+}
+
+void rx_fini(void) {
+	ADCSRA = 0;
+	ms_tick_unregister(TICK_RX);
+}
@@ -0,0 +1,85 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _RX_H_
+#define _RX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* receive decoder
+ *
+ * Audio from the receiver comes in on ADC0 (PF0), biased to half the
+ * supply.  The adc free runs at clk/128, a conversion every 13 adc
+ * clocks, and all the ADC interrupt does is average the samples in
+ * pairs into a block buffer.  Each full block, RX_BLOCK samples, is
+ * run by rx_work in the main loop, with interrupts on, through the
+ * fixed point Goertzel filter for the bin we are listening to, one of
+ * RX_BINS spread over RX_LOW to RX_HIGH, and through one other bin, a
+ * different one each block.  That is RX_STEPS filter steps a block, no
+ * more than the one filter at the full sample rate that the bank
+ * replaced.  It costs no sensitivity, as ours is run on every block,
+ * but a tone away from the middle takes a sweep or more to be found
+ * (see bench-rx).  A bin that holds on to being louder (3dB) than ours
+ * over a few of its turns is followed from then on, and the power in
+ * ours is handed to the rx tick.  That works out the power on a log
+ * scale, calls it mark or space against the average levels of each,
+ * and hands the lengths of the marks and spaces, in ms, to a timing
+ * decoder, which feeds the elements to didah_decode: thresh.c, or
+ * hmm.c when built with HMM (make HMM=1).  So what is heard gets typed
+ * just like what is keyed.  Nothing is decoded while we are sending or
+ * keying.
+ *
+ * Built with POT as well, the speed pot gets one conversion after each
+ * block, which makes a block RX_BLOCK + 1 samples long in time.
+ *
+ * This is only built in with RX (make RX=1): an open input decodes
+ * noise.
+ */
+
+#define RX_ADC_CHANNEL 0
+#define RX_RATE (F_CPU / 128 / 13)
+/* the bank runs at half the adc rate, which is still well above
+ * RX_HIGH */
+#define RX_DECIMATE 2
+/* samples per block; 64 is 6.7ms and about 150Hz wide */
+#define RX_BLOCK 64
+#define RX_BINS 8
+#define RX_LOW 400
+#define RX_HIGH 900
+#define RX_BIN_HZ(I) (RX_LOW + (I) * (RX_HIGH - RX_LOW) / (RX_BINS - 1))
+/* the bin we listen to and one other, each block */
+#define RX_STEPS (2 * RX_BLOCK / RX_DECIMATE)
+
+/* most cycles the ADC isr may take, vector to reti, out of the 1664
+ * there are between samples (see isr-profile) */
+#define RX_SAMPLE_CYCLES 200
+/* and rx_work, per block, out of the 106k or so a block takes to come
+ * in: RX_STEPS filter steps at about 60 cycles each, and the power and
+ * level of two bins, with room to spare */
+#define RX_WORK_CYCLES (RX_STEPS * 80)
+
+void rx_init(void);
+void rx_fini(void);
+
+/* run the bank over a block, if there is one waiting; call it from the
+ * main loop, which the ADC interrupt wakes often enough */
+void rx_work(void);
+
+#endif /* _RX_H_ */
@@ -0,0 +1,138 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cw-kbd.h"
+#include "util.h"
+#include "timer.h"
+#include "tick.h"
+#include "sched.h"
+
+struct sched_entry {
+	uint32_t due;
+	uint16_t period;
+	uint8_t id;
+};
+
+static struct sched_entry sched_heap[SCHED_LEN];
+static uint8_t sched_count;
+/* seconds since the scheduler started */
+static uint32_t sched_now;
+static sched_fire_t sched_fire;
+static sched_busy_t sched_busy;
+uint16_t sched_skipped;
+
+static void sched_swap(uint8_t a, uint8_t b) {
+	struct sched_entry t = sched_heap[a];
+	sched_heap[a] = sched_heap[b];
+	sched_heap[b] = t;
+}
+
+static void sched_up(uint8_t i) {
+	uint8_t p;
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (sched_heap[p].due <= sched_heap[i].due)
+			break;
+		sched_swap(i, p);
+		i = p;
+	}
+}
+
+static void sched_down(uint8_t i) {
+	uint8_t c;
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= sched_count)
+			break;
+		if (c + 1 < sched_count && sched_heap[c + 1].due < sched_heap[c].due)
+			c++;
+		if (sched_heap[i].due <= sched_heap[c].due)
+			break;
+		sched_swap(i, c);
+		i = c;
+	}
+}
+
+/* only ever looks at the top of the heap */
+static void sched_tick(void) {
+	struct sched_entry *e = &sched_heap[0];
+
+	sched_now++;
+	if (!sched_count || e->due > sched_now)
+		return;
+	if (sched_now - e->due >= e->period) {
+		/* held back all the way to the next slot: skip the missed one */
+		e->due += (sched_now - e->due) / e->period * e->period;
+		sched_skipped++;
+		debug("sched: skipped %u\r\n", e->id);
+		/* something else may be first now; see next time */
+		sched_down(0);
+		return;
+	}
+	if (sched_busy && sched_busy())
+		return;
+	debug("sched: fire %u\r\n", e->id);
+	sched_fire(e->id);
+	e->due += e->period;
+	sched_down(0);
+}
+
+void sched_init(sched_fire_t fire, sched_busy_t busy) {
+	sched_fire = fire;
+	sched_busy = busy;
+	sched_count = 0;
+	sched_now = 0;
+}
+
+void sched_set(uint8_t id, uint16_t period, uint16_t phase) {
+	uint8_t i;
+	uint8_t iv = rcli();
+
+	for (i=0; i<sched_count; i++)
+		if (sched_heap[i].id == id)
+			break;
+	if (i < sched_count) {
+		/* take it out; the last one fills the hole */
+		sched_heap[i] = sched_heap[--sched_count];
+		if (i < sched_count) {
+			sched_up(i);
+			sched_down(i);
+		}
+	}
+	if (period && sched_count < SCHED_LEN) {
+		phase %= period;
+		i = sched_count++;
+		sched_heap[i].id = id;
+		sched_heap[i].period = period;
+		/* the first slot on the grid after now */
+		sched_heap[i].due = sched_now - (sched_now + period - phase) % period
+			+ period;
+		sched_up(i);
+	}
+	if (sched_count && !ms_tick_registered(TICK_SCHED)) {
+		debug("ms_tick_register(TICK_SCHED)\r\n");
+		ms_tick_register(sched_tick, TICK_SCHED, 1000);
+	} else if (!sched_count && ms_tick_registered(TICK_SCHED)) {
+		debug("ms_tick_unregister(TICK_SCHED)\r\n");
+		ms_tick_unregister(TICK_SCHED);
+	}
+	sreg(iv);
+}
@@ -0,0 +1,53 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* repeat scheduler
+ *
+ * Things that repeat (memories, beacons) are kept in a small min-heap
+ * ordered by when they are next due, with one second resolution.  Due
+ * times sit on a fixed grid: every period seconds, offset by phase,
+ * counted from when the scheduler started, so repeats never drift and
+ * repeats with related periods stay lined up.
+ *
+ * If something comes due while busy() says the operator is sending, it
+ * is held back and tried again every second until the way is clear.  If
+ * that takes until its next slot, the missed slot is skipped.
+ */
+
+#define SCHED_LEN 10
+
+typedef void (*sched_fire_t)(uint8_t id);
+typedef bool (*sched_busy_t)(void);
+
+void sched_init(sched_fire_t fire, sched_busy_t busy);
+
+/* repeat id every period seconds, phase seconds into the period;
+ * a period of 0 stops it */
+void sched_set(uint8_t id, uint16_t period, uint16_t phase);
+
+/* slots missed because we were busy for a whole period */
+extern uint16_t sched_skipped;
+
+#endif /* _SCHED_H_ */
@@ -20,12 +20,18 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include <util/crc16.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <util/atomic.h>
 #include "cw-kbd.h"
 #include "settings.h"
 #include "settings.sig.h"
 #include "cw.h"
+#include "eeq.h"
+#include "memory.h"
 
 EEMEM settings_t settings;
 PROGMEM struct default_preset default_settings = {
@@ -35,157 +41,826 @@ PROGMEM struct default_preset default_settings = {
 	.left_key = DIT,
 	.frequency = 22,
 	.beeper = true,
+	.weight = 50,
 };
 static uint8_t cp;
 
+/*
+ * The settings in struct settings_image get changed a lot (every speed
+ * or tone change), so rather than beating on the same eeprom cells,
+ * they are kept in ram and saved as a base copy plus a circular log of
+ * byte changes.  Each change appends one record to the log; when the
+ * log has gone all the way around, the ram image is folded back into
+ * the base copy and the header moves up to the current log position.
+ *
+ * Records carry a sequence number and a crc, so on boot the image is
+ * rebuilt by replaying records from the header position for as long as
+ * the sequence keeps counting up and the crcs check out.  This is at
+ * most SETTINGS_LOG_LEN records, so boot time is bounded.
+ *
+ * Changes are made from interrupts, so if the eeprom queue has no room
+ * for a record, the change is only made in ram and the log falls
+ * behind.  Once the queue has run empty, the image is folded, which
+ * saves everything the log missed.
+ */
+static struct settings_image image;
+static uint8_t log_seq;   /* sequence number of the next record */
+static uint8_t log_head;  /* where the next record goes */
+static uint8_t log_used;  /* records since the last fold */
+static bool log_behind;   /* changes since the last fold have no record */
+static bool reset_behind; /* settings_default still has to be saved */
+
+#define LOG_CRC_INIT 0x5a
+
+static uint8_t log_crc(const uint8_t *p, uint8_t len) {
+	uint8_t crc = LOG_CRC_INIT;
+	while (len--)
+		crc = _crc_ibutton_update(crc, *p++);
+	return crc;
+}
+
+/* start the log over from the current position */
+static void settings_log_start(void) {
+	struct settings_log_header h;
+	h.seq = log_seq;
+	h.pos = log_head;
+	h.crc = log_crc((uint8_t *)&h, sizeof(h) - 1);
+	eeq_write_block(&settings.log_header, &h, sizeof(h));
+	log_used = 0;
+}
+
+/* fold the ram image into the base copy and restart the log here, or
+ * leave the log behind until there is room to */
+static void settings_log_fold(void) {
+	if (!eeq_room(2, false)) {
+		log_behind = true;
+		return;
+	}
+	/* the image is written straight from ram; anything that changes
+	 * in the meantime is also in a newer record, so this is safe */
+	eeq_write_live(&settings.image, &image, sizeof(image));
+	settings_log_start();
+	log_behind = false;
+}
+
+static void settings_log_append(uint8_t off, uint8_t val) {
+	struct settings_log_record r;
+	/* the fold that catches up will have this too */
+	if (log_behind)
+		return;
+	r.seq = log_seq;
+	r.off = off;
+	r.val = val;
+	r.crc = log_crc((uint8_t *)&r, sizeof(r) - 1);
+	if (!eeq_write_block(&settings.log[log_head], &r, sizeof(r))) {
+		log_behind = true;
+		return;
+	}
+	log_seq++;
+	if (++log_head == SETTINGS_LOG_LEN)
+		log_head = 0;
+	if (++log_used == SETTINGS_LOG_LEN)
+		settings_log_fold();
+}
+
+/* rebuild the ram image from the base copy and the log */
+static void settings_log_replay(void) {
+	struct settings_log_header h;
+	struct settings_log_record r;
+
+	eeq_read_block(&image, &settings.image, sizeof(image));
+	eeq_read_block(&h, &settings.log_header, sizeof(h));
+	if (h.crc != log_crc((uint8_t *)&h, sizeof(h) - 1) ||
+			h.pos >= SETTINGS_LOG_LEN) {
+		h.seq = 0;
+		h.pos = 0;
+	}
+	log_seq = h.seq;
+	log_head = h.pos;
+	for (log_used = 0; log_used < SETTINGS_LOG_LEN; log_used++) {
+		eeq_read_block(&r, &settings.log[log_head], sizeof(r));
+		if (r.seq != log_seq ||
+				r.crc != log_crc((uint8_t *)&r, sizeof(r) - 1))
+			break;
+		if (r.off < sizeof(image))
+			((uint8_t *)&image)[r.off] = r.val;
+		log_seq++;
+		if (++log_head == SETTINGS_LOG_LEN)
+			log_head = 0;
+	}
+	/* we went down between filling the log and folding it */
+	if (log_used == SETTINGS_LOG_LEN)
+		settings_log_fold();
+}
+
+/* change one byte of the image, logging it if it really changed */
+static void settings_set(void *field, uint8_t val) {
+	uint8_t *p = field;
+	if (*p == val)
+		return;
+	*p = val;
+	settings_log_append(p - (uint8_t *)&image, val);
+}
+
 /* signature is made by taking the sha1sum of the settings_t struct */
 bool settings_valid_signature(void) {
-	uint32_t ee_sig = eeprom_read_dword(&settings.signature);
+	uint32_t ee_sig = eeq_read_dword(&settings.signature);
 	uint32_t pgm_sig = pgm_read_dword(&default_settings.signature);
 	return (ee_sig == pgm_sig);
 }
 
-void settings_choose_sanity(void) {
-	uint8_t i, v;
-	for (i=0; i<sizeof(struct preset); i++) {
-		v = pgm_read_byte(((PGM_P)&default_settings)+i+4);
-		eeprom_update_byte(((uint8_t*)&settings.presets[cp])+i, v);
+/*
+ * Layout migrations.  Each time the SHA1SUM block in settings.h changes,
+ * the layout being replaced is added to the end of settings_history[]
+ * and the way to get from it to the new layout is added as the next
+ * step: the regions that moved (offsets in bytes from the start of the
+ * eeprom) in settings_moves[], and anything that can't be done by moving
+ * bytes around in settings_fixup().  Steps are chained, so any old
+ * layout is brought all the way up to date.  Old layouts are only ever
+ * known by their offsets, never by the structs in settings.h.
+ *
+ * Any log the old layout had is folded into its base image first, so
+ * the steps only have to deal with the image, and the new layout starts
+ * with an empty log.
+ *
+ * Regions that stay put are skipped and the copies only write the bytes
+ * that differ, so an upgrade costs only what really moved.  All of it
+ * goes through the write queue with the new signature last; if power is
+ * lost part way, the signature is left invalid rather than old, so the
+ * next boot falls back to the defaults instead of moving things twice.
+ *
+ * Moving a full memory pool is seconds of eeprom writes, so the boot
+ * does not wait for them.  The steps are first run dry, on the ram image
+ * standing in for the part of the eeprom it comes from, which gives the
+ * new image straight away; the image only ever comes from the old image
+ * and its log, so whatever the dry run makes of the rest does not
+ * matter.  The real steps are then queued a unit at a time whenever the
+ * queue has room, walking them from the start each time and skipping
+ * the units already queued.  The last unit folds the ram image over the
+ * base copy, which takes care of the old log and of any change made in
+ * the meantime.  Until then nothing is logged, and the memories read as
+ * empty and can't be set.
+ */
+struct settings_version {
+	uint32_t signature;
+	uint16_t log;     /* where the log is, if it has one */
+	uint8_t log_len;  /* and how many records it holds */
+};
+
+struct settings_move {
+	uint8_t step;
+	uint16_t from;
+	uint16_t to;
+	uint16_t len;
+};
+
+#define SETTINGS_EE(OFF) ((uint8_t *)&settings + (OFF))
+
+static bool settings_dry;        /* the steps work on the ram image */
+static bool settings_migrating;  /* the real ones are still being queued */
+static uint8_t migrate_from;     /* the layout they start from */
+static uint8_t migrate_queued;   /* units of them queued so far */
+static uint8_t migrate_unit;     /* the unit a walk has got to */
+static uint16_t pack_off;        /* where the next packed memory goes */
+
+static PROGMEM struct settings_version settings_history[] = {
+	{ SETTINGS_SIG_V1, 0, 0 },
+	{ SETTINGS_SIG_V2, 718, 76 },
+	{ SETTINGS_SIG_V3, 720, 76 },
+	{ SETTINGS_SIG_V4, 720, 76 },
+	{ SETTINGS_SIG_V5, 725, 74 },
+	{ SETTINGS_SIG_V6, 727, 73 },
+};
+#define SETTINGS_VERSIONS \
+	(sizeof(settings_history)/sizeof(struct settings_version))
+
+static PROGMEM struct settings_move settings_moves[] = {
+	/* v1: signature, current_preset, presets, memory_repeat, memory.
+	 * v2 adds the log header after the signature and the log at the end */
+	{ 0, 4, 7, 71 + 640 },
+	/* v3 adds the callsign after the memory repeats and packs the
+	 * memories (see settings_pack_memories) */
+	/* v4 has second resolution repeats with a phase, which pushes the
+	 * callsign and a slightly smaller memory pool up */
+	{ 2, 88, 118, 602 },
+	{ 2, 78, 108, CALLSIGN_LEN },
+	/* v5 adds the contest serial number and cut numbers to the end of
+	 * the image; the memory pool moves up and the log gives up two
+	 * records to make room */
+	{ 3, 118, 123, 602 },
+	/* v6 adds the ptt lead and tail times after them, and the log
+	 * gives up another record */
+	{ 4, 123, 125, 602 },
+	/* v7 presets have a weight and keying compensation on the end, so
+	 * each one is two bytes longer.  Everything after them moves up
+	 * twenty and the log gives up four records; the presets themselves
+	 * are spread out from the top down */
+	{ 5, 125, 145, 602 },
+	{ 5, 68, 88, 57 },
+	{ 5, 62, 80, 6 },
+	{ 5, 56, 72, 6 },
+	{ 5, 50, 64, 6 },
+	{ 5, 44, 56, 6 },
+	{ 5, 38, 48, 6 },
+	{ 5, 32, 40, 6 },
+	{ 5, 26, 32, 6 },
+	{ 5, 20, 24, 6 },
+	{ 5, 14, 16, 6 },
+};
+
+/* the byte of the ram image standing in for eeprom offset off in a dry
+ * run, if there is one */
+static uint8_t *settings_window(uint16_t off) {
+	off -= offsetof(settings_t, image);
+	return off < sizeof(image) ? (uint8_t *)&image + off : NULL;
+}
+
+/* the steps get at the eeprom through these, which in a dry run read
+ * the window and write only to it */
+static uint8_t settings_ee_read(uint16_t off) {
+	uint8_t *p;
+	if (settings_dry && (p = settings_window(off)))
+		return *p;
+	return eeq_read_byte(SETTINGS_EE(off));
+}
+
+static void settings_ee_read_block(void *dst, uint16_t off, uint16_t len) {
+	uint8_t *d = dst;
+	while (len--)
+		*d++ = settings_ee_read(off++);
+}
+
+static void settings_ee_put(uint16_t off, uint8_t val) {
+	uint8_t *p = settings_window(off);
+	if (p)
+		*p = val;
+}
+
+static void settings_ee_write_byte(uint16_t off, uint8_t val) {
+	if (settings_dry)
+		settings_ee_put(off, val);
+	else
+		eeq_write_byte(SETTINGS_EE(off), val);
+}
+
+static void settings_ee_write_block(uint16_t off, const void *src,
+		uint8_t len) {
+	const uint8_t *s = src;
+	if (!settings_dry) {
+		eeq_write_block(SETTINGS_EE(off), src, len);
+		return;
 	}
+	while (len--)
+		settings_ee_put(off++, *s++);
 }
 
-void settings_default(void) {
-	uint8_t i, j;
-	eeprom_update_dword(&settings.signature,
-		pgm_read_dword(&default_settings.signature));
-	j = cp;
-	for (i=0; i<MEMORY_COUNT; i++) {
-		cp = i;
-		settings_choose_sanity();
+static void settings_ee_write_block_P(uint16_t off, const void *src,
+		uint8_t len) {
+	const uint8_t *s = src;
+	if (!settings_dry) {
+		eeq_write_block_P(SETTINGS_EE(off), src, len);
+		return;
 	}
-	cp = j;
-	eeprom_update_byte(&settings.current_preset, 0);
-	/* clear out the memories */
+	while (len--)
+		settings_ee_put(off++, pgm_read_byte(s++));
+}
+
+static void settings_ee_fill(uint16_t off, uint8_t val, uint16_t len) {
+	if (!settings_dry) {
+		eeq_fill(SETTINGS_EE(off), val, len);
+		return;
+	}
+	while (len--)
+		settings_ee_put(off++, val);
+}
+
+/* away from the overlap, as eeq_copy does */
+static void settings_ee_copy(uint16_t to, uint16_t from, uint16_t len) {
+	uint16_t n, i;
+	if (!settings_dry) {
+		eeq_copy(SETTINGS_EE(to), SETTINGS_EE(from), len);
+		return;
+	}
+	for (n = 0; n < len; n++) {
+		i = to > from ? len - 1 - n : n;
+		if (settings_window(to + i))
+			settings_ee_put(to + i, settings_ee_read(from + i));
+	}
+}
+
+/* true if the walk has got to the first unit of the real steps not
+ * queued yet and the queue has room for its jobs; a dry run does them
+ * all */
+static bool settings_unit(uint8_t jobs, bool stage) {
+	if (settings_dry)
+		return true;
+	if (migrate_unit++ != migrate_queued || !eeq_room(jobs, stage))
+		return false;
+	migrate_queued++;
+	return true;
+}
+
+/* v2 had ten raw 64 byte memories at 78, where the v3 callsign (78) and
+ * memory pool (88) start.  Each encoded memory is at most 49 bytes, so
+ * the pool never catches up with the raw memories still to be read. */
+static void settings_pack_memories(void) {
+	uint8_t text[65];
+	uint8_t data[MEMORY_BYTES];
+	uint8_t i, len;
+
+	text[64] = 0;
 	for (i=0; i<MEMORY_COUNT; i++) {
-		eeprom_update_byte(&settings.memory_repeat[i], 0);
-		for (j=0; j<MEMORY_LEN; j++)
-			eeprom_update_byte(&settings.memory[i][j], 0);
+		if (!settings_unit(2, true))
+			continue;
+		if (i == 0)
+			pack_off = 88;
+		settings_ee_read_block(text, 78 + 64 * i, 64);
+		len = memory_encode((char *)text, data);
+		settings_ee_write_byte(pack_off, len);
+		if (len)
+			settings_ee_write_block(pack_off + 1, data, len);
+		pack_off += 1 + len;
+	}
+	if (settings_unit(1, false))
+		settings_ee_fill(78, 0, CALLSIGN_LEN);
+}
+
+/* v3 repeats were in minutes, one byte each at 68; v4 has them in
+ * seconds at 68 and phases at 88 */
+static void settings_repeat_seconds(void) {
+	uint8_t min[MEMORY_COUNT];
+	uint16_t sec[MEMORY_COUNT];
+	uint16_t off;
+	uint8_t i, len;
+
+	if (!settings_unit(3, true))
+		return;
+	settings_ee_read_block(min, 68, MEMORY_COUNT);
+	for (i=0; i<MEMORY_COUNT; i++)
+		sec[i] = min[i] * 60;
+	settings_ee_write_block(68, sec, sizeof(sec));
+	settings_ee_fill(88, 0, sizeof(sec));
+
+	/* the pool got smaller; drop whatever no longer fits */
+	for (off=0, i=0; i<MEMORY_COUNT; i++, off+=1+len) {
+		len = settings_ee_read(118 + off);
+		if (off + 1 + len > 602) {
+			settings_ee_fill(118 + off, 0,
+				MIN(MEMORY_COUNT - i, 602 - off));
+			break;
+		}
 	}
 }
 
+/* the v5 serial number starts at 001, with no cuts */
+static void settings_serial_defaults(void) {
+	static PROGMEM uint8_t serial[5] = { 1, 0, 0, 0, 3 };
+	if (settings_unit(1, false))
+		settings_ee_write_block_P(118, serial, sizeof(serial));
+}
+
+/* v6 ptt starts out following the key, with no lead or tail */
+static void settings_ptt_defaults(void) {
+	if (settings_unit(1, false))
+		settings_ee_fill(123, 0, 2);
+}
+
+/* v7 presets start out evenly weighted, with no compensation */
+static void settings_weight_defaults(void) {
+	static PROGMEM uint8_t weighting[2] = { 50, 0 };
+	uint8_t i;
+	for (i=0; i<MEMORY_COUNT; i++)
+		if (settings_unit(1, false))
+			settings_ee_write_block_P(14 + 8 * i, weighting,
+				sizeof(weighting));
+}
+
+static void settings_fixup(uint8_t step) {
+	switch (step) {
+	case 1:
+		settings_pack_memories();
+		break;
+	case 2:
+		settings_repeat_seconds();
+		break;
+	case 3:
+		settings_serial_defaults();
+		break;
+	case 4:
+		settings_ptt_defaults();
+		break;
+	case 5:
+		settings_weight_defaults();
+		break;
+	}
+}
+
+/* replay a log of log_len records at log_off into the old image; only
+ * the dry run needs to, as the real one ends with a fold */
+static void settings_fold_old_log(uint16_t log_off, uint8_t log_len) {
+	struct settings_log_header h;
+	struct settings_log_record r;
+	uint8_t n;
+
+	eeq_read_block(&h, &settings.log_header, sizeof(h));
+	if (h.crc != log_crc((uint8_t *)&h, sizeof(h) - 1) ||
+			h.pos >= log_len)
+		return;
+	for (n=0; n<log_len; n++) {
+		eeq_read_block(&r, SETTINGS_EE(log_off + h.pos * sizeof(r)),
+			sizeof(r));
+		if (r.seq != h.seq ||
+				r.crc != log_crc((uint8_t *)&r, sizeof(r) - 1))
+			break;
+		settings_ee_write_byte(offsetof(settings_t, image) + r.off,
+			r.val);
+		h.seq++;
+		if (++h.pos == log_len)
+			h.pos = 0;
+	}
+}
+
+/* go through the steps from migrate_from: all of them on the ram image
+ * in a dry run, otherwise queueing whatever of the real ones is next */
+static void settings_migrate_walk(void) {
+	uint16_t from, to, log_off;
+	uint8_t i, step = migrate_from;
+
+	migrate_unit = 0;
+	if (settings_unit(1, false))
+		settings_ee_fill(offsetof(settings_t, signature), 0,
+			sizeof(settings.signature));
+	log_off = pgm_read_word(&settings_history[step].log);
+	if (settings_dry && log_off)
+		settings_fold_old_log(log_off,
+			pgm_read_byte(&settings_history[step].log_len));
+	for (i=0; i<(sizeof(settings_moves)/sizeof(struct settings_move)); i++) {
+		if (pgm_read_byte(&settings_moves[i].step) < step)
+			continue;
+		/* finish off the step before moving on to the next one */
+		while (step < pgm_read_byte(&settings_moves[i].step))
+			settings_fixup(step++);
+		from = pgm_read_word(&settings_moves[i].from);
+		to = pgm_read_word(&settings_moves[i].to);
+		if (from == to)
+			continue;
+		if (settings_unit(1, false))
+			settings_ee_copy(to, from,
+				pgm_read_word(&settings_moves[i].len));
+	}
+	while (step < SETTINGS_VERSIONS)
+		settings_fixup(step++);
+	/* the image over the base copy with an empty log, then the new
+	 * signature */
+	if (settings_dry || !settings_unit(4, true))
+		return;
+	log_seq = 0;
+	log_head = 0;
+	settings_log_fold();
+	eeq_write_byte(&settings.log[0].seq, 0x80);
+	eeq_write_block_P(&settings.signature, &default_settings.signature,
+		sizeof(settings.signature));
+	settings_migrating = false;
+}
+
+static bool settings_migrate(void) {
+	uint32_t sig = eeq_read_dword(&settings.signature);
+
+	for (migrate_from=0; migrate_from<SETTINGS_VERSIONS; migrate_from++)
+		if (pgm_read_dword(&settings_history[migrate_from].signature)
+				== sig)
+			break;
+	if (migrate_from == SETTINGS_VERSIONS)
+		return false;
+	eeq_read_block(&image, &settings.image, sizeof(image));
+	settings_dry = true;
+	settings_migrate_walk();
+	settings_dry = false;
+	/* the fold at the end saves everything */
+	log_behind = true;
+	settings_migrating = true;
+	migrate_queued = 0;
+	settings_migrate_walk();
+	return true;
+}
+
+void settings_choose_sanity(void) {
+	uint8_t i;
+	for (i=0; i<sizeof(struct preset); i++)
+		settings_set(((uint8_t *)&image.presets[cp]) + i,
+			pgm_read_byte(((PGM_P)&default_settings.wpm) + i));
+}
+
+/* the eeprom side of settings_default, all of it or (if there is no
+ * room for that) none of it */
+static void settings_default_save(void) {
+	reset_behind = !eeq_room(5, false);
+	if (reset_behind) {
+		log_behind = true;
+		return;
+	}
+	settings_log_fold();
+	/* make sure nothing left in the log area replays on top of it */
+	eeq_write_byte(&settings.log[log_head].seq, log_seq ^ 0x80);
+	/* clear out the memories */
+	eeq_fill(settings.memory, 0, sizeof(settings.memory));
+	eeq_write_block_P(&settings.signature, &default_settings.signature,
+		sizeof(settings.signature));
+}
+
+/* everything here is queued and written out in the background; the
+ * signature goes last so that a reset cut short is redone next boot */
+void settings_default(void) {
+	uint8_t i;
+	/* nothing a migration still had to do is wanted now */
+	settings_migrating = false;
+	memset(&image, 0, sizeof(image));
+	for (i=0; i<MEMORY_COUNT; i++)
+		memcpy_P(&image.presets[i], &default_settings.wpm,
+			sizeof(struct preset));
+	image.serial = 1;
+	image.serial_width = 3;
+	settings_default_save();
+}
+
+/* the eeprom queue has room again after turning something away */
+static void settings_catch_up(void) {
+	if (settings_migrating)
+		settings_migrate_walk();
+	else if (reset_behind)
+		settings_default_save();
+	else if (log_behind)
+		settings_log_fold();
+}
+
 void settings_init(void) {
 	/* check for valid signature */
-	if (!settings_valid_signature())
+	if (!settings_valid_signature() && !settings_migrate())
 		settings_default();
+	/* the replay sees through to anything still queued; a migration
+	 * has the image already */
+	if (!settings_migrating)
+		settings_log_replay();
+	eeq_set_drained(settings_catch_up);
 	cp = settings_get_preset();
 }
 
 uint8_t settings_get_wpm(void) {
-	return eeprom_read_byte(&settings.presets[cp].wpm);
+	return image.presets[cp].wpm;
 }
 
 void settings_set_wpm(uint8_t wpm) {
-	eeprom_update_byte(&settings.presets[cp].wpm, wpm);
+	settings_set(&image.presets[cp].wpm, wpm);
 }
 
 uint8_t settings_get_keying_mode(void) {
-	return (keying_mode_t)eeprom_read_byte(&settings.presets[cp].keying_mode);
+	return image.presets[cp].keying_mode;
 }
 
 void settings_set_keying_mode(keying_mode_t mode) {
-	eeprom_update_byte((uint8_t *)&settings.presets[cp].keying_mode, (uint8_t)mode);
+	settings_set(&image.presets[cp].keying_mode, (uint8_t)mode);
 }
 
 uint8_t settings_get_frequency(void) {
-	return eeprom_read_byte(&settings.presets[cp].frequency);
+	return image.presets[cp].frequency;
 }
 
 void settings_set_frequency(uint8_t freq) {
-	eeprom_update_byte(&settings.presets[cp].frequency, freq);
+	settings_set(&image.presets[cp].frequency, freq);
 }
 
 didah_queue_t settings_get_left_key(void) {
-	return (didah_queue_t)eeprom_read_byte(&settings.presets[cp].left_key);
+	return image.presets[cp].left_key;
 }
 
 void settings_set_left_key(didah_queue_t didah) {
-	eeprom_update_byte((uint8_t *)&settings.presets[cp].left_key, (uint8_t)didah);
+	settings_set(&image.presets[cp].left_key, (uint8_t)didah);
+}
+
+/* offset in the pool of the data of memory id, and its length */
+uint16_t settings_get_memory(uint8_t id, uint8_t *len) {
+	uint16_t off = 0;
+	uint8_t i;
+	if (settings_migrating) {
+		*len = 0;
+		return MEMORY_POOL_LEN;
+	}
+	for (i=0; i<id; i++) {
+		off += 1 + eeq_read_byte(&settings.memory[off]);
+		if (off >= MEMORY_POOL_LEN) {
+			*len = 0;
+			return MEMORY_POOL_LEN;
+		}
+	}
+	*len = eeq_read_byte(&settings.memory[off]);
+	/* don't wander off the end of a damaged pool */
+	if (off + 1 + *len > MEMORY_POOL_LEN)
+		*len = 0;
+	return off + 1;
+}
+
+uint8_t settings_get_memory_byte(uint16_t off) {
+	return eeq_read_byte(&settings.memory[off]);
 }
 
-void settings_get_memory(uint8_t id, uint8_t *msg) {
-	eeprom_read_block(msg, &settings.memory[id][0], MEMORY_LEN);
+/* for interrupt context; false if the eeprom is busy */
+bool settings_try_memory_byte(uint16_t off, uint8_t *v) {
+	return eeq_try_read_byte(&settings.memory[off], v);
 }
 
-void settings_set_memory(uint8_t id, const uint8_t *msg) {
-	eeprom_update_block(msg, &settings.memory[id][0], MEMORY_LEN);
+/* replace memory id, moving the memories after it up or down to make
+ * room.  Returns false if it won't fit in the pool, or if the eeprom
+ * queue can't take all of it yet (the last save is still going out). */
+bool settings_set_memory(uint8_t id, const uint8_t *data, uint8_t len) {
+	uint16_t start, end, used;
+	uint8_t old, i;
+	bool room;
+
+	if (settings_migrating)
+		return false;
+	start = settings_get_memory(id, &old) - 1;
+	end = start + 1 + old;
+	for (used=end, i=id+1; i<MEMORY_COUNT; i++)
+		used += 1 + eeq_read_byte(&settings.memory[used]);
+	if (used - old + len > MEMORY_POOL_LEN)
+		return false;
+	/* a move without the rest would wreck the pool */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		room = eeq_room(3, true);
+		if (room) {
+			if (len != old && used > end)
+				eeq_copy(&settings.memory[start + 1 + len],
+					&settings.memory[end], used - end);
+			eeq_write_byte(&settings.memory[start], len);
+			if (len)
+				eeq_write_block(&settings.memory[start + 1],
+					data, len);
+		}
+	}
+	return room;
+}
+
+uint16_t settings_get_memory_repeat(uint8_t id) {
+	return image.repeat_period[id];
+}
+
+uint16_t settings_get_memory_phase(uint8_t id) {
+	return image.repeat_phase[id];
 }
 
-uint8_t settings_get_memory_repeat(uint8_t id) {
-	return eeprom_read_byte(&settings.memory_repeat[id]);
+static void settings_set16(uint16_t *field, uint16_t val) {
+	settings_set(field, val & 0xff);
+	settings_set((uint8_t *)field + 1, val >> 8);
 }
 
-void settings_set_memory_repeat(uint8_t id, const uint8_t freq) {
-	eeprom_update_byte(&settings.memory_repeat[id], freq);
+void settings_set_memory_repeat(uint8_t id, uint16_t period, uint16_t phase) {
+	settings_set16(&image.repeat_period[id], period);
+	settings_set16(&image.repeat_phase[id], phase);
 }
 
 bool settings_get_beeper(void) {
-	return (bool)eeprom_read_byte((uint8_t*)&settings.presets[cp].beeper);
+	return image.presets[cp].beeper;
 }
 
 void settings_set_beeper(bool beep) {
-	eeprom_update_byte((uint8_t*)&settings.presets[cp].beeper, (uint8_t)beep);
+	settings_set(&image.presets[cp].beeper, (uint8_t)beep);
+}
+
+uint8_t settings_get_weight(void) {
+	return image.presets[cp].weight;
+}
+
+int8_t settings_get_comp(void) {
+	return image.presets[cp].comp;
+}
+
+void settings_set_weighting(uint8_t weight, int8_t comp) {
+	settings_set(&image.presets[cp].weight, weight);
+	settings_set(&image.presets[cp].comp, (uint8_t)comp);
 }
 
 bool settings_get_autospace(void) {
-	return (bool)eeprom_read_byte((uint8_t*)&settings.presets[cp].autospace);
+	return image.presets[cp].autospace;
 }
 
 void settings_set_autospace(bool autospace) {
-	eeprom_update_byte((uint8_t*)&settings.presets[cp].autospace, (uint8_t)autospace);
+	settings_set(&image.presets[cp].autospace, (uint8_t)autospace);
+}
+
+/* not nul terminated if it takes up all CALLSIGN_LEN chars */
+const char *settings_get_callsign(void) {
+	return image.callsign;
+}
+
+void settings_set_callsign(const char *call) {
+	uint8_t i;
+	for (i=0; i<CALLSIGN_LEN; i++) {
+		settings_set(&image.callsign[i], *call);
+		if (*call)
+			call++;
+	}
+}
+
+uint16_t settings_get_serial(void) {
+	return image.serial;
+}
+
+uint8_t settings_get_serial_width(void) {
+	return image.serial_width;
+}
+
+void settings_set_serial(uint16_t serial, uint8_t width) {
+	settings_set16(&image.serial, serial);
+	settings_set(&image.serial_width, width);
+}
+
+uint16_t settings_get_cuts(void) {
+	return image.cuts;
+}
+
+void settings_set_cuts(uint16_t cuts) {
+	settings_set16(&image.cuts, cuts);
+}
+
+uint8_t settings_get_ptt_lead(void) {
+	return image.ptt_lead;
+}
+
+uint8_t settings_get_ptt_tail(void) {
+	return image.ptt_tail;
+}
+
+void settings_set_ptt(uint8_t lead, uint8_t tail) {
+	settings_set(&image.ptt_lead, lead);
+	settings_set(&image.ptt_tail, tail);
 }
 
 uint8_t settings_get_preset(void) {
-	return eeprom_read_byte(&settings.current_preset);
+	return image.current_preset;
 }
 
 void restore_preset(uint8_t pid) {
 	if (pid > 9)
 		return;
 	cp = pid;
-	eeprom_update_byte(&settings.current_preset, pid);
-	cw_set_speed(settings_get_wpm());
+	settings_set(&image.current_preset, pid);
+	cw_set_speed(settings_get_wpm(), false);
 	cw_set_keying_mode(settings_get_keying_mode());
 	cw_set_left_key(settings_get_left_key());
 	cw_set_beeper(settings_get_beeper());
 	cw_set_word_space(settings_get_autospace(), true);
+	cw_set_weighting(settings_get_weight(), settings_get_comp());
 }
 
 #ifdef DEBUG
 void settings_dump(void) {
 	uint8_t i;
-	uint32_t sig = eeprom_read_dword(&settings.signature);
-	uint8_t msg[MEMORY_LEN];
+	uint32_t sig = eeq_read_dword(&settings.signature);
+	char msg[MEMORY_TEXT_LEN + 1];
 	ulog("signature: %#x%x\r", (uint16_t)(sig >> 16), (uint16_t)(sig & 0xffff));
 	_delay_ms(1);
-	ulog("current_preset: %u\r", eeprom_read_byte(&settings.current_preset));
+	ulog("log: seq %u, head %u, used %u/%u\r", log_seq, log_head,
+		log_used, SETTINGS_LOG_LEN);
+	_delay_ms(1);
+	ulog("current_preset: %u\r", image.current_preset);
 	_delay_ms(1);
 	for (i=0; i<MEMORY_COUNT; i++) {
 		ulog("preset %u:\r", i);
 		_delay_ms(1);
-		ulog("  wpm: %u\r", eeprom_read_byte(&settings.presets[i].wpm));
+		ulog("  wpm: %u\r", image.presets[i].wpm);
 		_delay_ms(1);
-		ulog("  key mode: %u\r", eeprom_read_byte(&settings.presets[i].keying_mode));
+		ulog("  key mode: %u\r", image.presets[i].keying_mode);
 		_delay_ms(1);
-		ulog("  left key: %u\r", eeprom_read_byte(&settings.presets[i].left_key));
+		ulog("  left key: %u\r", image.presets[i].left_key);
 		_delay_ms(1);
-		ulog("  freq: %u\r", eeprom_read_byte(&settings.presets[i].frequency));
+		ulog("  freq: %u\r", image.presets[i].frequency);
 		_delay_ms(1);
-		ulog("  beeper: %u\r", eeprom_read_byte((uint8_t*)&settings.presets[i].beeper));
+		ulog("  beeper: %u\r", image.presets[i].beeper);
+		_delay_ms(1);
+		ulog("  weight: %u, comp: %d\r", image.presets[i].weight,
+			image.presets[i].comp);
 		_delay_ms(1);
 	}
-	for (i=0; i<10; i++) {
-		settings_get_memory(i, msg);
-		ulog("memory %u (r %u)\r", i, eeprom_read_byte(&settings.memory_repeat[i]));
+	memcpy(msg, image.callsign, CALLSIGN_LEN);
+	msg[CALLSIGN_LEN] = 0;
+	ulog("callsign: %s\r", msg);
+	_delay_ms(1);
+	ulog("serial: %u (%u digits), cuts: %#x\r", image.serial,
+		image.serial_width, image.cuts);
+	_delay_ms(1);
+	ulog("ptt: lead %ums, tail %u0ms\r", image.ptt_lead,
+		image.ptt_tail);
+	_delay_ms(1);
+	for (i=0; i<MEMORY_COUNT; i++) {
+		struct memory_cursor mc;
+		uint8_t j = 0;
+		memory_open(&mc, i);
+		ulog("memory %u (r %us p %us, %u bytes)\r", i,
+			image.repeat_period[i], image.repeat_phase[i], mc.left);
 		_delay_ms(1);
+		while (j < MEMORY_TEXT_LEN && (msg[j] = memory_next(&mc)))
+			j++;
+		msg[j] = 0;
 		ulog("  [%s]\r", msg);
 		_delay_ms(10);
 	}
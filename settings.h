@@ -26,8 +26,12 @@
 
 /* SHA1SUM BEGIN */
 /* SHA1SUM SIG SHA1_SIGNATURE */
-#define MEMORY_LEN 64
 #define MEMORY_COUNT 10
+/* longest message that can be entered */
+#define MEMORY_TEXT_LEN 96
+/* and the most it can take up once encoded (see memory.c) */
+#define MEMORY_BYTES ((MEMORY_TEXT_LEN * 6 + 7) / 8)
+#define CALLSIGN_LEN 10
 
 #define SETTINGS_ITEMS \
 	uint8_t wpm; \
@@ -35,7 +39,9 @@
 	didah_queue_t left_key; \
 	uint8_t frequency; \
 	bool beeper; \
-	bool autospace;
+	bool autospace; \
+	uint8_t weight; /* mark to space, 50 is even */ \
+	int8_t comp;    /* and 0.1ms more (or less) on every mark */
 
 struct preset {
 	SETTINGS_ITEMS
@@ -46,15 +52,57 @@ struct default_preset {
 	SETTINGS_ITEMS;
 };
 
-typedef struct {
-	uint32_t signature; \
+/* the small, often changed settings.  These live in ram and are
+ * saved as a base copy plus a log of byte changes (see settings.c) */
+struct settings_image {
 	uint8_t current_preset;
 	struct preset presets[MEMORY_COUNT];
-	uint8_t memory_repeat[MEMORY_COUNT];
-	uint8_t memory[MEMORY_COUNT][MEMORY_LEN];
+	uint16_t repeat_period[MEMORY_COUNT]; /* seconds, 0 for off */
+	uint16_t repeat_phase[MEMORY_COUNT];
+	char callsign[CALLSIGN_LEN];
+	uint16_t serial;      /* next contest serial number */
+	uint16_t cuts;        /* bit n set: send digit n as its cut letter */
+	uint8_t serial_width; /* serial numbers are zero padded to this */
+	uint8_t ptt_lead;     /* ms of ptt before the first mark */
+	uint8_t ptt_tail;     /* and after the last, in 10ms */
+};
+
+struct settings_log_header {
+	uint8_t seq;  /* sequence number of the first unfolded record */
+	uint8_t pos;  /* and where it is */
+	uint8_t crc;
+};
+
+struct settings_log_record {
+	uint8_t seq;
+	uint8_t off;  /* offset into struct settings_image */
+	uint8_t val;
+	uint8_t crc;
+};
+
+#define SETTINGS_LOG_LEN 69
+
+/* whatever eeprom is left over after everything else.  The memories are
+ * stored back to back as a length byte followed by the encoded message */
+#define MEMORY_POOL_LEN 602
+
+typedef struct {
+	uint32_t signature; \
+	struct settings_log_header log_header;
+	struct settings_image image;
+	uint8_t memory[MEMORY_POOL_LEN];
+	struct settings_log_record log[SETTINGS_LOG_LEN];
 } settings_t;
 /* SHA1SUM END */
 
+/* signatures of earlier layouts; see settings_history[] in settings.c */
+#define SETTINGS_SIG_V1 0x1b2049ad
+#define SETTINGS_SIG_V2 0x352a244b
+#define SETTINGS_SIG_V3 0x513ce9a4
+#define SETTINGS_SIG_V4 0x21eee7b4
+#define SETTINGS_SIG_V5 0xc433d73c
+#define SETTINGS_SIG_V6 0x24679a79
+
 void settings_init(void);
 void settings_choose_sanity(void);
 void settings_default(void);
@@ -66,14 +114,30 @@ uint8_t settings_get_frequency(void);
 void settings_set_frequency(uint8_t freq);
 didah_queue_t settings_get_left_key(void);
 void settings_set_left_key(didah_queue_t didah);
-void settings_get_memory(uint8_t id, uint8_t *msg);
-void settings_set_memory(uint8_t id, const uint8_t *msg);
-uint8_t settings_get_memory_repeat(uint8_t id);
-void settings_set_memory_repeat(uint8_t id, const uint8_t freq);
+uint16_t settings_get_memory(uint8_t id, uint8_t *len);
+uint8_t settings_get_memory_byte(uint16_t off);
+bool settings_try_memory_byte(uint16_t off, uint8_t *v);
+bool settings_set_memory(uint8_t id, const uint8_t *data, uint8_t len);
+uint16_t settings_get_memory_repeat(uint8_t id);
+uint16_t settings_get_memory_phase(uint8_t id);
+void settings_set_memory_repeat(uint8_t id, uint16_t period, uint16_t phase);
 bool settings_get_autospace(void);
 void settings_set_autospace(bool autospace);
 bool settings_get_beeper(void);
 void settings_set_beeper(bool beep);
+uint8_t settings_get_weight(void);
+int8_t settings_get_comp(void);
+void settings_set_weighting(uint8_t weight, int8_t comp);
+const char *settings_get_callsign(void);
+void settings_set_callsign(const char *call);
+uint16_t settings_get_serial(void);
+uint8_t settings_get_serial_width(void);
+void settings_set_serial(uint16_t serial, uint8_t width);
+uint16_t settings_get_cuts(void);
+void settings_set_cuts(uint16_t cuts);
+uint8_t settings_get_ptt_lead(void);
+uint8_t settings_get_ptt_tail(void);
+void settings_set_ptt(uint8_t lead, uint8_t tail);
 uint8_t settings_get_preset(void);
 void restore_preset(uint8_t pid);
 void settings_dump(void);
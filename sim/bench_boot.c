@@ -0,0 +1,160 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-boot: how long settings_init holds up the boot
+ *
+ * usage: bench-boot
+ *
+ * settings_init runs before interrupts are on, so any wait on the
+ * eeprom in it holds up the boot.  It is timed in virtual cycles from
+ * the call to the return on eeprom images that make it do the most:
+ *
+ *   current    this layout, with every record of the log in use, so
+ *              all of them are replayed and the log is folded
+ *   v6, v2     an older layout with a full log of its own, which is
+ *              folded into its image, and every byte of the memories
+ *              in use, so the moves and fixups that bring it up to
+ *              date have the most to write; v2 is the oldest with a
+ *              log, and goes through every step after it
+ *
+ * For each, the time settings_init took is printed, and the time until
+ * everything it started is written out, which goes on in the background
+ * after it returns.  Code takes no time on the simulator, so what is
+ * timed is the waiting on the eeprom; the replay itself, a few reads
+ * and a crc for each record, is well under a ms on the avr, and so is
+ * the dry run of a migration.
+ *
+ * The exit status is 1 if settings_init took more than BOOT_LIMIT_MS in
+ * any of them: the budget the debug build checks it against on the
+ * avr, with timer1 (see sw_init).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+#include "settings.h"
+#include "stack.h"
+#include "eeq.h"
+#include "sim.h"
+
+#define BOOT_LIMIT_MS 50
+
+/* as in settings.c */
+#define LOG_CRC_INIT 0x5a
+
+static uint8_t log_crc(const uint8_t *p, uint8_t len) {
+	uint8_t crc = LOG_CRC_INIT;
+	while (len--)
+		crc = _crc_ibutton_update(crc, *p++);
+	return crc;
+}
+
+/* a log of len records at off, all of them in use and each one a change
+ * to a different byte of an image of image_len, as far as that goes */
+static void full_log(uint8_t *ee, uint16_t off, uint8_t len,
+		uint8_t image_len) {
+	struct settings_log_header h = { .seq = 0x40, .pos = len / 3 };
+	struct settings_log_record r;
+	uint8_t n, pos = h.pos;
+
+	h.crc = log_crc((uint8_t *)&h, sizeof(h) - 1);
+	memcpy(ee + 4, &h, sizeof(h));
+	for (n = 0; n < len; n++) {
+		r.seq = h.seq + n;
+		r.off = n % image_len;
+		r.val = ee[7 + r.off] ^ 1;
+		r.crc = log_crc((uint8_t *)&r, sizeof(r) - 1);
+		memcpy(ee + off + pos * sizeof(r), &r, sizeof(r));
+		if (++pos == len)
+			pos = 0;
+	}
+}
+
+static void sig(uint8_t *ee, uint32_t s) {
+	memcpy(ee, &s, sizeof(s));
+}
+
+static void current(uint8_t *ee) {
+	full_log(ee, offsetof(settings_t, log), SETTINGS_LOG_LEN,
+		sizeof(struct settings_image));
+}
+
+/* v6: the image at 7 (118 bytes), the memory pool at 125 and a log of
+ * 73 records at 727 */
+static void v6(uint8_t *ee) {
+	uint16_t i;
+	sig(ee, SETTINGS_SIG_V6);
+	memset(ee + 7, 0, 118);
+	/* ten memories of 59 bytes and their lengths */
+	for (i = 0; i < 602; i++)
+		ee[125 + i] = i % 60 ? 0x80 | i : 59;
+	full_log(ee, 727, 73, 118);
+}
+
+/* v2: the image at 7 (71 bytes), ten raw 64 byte memories at 78 and a
+ * log of 76 records at 718 */
+static void v2(uint8_t *ee) {
+	static const char text[] = "CQ TEST DE N7OH 5NN 001 TU ";
+	uint16_t i;
+	sig(ee, SETTINGS_SIG_V2);
+	memset(ee + 7, 0, 71);
+	/* 63 characters and the nul */
+	for (i = 0; i < 64 * MEMORY_COUNT; i++)
+		ee[78 + i] = i % 64 == 63 ? 0 : text[i % (sizeof(text) - 1)];
+	full_log(ee, 718, 76, 71);
+}
+
+static const struct {
+	const char *name;
+	void (*setup)(uint8_t *ee);
+} cases[] = {
+	{ "current", current },
+	{ "v6", v6 },
+	{ "v2", v2 },
+};
+
+int main(void) {
+	uint64_t start, init, drained;
+	unsigned i, fails = 0;
+	bool ok;
+
+	printf("%-8s %10s %8s %10s\n", "layout", "cycles", "ms",
+		"written ms");
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		sim_init(false);
+		cases[i].setup(sim_eeprom);
+		stack_init();
+		start = sim_now;
+		settings_init();
+		init = sim_now - start;
+		while (eeq_busy())
+			sim_run(sim_now + SIM_MS(1));
+		drained = sim_now - start;
+		ok = init <= SIM_MS(BOOT_LIMIT_MS);
+		fails += !ok;
+		printf("%-8s %10llu %8.1f %10.1f%s\n", cases[i].name,
+			(unsigned long long)init, (double)init / SIM_MS(1),
+			(double)drained / SIM_MS(1), ok ? "" : "  FAIL");
+	}
+	printf("%u over %u ms\n", fails, BOOT_LIMIT_MS);
+	return fails != 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-hmm: the two timing decoders, thresh.c and hmm.c, side by side
+ *
+ * usage: bench-hmm [-v] [-s seed] [-o prefix] [trace]...
+ *   -v  print what was sent and what each decoder made of it
+ *   -s  seed for the made up sending (default 1)
+ *   -o  also write the made up traces out, as prefix-<n>.txt
+ *
+ * A trace is the key as it went up and down: whitespace separated
+ * numbers of ms, positive for key down and negative for key up, with
+ * '#' to the end of a line a comment.  A "# text: ..." comment gives
+ * what was sent, for the error rate; without one the decoded text is
+ * just printed.
+ *
+ * Without traces, TEXT is sent by a handful of made up operators, from
+ * a steady hand to heavy dahs off a bug, a straight key with long gaps,
+ * a sender drifting up in speed and one in static crashes.  There are
+ * no recorded traces in the tree, and these are synthetic: they come
+ * from the same idea of how a hand sends that both decoders were
+ * written to, so what they show is how the two compare and whether a
+ * change makes either worse, not how accurate either is on the air.
+ * Only recorded traces, given on the command line, can say that.
+ *
+ * Each trace goes through both decoders, starting from 20 wpm, in the
+ * way rx.c drives them: the mark when it ends, and the space every
+ * 5ms as it goes on.  For each the character error rate (the edit
+ * distance to the text over its length) and the cpu per 1000 marks
+ * and spaces on this host are printed.  The exit status is 1 if, over
+ * all the traces, the hmm has more errors than the thresholds or is
+ * over HMM_CER_LIMIT.  On the synthetic senders, that is a regression
+ * check and no more.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "cw.h"
+#include "thresh.h"
+#include "hmm.h"
+#include "sim.h"
+
+#define TEXT "CQ TEST DE N7OH N7OH K 5NN 001 TU THE QUICK BROWN FOX " \
+	"JUMPS OVER THE LAZY DOG 73"
+#define MAX_EDGES 8192
+#define MAX_TYPED 1024
+#define QUIET_MS 5
+/* times round each trace, for the cpu time */
+#define REPEAT 20
+
+/* over all the traces; see above for what it means on the synthetic
+ * ones */
+#define HMM_CER_LIMIT 0.04
+
+struct op {
+	const char *name;
+	double wpm;
+	double drift;   /* wpm more by the end */
+	double dah;     /* dah over dit */
+	double jitter;  /* standard deviation of each length, over it */
+	double cgap;    /* character and word gaps over their right length */
+	double wgap;
+	double spikes;  /* short bursts of static a second */
+};
+
+static const struct op ops[] = {
+	{ "steady 20",      20, 0, 3.0, 0.03, 1.0, 1.0, 0 },
+	{ "bug 25",         25, 0, 3.8, 0.08, 1.2, 1.0, 0 },
+	{ "straight 15",    15, 0, 2.6, 0.12, 1.4, 1.3, 0 },
+	{ "rushed 28",      28, 0, 2.7, 0.12, 0.8, 0.7, 0 },
+	{ "slow 10",        10, 0, 3.3, 0.15, 1.6, 1.4, 0 },
+	{ "drifting 16-26", 16, 10, 3.0, 0.08, 1.0, 1.0, 0 },
+	{ "farnsworth 18",  18, 0, 3.0, 0.05, 1.8, 1.6, 0 },
+	{ "sloppy 22",      22, 0, 3.0, 0.20, 1.1, 1.0, 0 },
+	{ "static 20",      20, 0, 3.0, 0.08, 1.0, 1.0, 1.5 },
+};
+
+#define OPS (sizeof(ops) / sizeof(ops[0]))
+
+static int edges[MAX_EDGES];
+static unsigned n_edges;
+static char text[MAX_TYPED + 1];
+
+static char typed[MAX_TYPED + 1];
+static unsigned n_typed;
+
+static void hid(uint8_t c) {
+	if (n_typed < MAX_TYPED)
+		typed[n_typed++] = c;
+}
+
+/* gaussian noise, Box-Muller */
+static double gauss(void) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* key up and down, merging with the last edge if it went the same way */
+static void edge(double ms) {
+	int len = ms < 0 ? ms - 0.5 : ms + 0.5;
+	if (!len)
+		len = ms < 0 ? -1 : 1;
+	if (n_edges && (edges[n_edges - 1] < 0) == (len < 0))
+		edges[n_edges - 1] += len;
+	else if (n_edges < MAX_EDGES)
+		edges[n_edges++] = len;
+}
+
+static double vary(const struct op *op, double ms) {
+	double x = ms * (1 + op->jitter * gauss());
+	return x < 1 ? 1 : x;
+}
+
+/* a space, with the static in it */
+static void space(const struct op *op, double ms) {
+	double at;
+	while (op->spikes && ms > 20 &&
+			rand() < RAND_MAX * op->spikes * ms / 1000) {
+		at = (ms - 10) * rand() / RAND_MAX + 5;
+		edge(-at);
+		edge(2 + 4.0 * rand() / RAND_MAX);
+		ms -= at;
+	}
+	edge(-ms);
+}
+
+static void make_trace(const struct op *op) {
+	size_t len = strlen(TEXT), i;
+	const char *m;
+	double u;
+
+	n_edges = 0;
+	strcpy(text, TEXT);
+	for (i = 0; i < len; i++) {
+		u = 1200 / (op->wpm + op->drift * i / len);
+		if (TEXT[i] == ' ') {
+			space(op, vary(op, 7 * u * op->wgap));
+			continue;
+		}
+		for (m = sim_morse[(uint8_t)TEXT[i]]; m && *m; m++) {
+			edge(vary(op, *m == '.' ? u : op->dah * u));
+			if (m[1])
+				space(op, vary(op, u));
+		}
+		if (TEXT[i + 1] && TEXT[i + 1] != ' ')
+			space(op, vary(op, 3 * u * op->cgap));
+	}
+}
+
+static void write_trace(const char *name, const struct op *op) {
+	FILE *f = fopen(name, "w");
+	unsigned i;
+	if (!f) {
+		perror(name);
+		return;
+	}
+	fprintf(f, "# %s\n# text: %s\n", op->name, text);
+	for (i = 0; i < n_edges; i++)
+		fprintf(f, "%d%c", edges[i], i % 16 == 15 ? '\n' : ' ');
+	fprintf(f, "\n");
+	fclose(f);
+}
+
+static bool read_trace(const char *name) {
+	FILE *f = fopen(name, "r");
+	char line[MAX_TYPED + 16], *p, *end;
+	long v;
+
+	if (!f) {
+		perror(name);
+		return false;
+	}
+	n_edges = 0;
+	text[0] = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if ((p = strchr(line, '#'))) {
+			if (!strncmp(p, "# text: ", 8)) {
+				snprintf(text, sizeof(text), "%s", p + 8);
+				text[strcspn(text, "\r\n")] = 0;
+			}
+			*p = 0;
+		}
+		for (p = line; ; p = end) {
+			v = strtol(p, &end, 10);
+			if (end == p)
+				break;
+			if (v)
+				edge(v);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/* upper case, one space between words and none at the ends */
+static void tidy(char *s) {
+	char *d = s, *p;
+	for (p = s; *p; p++) {
+		if (*p == ' ' && (d == s || d[-1] == ' '))
+			continue;
+		*d++ = toupper((unsigned char)*p);
+	}
+	if (d > s && d[-1] == ' ')
+		d--;
+	*d = 0;
+}
+
+static double cpu_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct decoder {
+	const char *name;
+	void (*init)(uint16_t dit);
+	void (*mark)(uint16_t len);
+	void (*quiet)(uint16_t len);
+	unsigned errors;
+	double cpu;
+};
+
+static struct decoder decoders[] = {
+	{ "thresh", thresh_init, thresh_mark, thresh_quiet },
+	{ "hmm",    hmm_init,    hmm_mark,    hmm_quiet },
+};
+
+#define DECODERS (sizeof(decoders) / sizeof(decoders[0]))
+
+/* the trace through one decoder, REPEAT times; returns the errors */
+static unsigned run_decoder(struct decoder *d, bool verbose) {
+	unsigned r, i, errors;
+	int t;
+	double c = cpu_s();
+
+	for (r = 0; r < REPEAT; r++) {
+		n_typed = 0;
+		d->init(1200 / 20);
+		for (i = 0; i < n_edges; i++) {
+			if (edges[i] > 0) {
+				d->mark(edges[i]);
+				continue;
+			}
+			for (t = QUIET_MS; t < -edges[i]; t += QUIET_MS)
+				d->quiet(t);
+			d->quiet(-edges[i]);
+		}
+		/* and long enough after for anything held back */
+		for (t = QUIET_MS; t <= 3000; t += QUIET_MS)
+			d->quiet(t);
+	}
+	c = cpu_s() - c;
+	d->cpu += c;
+	typed[n_typed] = 0;
+	tidy(typed);
+	errors = text[0] ? sim_edit_distance(text, typed) : 0;
+	d->errors += errors;
+	printf(" %6u %6.1f %6.0f", errors, 100.0 * errors /
+		(text[0] ? strlen(text) : 1), c * 1e6 / REPEAT * 1000 /
+		(n_edges ? n_edges : 1));
+	if (verbose || !text[0])
+		printf("\n    %-6s \"%s\"", d->name, typed);
+	return errors;
+}
+
+static void run(const char *name, bool verbose) {
+	unsigned i;
+	tidy(text);
+	printf("  %-16s %6zu", name, strlen(text));
+	for (i = 0; i < DECODERS; i++)
+		run_decoder(&decoders[i], verbose);
+	if (verbose && text[0])
+		printf("\n    %-6s \"%s\"", "sent", text);
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	const char *prefix = NULL;
+	unsigned seed = 1, chars = 0, i;
+	bool verbose = false, ok = true;
+	char name[256];
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vs:o:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = true; break;
+		case 's': seed = atoi(optarg); break;
+		case 'o': prefix = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-s seed] [-o prefix] "
+				"[trace]...\n", argv[0]);
+			return 2;
+		}
+	}
+
+	/* only for cw_init, so didah_decode hands its characters to hid */
+	sim_boot(true, hid);
+	if (optind < argc)
+		printf("recorded traces\n");
+	else
+		printf("synthetic senders, no recorded traces: a comparison of "
+			"the decoders,\nnot their accuracy on the air\n");
+	printf("  %-16s %6s", "", "chars");
+	for (i = 0; i < DECODERS; i++)
+		printf(" %20s", decoders[i].name);
+	printf("\n  %-16s %6s", "", "");
+	for (i = 0; i < DECODERS; i++)
+		printf(" %6s %6s %6s", "errors", "cer%", "us/1k");
+	printf("\n");
+
+	if (optind < argc) {
+		for (i = optind; i < (unsigned)argc; i++) {
+			if (!read_trace(argv[i])) {
+				ok = false;
+				continue;
+			}
+			chars += strlen(text);
+			run(argv[i], verbose);
+		}
+	} else {
+		for (i = 0; i < OPS; i++) {
+			/* each gets its own sending, whatever order they are in */
+			srand(seed * 1000 + i);
+			make_trace(&ops[i]);
+			if (prefix) {
+				snprintf(name, sizeof(name), "%s-%u.txt", prefix, i);
+				write_trace(name, &ops[i]);
+			}
+			chars += strlen(text);
+			run(ops[i].name, verbose);
+		}
+	}
+	if (!chars)
+		return ok ? 0 : 1;
+	printf("  %-16s %6u", optind < argc ? "all" : "all synthetic", chars);
+	for (i = 0; i < DECODERS; i++)
+		printf(" %6u %6.1f %6s", decoders[i].errors,
+			100.0 * decoders[i].errors / chars, "");
+	printf("\n");
+	if (decoders[1].errors > decoders[0].errors ||
+			decoders[1].errors > HMM_CER_LIMIT * chars) {
+		printf("  FAIL: hmm over %.0f%% cer or behind the thresholds%s\n",
+			HMM_CER_LIMIT * 100, optind < argc ? "" :
+			" on the synthetic senders");
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
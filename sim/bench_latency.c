@@ -0,0 +1,282 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-latency: how long a character keyed on the paddles takes to
+ * come out of the keyboard
+ *
+ * usage: bench-latency [-v] [-b] [-w wpm]...
+ *   -v  print the times for every character
+ *   -b  queue up BACKLOG to be sent before the keying starts, which
+ *       should make no difference to the times
+ *   -w  speed to key at, may be given more than once (default 15, 25
+ *       and 40)
+ *
+ * A text is keyed on the simulated paddles by a near perfect operator:
+ * each paddle is held for the length of its element, and let go a unit
+ * (three at the end of a character, seven at the end of a word) before
+ * the next press.  Character gaps are stretched by a random part of
+ * USB_WORK_MS so the keying does not stay in step with usb_work.  The
+ * trace points in the firmware mark each decoded character on its way
+ * through, starting from the paddle release that ended it:
+ *
+ *   gap     the release until cw_in decides the character is over and
+ *           enqueues the space after it (didah_enqueue)
+ *   report  from there until a keyboard report carries it (hid_report,
+ *           called from CALLBACK_HID_Device_CreateHIDReport)
+ *
+ * Only these two are modelled, as they are made of waiting: code takes
+ * no time on the simulator, so the paddle isr, the decode and the hand
+ * off to hid_nq in between would always come out as 0.  The cycles they
+ * take on the avr are for isr-profile to measure.  The usb side is
+ * modelled by building a report every USB_WORK_MS, as usb_work does
+ * once connected; the time until the host polls for that report (up to
+ * the endpoint interval) is not included.  The exit status is 1 if
+ * what was keyed is not what was typed, leaving out the backlog, which
+ * is typed as it is sent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cw.h"
+#include "cw-kbd.h"
+#include "hid.h"
+#include "timer.h"
+#include "tick.h"
+#include "sim.h"
+
+#define TEXT "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 5NN TU 73"
+#define BACKLOG "CQ CQ CQ DE N7OH N7OH N7OH K"
+#define MAX_CHARS 128
+#define MAX_SPEEDS 8
+
+enum stage { ST_RELEASE, ST_GAP, ST_REPORT, STAGES };
+static const char *stage_name[STAGES] = { "release", "gap", "report" };
+
+/* when each character got to each stage */
+static struct {
+	uint64_t at[STAGES];
+	char c;
+} chars[MAX_CHARS];
+/* characters that have got as far as the gap */
+static unsigned n_gap;
+/* the one being decoded right now */
+static int decoding;
+/* whose each key in hid_q is, in hid_nq order, which is the order the
+ * reports go out in (-1 for the backlog, and the rest of a prosign) */
+#define MAX_KEYS 512
+static int keys[MAX_KEYS];
+static unsigned n_nq, n_key;
+
+static uint64_t last_release;
+
+static void trace_point(enum trace_event id, uint8_t a, uint8_t b) {
+	switch (id) {
+	case TR_DIDAH_NQ:
+		/* the paddles' elements are decoded as they go in */
+		decoding = -1;
+		if (a != SPACE || !b || n_gap == MAX_CHARS)
+			break;
+		decoding = n_gap;
+		chars[n_gap].at[ST_RELEASE] = last_release;
+		chars[n_gap].at[ST_GAP] = sim_now;
+		n_gap++;
+		break;
+	case TR_DIDAH_DQ:
+		/* and the backlog's as they come out */
+		decoding = -1;
+		break;
+	case TR_HID_NQ:
+		if (n_nq == MAX_KEYS)
+			break;
+		/* only the first key of anything a space decodes to */
+		keys[n_nq] = -1;
+		if (decoding >= 0 && !chars[decoding].c) {
+			chars[decoding].c = a;
+			keys[n_nq] = decoding;
+		}
+		n_nq++;
+		break;
+	case TR_HID_KEY:
+		if (n_key < n_nq && keys[n_key] >= 0)
+			chars[keys[n_key]].at[ST_REPORT] = sim_now;
+		n_key++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void usb_work(void) {
+	USB_KeyboardReport_Data_t report;
+	memset(&report, 0, sizeof(report));
+	hid_report(&report);
+}
+
+static void paddle(uint8_t right, bool down) {
+	if (!down)
+		last_release = sim_now;
+	sim_paddle(right, down);
+}
+
+/* key text on the paddles, unit_us to the unit */
+static void key_text(const char *text, uint32_t unit_us) {
+	uint8_t dit = cw_get_left_key() == DIT ? 0 : 1;
+	uint64_t t = sim_now + SIM_MS(100);
+	const char *m;
+
+	for (; *text; text++) {
+		if (*text == ' ') {
+			t += SIM_US(4 * unit_us);
+			continue;
+		}
+		for (m = sim_morse[(uint8_t)*text]; m && *m; m++) {
+			uint8_t len = *m == '.' ? 1 : 3;
+			uint8_t side = *m == '.' ? dit : !dit;
+			sim_run(t);
+			paddle(side, true);
+			t += SIM_US(len * unit_us);
+			sim_run(t);
+			paddle(side, false);
+			t += SIM_US(unit_us);
+		}
+		t += SIM_US(2 * unit_us) + SIM_US(rand() % (USB_WORK_MS * 1000));
+	}
+	sim_run(t);
+	while (cw_busy())
+		sim_run(sim_now + SIM_MS(10));
+	/* long enough for the keyboard to catch up */
+	sim_run(sim_now + SIM_MS(500));
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* nearest rank */
+static double percentile(const uint64_t *v, unsigned n, unsigned p) {
+	unsigned r = (n * p + 99) / 100;
+	return (double)v[r ? r - 1 : 0] / SIM_US(1) / 1000;
+}
+
+static void print_stats(const char *name, uint64_t *v, unsigned n) {
+	uint64_t sum = 0;
+	unsigned i;
+	qsort(v, n, sizeof(*v), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	printf("  %-7s %8.2f %8.2f %8.2f %8.2f\n", name,
+		(double)sum / n / SIM_US(1) / 1000,
+		percentile(v, n, 50), percentile(v, n, 99), percentile(v, n, 100));
+}
+
+static bool bench(uint8_t wpm, bool backlog, bool verbose) {
+	static uint64_t lat[STAGES + 1][MAX_CHARS];
+	char typed[MAX_CHARS + 1];
+	unsigned i, n = 0;
+	enum stage s;
+
+	sim_trace = trace_point;
+	sim_boot(false, hid_nq);
+	cw_set_speed(wpm, true);
+	cw_set_word_space(true, false);
+	ms_tick_register(usb_work, TICK_USB_WORK, USB_WORK_MS);
+	sim_sync();
+	if (backlog)
+		cw_string(BACKLOG);
+	key_text(TEXT, 1200000UL / wpm);
+
+	printf("%u wpm, %u ms unit%s:\n", wpm, 1200 / wpm,
+		backlog ? ", behind a backlog" : "");
+	if (verbose)
+		printf("  char %8s %8s\n", stage_name[ST_GAP],
+			stage_name[ST_REPORT]);
+	for (i = 0; i < n_gap; i++) {
+		if (!chars[i].at[ST_REPORT])
+			continue;
+		typed[n] = chars[i].c;
+		for (s = ST_GAP; s < STAGES; s++)
+			lat[s][n] = chars[i].at[s] - chars[i].at[s - 1];
+		lat[STAGES][n] = chars[i].at[ST_REPORT] -
+			chars[i].at[ST_RELEASE];
+		if (verbose) {
+			printf("  '%c' ", chars[i].c);
+			for (s = ST_GAP; s < STAGES; s++)
+				printf(" %8.2f", (double)lat[s][n] /
+					SIM_US(1) / 1000);
+			printf("\n");
+		}
+		n++;
+	}
+	typed[n] = 0;
+
+	printf("  %-7s %8s %8s %8s %8s   (ms)\n", "stage", "mean", "p50",
+		"p99", "max");
+	if (n) {
+		for (s = ST_GAP; s < STAGES; s++)
+			print_stats(stage_name[s], lat[s], n);
+		print_stats("total", lat[STAGES], n);
+	}
+	/* in lower case, with a word space at the end */
+	if (strncasecmp(typed, TEXT, strlen(TEXT)) ||
+			strcmp(typed + strlen(TEXT), " ")) {
+		printf("  typed \"%s\"\n  FAIL\n", typed);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	uint8_t speeds[MAX_SPEEDS] = { 15, 25, 40 };
+	unsigned i, n = 0;
+	bool verbose = false, backlog = false, ok = true;
+	int opt, status;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "vbw:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = true; break;
+		case 'b': backlog = true; break;
+		case 'w':
+			if (n < MAX_SPEEDS)
+				speeds[n++] = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-b] [-w wpm]...\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!n)
+		n = 3;
+
+	for (i = 0; i < n; i++) {
+		/* a fresh process for each run, as in bench-timing */
+		fflush(stdout);
+		if ((pid = fork()) == 0)
+			exit(bench(speeds[i], backlog, verbose) ? 0 : 1);
+		if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+				!WIFEXITED(status) || WEXITSTATUS(status))
+			ok = false;
+	}
+	return ok ? 0 : 1;
+}
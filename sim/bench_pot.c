@@ -0,0 +1,223 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-pot: the speed pot (pot.c) sharing the adc with rx.c
+ *
+ * usage: bench-pot [-v]
+ *   -v  print each speed the pot sets as it goes
+ *
+ * The pot is turned to the middle of a few speeds, and each has to be
+ * the speed set, within POT_SETTLE_MS of the turn, and with the one
+ * call to cw_set_speed.  Then it is left on the edge between two
+ * speeds with a few counts of noise on it for a while, where it must
+ * not set the speed more than once.  Last, it is turned while a row of
+ * dahs goes out, and every mark has to be a whole dah at the old speed
+ * or the new: a speed only takes over between elements.  None of it
+ * may change the speed saved in the settings.
+ *
+ * The receive input sits at half the supply, with noise, so the rx
+ * decoder runs on the same adc the whole time.  The exit status is 1
+ * if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cw.h"
+#include "rx.h"
+#include "pot.h"
+#include "settings.h"
+#include "sim.h"
+
+/* two readings of 16 of the slots after each rx block, and one more
+ * that the turn may have landed in the middle of */
+#define POT_SETTLE_MS 400
+#define DITHER_S 20
+#define MAX_MARKS 64
+
+static const uint8_t speeds[] = { 20, 35, 12, 50, 5, 28 };
+
+static uint16_t pot_level; /* 10 bit */
+static unsigned pot_noise; /* counts either side */
+
+static unsigned sets;
+static uint8_t set_wpm;
+static uint64_t set_at;
+static bool verbose;
+
+static uint64_t mark_on;
+static unsigned marks[MAX_MARKS];
+static unsigned n_marks;
+
+static uint16_t noisy(uint16_t v, unsigned n) {
+	int x = v + (n ? rand() % (2 * n + 1) - (int)n : 0);
+	return x < 0 ? 0 : x > 1023 ? 1023 : x;
+}
+
+static uint16_t adc_in(uint8_t mux) {
+	if (mux == POT_ADC_CHANNEL)
+		return noisy(pot_level, pot_noise);
+	return noisy(512, 2);
+}
+
+static double ms(uint64_t cycles) {
+	return (double)cycles / SIM_US(1) / 1000.0;
+}
+
+static void trace_point(enum trace_event id, uint8_t a, uint8_t b) {
+	if (id != TR_POT)
+		return;
+	sets++;
+	set_wpm = a;
+	set_at = sim_now;
+	if (verbose)
+		printf("%10.3f pot: %u wpm\n", ms(sim_now), a);
+}
+
+static void watch(enum sim_signal sig, uint16_t v) {
+	if (sig != SIM_KEY)
+		return;
+	if (v)
+		mark_on = sim_now;
+	else if (n_marks < MAX_MARKS)
+		marks[n_marks++] = (ms(sim_now - mark_on) + 0.5);
+}
+
+static void loop(void) {
+	rx_work();
+	pot_work();
+}
+
+static void hid(uint8_t c) {
+}
+
+/* where on the pot a speed starts, in 10 bit counts, as a fraction of
+ * the way into it */
+static uint16_t pot_for(uint8_t wpm, double frac) {
+	double r = (wpm - POT_WPM_MIN + frac) * (double)POT_OVERSAMPLE *
+		256 / (POT_WPM_MAX - POT_WPM_MIN + 1);
+	return r / POT_OVERSAMPLE * 4 + 0.5;
+}
+
+static bool turn_to(uint8_t wpm) {
+	uint64_t t;
+	unsigned before = sets;
+	bool ok;
+
+	pot_level = pot_for(wpm, 0.5);
+	t = sim_now;
+	sim_run(sim_now + SIM_MS(1000));
+	ok = sets == before + 1 && set_wpm == wpm &&
+		set_at - t <= SIM_MS(POT_SETTLE_MS);
+	printf("  turn to %2u wpm: %u set, %2u wpm after %5.1f ms%s\n",
+		wpm, sets - before, set_wpm, ms(set_at - t),
+		ok ? "" : "  FAIL");
+	return ok;
+}
+
+static bool dither(uint8_t wpm) {
+	unsigned before;
+	bool ok;
+
+	/* come at it from below, then sit on the edge */
+	pot_level = pot_for(wpm - 1, 0.5);
+	sim_run(sim_now + SIM_MS(1000));
+	pot_level = pot_for(wpm, 0);
+	pot_noise = 6;
+	before = sets;
+	sim_run(sim_now + SIM_MS(DITHER_S * 1000));
+	pot_noise = 0;
+	ok = sets - before <= 1;
+	printf("  %u..%u edge, +-%u counts for %us: %u set%s\n",
+		wpm - 1, wpm, 6, DITHER_S, sets - before,
+		ok ? "" : "  FAIL");
+	return ok;
+}
+
+static bool mid_element(uint8_t from, uint8_t to) {
+	unsigned i, old = 3 * 1200 / from, new = 3 * 1200 / to, n_old = 0;
+	bool ok = true;
+
+	pot_level = pot_for(from, 0.5);
+	sim_run(sim_now + SIM_MS(1000));
+	n_marks = 0;
+	cw_string("TTTTTTTTTT");
+	sim_sync();
+	sim_run(sim_now + SIM_MS(5 * 2 * old / 3 + old / 2));
+	pot_level = pot_for(to, 0.5);
+	while (cw_busy())
+		sim_run(sim_now + SIM_MS(10));
+	for (i = 0; i < n_marks; i++) {
+		if (marks[i] == old && n_old == i)
+			n_old++;
+		else if (marks[i] != new)
+			ok = false;
+	}
+	printf("  %u to %u wpm sending: %u dahs at %u ms then %u at %u ms%s\n",
+		from, to, n_old, old, n_marks - n_old, new,
+		ok && n_old && n_marks == 10 ? "" : "  FAIL");
+	if (!ok && verbose)
+		for (i = 0; i < n_marks; i++)
+			printf("    mark %u: %u ms\n", i, marks[i]);
+	return ok && n_old && n_marks == 10;
+}
+
+int main(int argc, char **argv) {
+	unsigned i, fails = 0;
+	uint8_t saved;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	sim_adc = adc_in;
+	sim_loop = loop;
+	sim_trace = trace_point;
+	sim_watch = watch;
+	sim_boot(true, hid);
+	saved = settings_get_wpm();
+	rx_init();
+	pot_init();
+	sim_sync();
+
+	printf("pot on ADC%u, %u to %u wpm, shared with rx\n",
+		POT_ADC_CHANNEL, POT_WPM_MIN, POT_WPM_MAX);
+	for (i = 0; i < sizeof(speeds); i++)
+		fails += !turn_to(speeds[i]);
+	fails += !dither(21);
+	fails += !dither(40);
+	fails += !mid_element(20, 30);
+	fails += !mid_element(30, 15);
+	if (settings_get_wpm() != saved) {
+		printf("  saved speed changed from %u to %u  FAIL\n",
+			saved, settings_get_wpm());
+		fails++;
+	}
+	printf("%u failed\n", fails);
+	return fails != 0;
+}
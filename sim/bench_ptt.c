@@ -0,0 +1,206 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-ptt: the ptt sequencer around the keyer output
+ *
+ * usage: bench-ptt [-v]
+ *   -v  print every run, not just the ones that fail
+ *
+ * A text from the keyboard, and a letter on the paddles, are sent at a
+ * few speeds with a few ptt lead and tail times, and the ptt and key
+ * outputs are checked:
+ *
+ *   - ptt goes on once and off once, around all of the keying
+ *   - the first mark starts exactly lead ms after ptt goes on
+ *   - it starts no later than it does with no lead, plus the lead
+ *   - the keying after that is the same as with no lead
+ *   - for the paddles, ptt is held at least the tail after the last
+ *     mark, unless the keyer has nothing more queued or keyed;
+ *     for the text, it goes off once the last character is done
+ *
+ * Each run sends the same thing with no lead or tail first to compare
+ * against.  The exit status is 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "cw.h"
+#include "sim.h"
+
+#define TEXT "TEST DE N7OH"
+#define MAX_EDGES 512
+
+static const uint8_t speeds[] = { 15, 25, 40 };
+static const uint8_t leads[] = { 0, 8, 50 };
+static const uint8_t tails[] = { 0, 15 }; /* 10ms */
+
+struct run {
+	uint64_t start;
+	uint64_t key[MAX_EDGES];
+	unsigned nkey;
+	uint64_t ptt_on, ptt_off;
+	unsigned ptt_edges;
+	bool busy_off;  /* the keyer still had something when ptt went off */
+};
+
+static struct run *cur;
+
+static void watch(enum sim_signal sig, uint16_t v) {
+	if (sig == SIM_KEY && cur->nkey < MAX_EDGES)
+		cur->key[cur->nkey++] = sim_now;
+	if (sig == SIM_PTT) {
+		cur->ptt_edges++;
+		if (v)
+			cur->ptt_on = sim_now;
+		else {
+			cur->ptt_off = sim_now;
+			cur->busy_off = cw_busy();
+		}
+	}
+}
+
+static void hid(uint8_t c) {
+}
+
+static double ms(uint64_t cycles) {
+	return (double)cycles / SIM_US(1) / 1000.0;
+}
+
+/* the text from the keyboard, or a dah on the paddles, from a fresh
+ * firmware */
+static void send_one(struct run *r, uint8_t wpm, uint8_t lead, uint8_t tail,
+		bool paddle) {
+	memset(r, 0, sizeof(*r));
+	cur = r;
+	sim_watch = watch;
+	sim_boot(false, hid);
+	cw_set_speed(wpm, true);
+	cw_set_ptt(lead, tail, false);
+	sim_run(sim_now + SIM_MS(100));
+	r->start = sim_now;
+	if (paddle) {
+		sim_paddle(1, true);
+		sim_run(sim_now + SIM_MS(3 * 1200 / wpm));
+		sim_paddle(1, false);
+	} else {
+		cw_string(TEXT);
+		sim_sync();
+	}
+	while (cw_busy() || r->ptt_edges & 1)
+		sim_run(sim_now + SIM_MS(1));
+	sim_run(sim_now + SIM_MS(100));
+}
+
+/* each send in a process of its own, so the firmware starts from its
+ * power on state every time; the edges come back in shared memory */
+static bool send(struct run *r, uint8_t wpm, uint8_t lead, uint8_t tail,
+		bool paddle) {
+	int status;
+	pid_t pid;
+	fflush(stdout);
+	if ((pid = fork()) == 0) {
+		send_one(r, wpm, lead, tail, paddle);
+		exit(0);
+	}
+	return pid > 0 && waitpid(pid, &status, 0) >= 0 &&
+		WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+static bool bench(uint8_t wpm, uint8_t lead, uint8_t tail, bool paddle,
+		bool verbose) {
+	static struct run *base, *r;
+	uint64_t last;
+	double first, hang;
+	const char *why = NULL;
+	unsigned i;
+
+	if (!base) {
+		base = mmap(NULL, 2 * sizeof(*base), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			perror("mmap");
+			exit(2);
+		}
+		r = base + 1;
+	}
+	if (!send(base, wpm, 0, 0, paddle) ||
+			!send(r, wpm, lead, tail, paddle)) {
+		printf("  %3u %5s %4u %4u0 FAIL: run crashed\n", wpm,
+			paddle ? "paddle" : "text", lead, tail);
+		return false;
+	}
+	last = r->nkey ? r->key[r->nkey - 1] : 0;
+	first = r->nkey ? ms(r->key[0] - r->start) : 0;
+	hang = ms(r->ptt_off - last);
+
+	if (!r->nkey || r->nkey != base->nkey)
+		why = "keyed differently";
+	else if (r->ptt_edges != 2)
+		why = "ptt did not go on and off once";
+	else if (r->key[0] - r->ptt_on != SIM_MS(lead))
+		why = "lead is off";
+	else if (r->key[0] - r->start > base->key[0] - base->start + SIM_MS(lead))
+		why = "later than the lead";
+	else if (r->ptt_off <= last)
+		why = "ptt off before the last mark";
+	else if (paddle && hang < tail * 10 && r->busy_off)
+		why = "tail cut short";
+	for (i = 1; !why && i < r->nkey; i++)
+		if (r->key[i] - r->key[i - 1] != base->key[i] - base->key[i - 1])
+			why = "element timing changed";
+	if (why || verbose)
+		printf("  %3u %5s %4u %4u0 %7.3f %7.3f %7.3f%s%s\n", wpm,
+			paddle ? "paddle" : "text", lead, tail,
+			ms(base->key[0] - base->start), first, hang,
+			why ? "  FAIL: " : "", why ? why : "");
+	return !why;
+}
+
+int main(int argc, char **argv) {
+	unsigned s, l, t, p, runs = 0, failed = 0;
+	bool verbose = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v': verbose = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (verbose)
+		printf("  %3s %5s %4s %5s %7s %7s %7s\n", "wpm", "from",
+			"lead", "tail", "no-lead", "first", "hang");
+	for (s = 0; s < sizeof(speeds); s++)
+	for (l = 0; l < sizeof(leads); l++)
+	for (t = 0; t < sizeof(tails); t++)
+	for (p = 0; p < 2; p++) {
+		runs++;
+		if (!bench(speeds[s], leads[l], tails[t], p, verbose))
+			failed++;
+	}
+	printf("%u runs, %u failed\n", runs, failed);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,485 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-rx: the receive decoder (rx.c) against audio
+ *
+ * usage: bench-rx [-v] [-s seed] [-o prefix] [file.wav]...
+ *   -v  print what was sent and what was decoded for every run
+ *   -s  seed for the noise (default 1)
+ *   -o  also write the made up audio out, as prefix-<wpm>-<snr>.wav
+ *
+ * With wav files (16 or 8 bit pcm, any rate, the first channel is
+ * used) each one is played into ADC0 and whatever comes out of the
+ * decoder is printed, with how much faster than real time that was.
+ *
+ * Without, a text is sent as 700Hz tones with 5ms edges, from 15 to 35
+ * wpm, and then at 20 wpm on tones across the filter bank, clean and in
+ * white noise at a few signal to noise ratios (in a 500Hz bandwidth),
+ * and the character error rate of what is decoded is worked out: the
+ * edit distance to the text over its length, with how many times the
+ * bank moved to another bin and how long after the first mark it got
+ * to one next to the tone (0 if it started there).  Then for each of
+ * the tones the weakest snr that still decodes under RX_CER_LIMIT, down
+ * from WEAK_FROM dB a dB at a time, is searched for: that is where any
+ * cost in sensitivity shows, in dB.
+ *
+ * Last, the filter steps the bank runs per block are printed against
+ * the one filter at the full sample rate it has to fit in the time of,
+ * and the cpu the decoder takes per second of audio on this host is
+ * measured, split into the ADC isr and the bank in rx_work, by feeding
+ * blocks straight to them.  The host times only compare one build with
+ * another; the cycles on the avr are in the rx scenario of isr-profile.
+ *
+ * The exit status is 1 if the cer is over RX_CER_LIMIT for any run at
+ * RX_SNR_OK dB or better, or the bank runs more filter steps a block
+ * than the one filter did.
+ *
+ * Each run boots a fresh firmware, with the keyer at its default 20
+ * wpm, and rx_init starting the adc.  The audio is sampled at sim_now
+ * for each conversion, so the adc sees it at its own rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <avr/io.h>
+#include "cw.h"
+#include "rx.h"
+#include "sim.h"
+
+/* called directly to time it */
+void ADC_vect(void);
+
+#define TEXT "CQ TEST DE N7OH N7OH K 5NN 001 TU THE QUICK BROWN FOX " \
+	"JUMPS OVER THE LAZY DOG 73"
+#define RATE 8000
+#define MAX_TYPED 1024
+
+#define RX_SNR_OK 10
+/* most of the errors that are left are the first character or two,
+ * while a sender well away from 20wpm is picked up */
+#define RX_CER_LIMIT 0.05
+/* where the search for the weakest snr that decodes starts */
+#define WEAK_FROM 12
+
+static const uint8_t speeds[] = { 15, 20, 25, 30, 35 };
+/* off tune by up to half a bin spacing, and at the ends of the bank */
+static const uint16_t tones[] = { 400, 505, 650, 790, 900 };
+/* dB in 500Hz; the first is no noise at all */
+static const int snrs[] = { 99, 20, 10, 6, 3 };
+
+static int16_t *audio;
+static size_t audio_len;
+static unsigned audio_rate;
+
+static char typed[MAX_TYPED + 1];
+static unsigned n_typed;
+
+static void hid(uint8_t c) {
+	if (n_typed < MAX_TYPED)
+		typed[n_typed++] = c;
+}
+
+/* how often the bank moved to another bin, and when it first got to
+ * one next to the tone (0 until it does, 1 if it started there) */
+static unsigned hops;
+static uint16_t tone_hz;
+static uint64_t locked;
+
+static bool near_tone(uint8_t bin) {
+	return abs((int)RX_BIN_HZ(bin) - tone_hz) <=
+		(RX_HIGH - RX_LOW) / (RX_BINS - 1);
+}
+
+static void trace_point(enum trace_event id, uint8_t a, uint8_t b) {
+	if (id != TR_RX_BIN)
+		return;
+	hops++;
+	if (!locked && near_tone(a))
+		locked = sim_now;
+}
+
+/* biased to half the supply, full scale is the whole adc range */
+static uint16_t adc_in(uint8_t mux) {
+	size_t i = sim_now * audio_rate / F_CPU;
+	if (mux != RX_ADC_CHANNEL || i >= audio_len)
+		return 512;
+	return (uint16_t)((audio[i] + 32768) >> 6);
+}
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* play audio into the decoder; returns wall seconds it took */
+static double decode(void) {
+	double t;
+	n_typed = hops = 0;
+	sim_adc = adc_in;
+	sim_loop = rx_work;
+	sim_trace = trace_point;
+	sim_boot(true, hid);
+	rx_init();
+	locked = near_tone(RX_BINS / 2) ? 1 : 0;
+	sim_sync();
+	t = now_s();
+	sim_run(SIM_US((uint64_t)audio_len * 1000000 / audio_rate) +
+		SIM_MS(1000));
+	t = now_s() - t;
+	typed[n_typed] = 0;
+	return t;
+}
+
+static uint16_t le16(const uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p) {
+	return le16(p) | (uint32_t)le16(p + 2) << 16;
+}
+
+static bool read_wav(const char *name) {
+	FILE *f = fopen(name, "rb");
+	uint8_t h[12], fmt[16] = { 0 };
+	uint32_t len;
+	uint16_t channels = 0, bits = 0;
+	uint8_t *data = NULL;
+	size_t i, step;
+
+	if (!f || fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) ||
+			memcmp(h + 8, "WAVE", 4))
+		goto bad;
+	while (fread(h, 1, 8, f) == 8) {
+		len = le32(h + 4);
+		if (!memcmp(h, "fmt ", 4) && len >= 16) {
+			if (fread(fmt, 1, 16, f) != 16)
+				goto bad;
+			fseek(f, len - 16 + (len & 1), SEEK_CUR);
+			channels = le16(fmt + 2);
+			audio_rate = le32(fmt + 4);
+			bits = le16(fmt + 14);
+		} else if (!memcmp(h, "data", 4)) {
+			data = malloc(len);
+			if (!data || fread(data, 1, len, f) != len)
+				goto bad;
+			break;
+		} else {
+			fseek(f, len + (len & 1), SEEK_CUR);
+		}
+	}
+	if (!data || le16(fmt) != 1 || !channels || !audio_rate ||
+			(bits != 8 && bits != 16))
+		goto bad;
+	step = channels * bits / 8;
+	audio_len = len / step;
+	audio = realloc(audio, audio_len * sizeof(*audio));
+	for (i = 0; i < audio_len; i++)
+		audio[i] = bits == 16 ? (int16_t)le16(data + i * step) :
+			(data[i * step] - 128) << 8;
+	free(data);
+	fclose(f);
+	return true;
+bad:
+	fprintf(stderr, "%s: not a pcm wav file\n", name);
+	free(data);
+	if (f)
+		fclose(f);
+	return false;
+}
+
+static void write_wav(const char *name) {
+	FILE *f = fopen(name, "wb");
+	uint32_t len = audio_len * 2;
+	uint8_t h[44];
+	if (!f) {
+		perror(name);
+		return;
+	}
+	memcpy(h, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x01\0", 24);
+	memcpy(h + 36, "data", 4);
+#define PUT32(P, V) do { (P)[0] = (V); (P)[1] = (V) >> 8; \
+	(P)[2] = (V) >> 16; (P)[3] = (V) >> 24; } while (0)
+	PUT32(h + 4, 36 + len);
+	PUT32(h + 24, audio_rate);
+	PUT32(h + 28, audio_rate * 2);
+	h[32] = 2; h[33] = 0;
+	h[34] = 16; h[35] = 0;
+	PUT32(h + 40, len);
+	fwrite(h, 1, sizeof(h), f);
+	/* the host is little endian */
+	fwrite(audio, 2, audio_len, f);
+	fclose(f);
+}
+
+/* gaussian noise, Box-Muller */
+static double gauss(void) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* TEXT at wpm with hz tones a quarter of full scale, plus noise */
+static void make_audio(uint8_t wpm, int snr, uint16_t hz) {
+	double unit = 1.2 / wpm, edge = 0.005, amp = 8192;
+	double sigma = amp / sqrt(2) / pow(10, snr / 20.0) *
+		sqrt(RATE / 2 / 500.0);
+	size_t n = 0, i, len, max;
+	const char *t, *m;
+	double x, env;
+
+	audio_rate = RATE;
+	tone_hz = hz;
+	/* half a second either side */
+	max = RATE * (1 + strlen(TEXT) * 22 * unit);
+	audio = realloc(audio, max * sizeof(*audio));
+	memset(audio, 0, max * sizeof(*audio));
+	n = RATE / 2;
+	for (t = TEXT; *t; t++) {
+		if (*t == ' ') {
+			n += 4 * unit * RATE;
+			continue;
+		}
+		for (m = sim_morse[(uint8_t)*t]; m && *m; m++) {
+			len = (*m == '.' ? 1 : 3) * unit * RATE;
+			for (i = 0; i < len; i++) {
+				env = 1;
+				if (i < edge * RATE)
+					env = (1 - cos(M_PI * i / (edge * RATE))) / 2;
+				else if (len - i < edge * RATE)
+					env = (1 - cos(M_PI * (len - i) /
+						(edge * RATE))) / 2;
+				audio[n + i] = amp * env *
+					sin(2 * M_PI * hz * (n + i) / RATE);
+			}
+			n += len + unit * RATE;
+		}
+		n += 2 * unit * RATE;
+	}
+	audio_len = n + RATE / 2;
+	for (i = 0; snr < 99 && i < audio_len; i++) {
+		x = audio[i] + sigma * gauss();
+		audio[i] = x > 32767 ? 32767 : x < -32768 ? -32768 : x;
+	}
+}
+
+/* upper case, one space between words and none at the ends */
+static void tidy(char *s) {
+	char *d = s, *p;
+	for (p = s; *p; p++) {
+		if (*p == ' ' && (d == s || d[-1] == ' '))
+			continue;
+		*d++ = toupper((unsigned char)*p);
+	}
+	if (d > s && d[-1] == ' ')
+		d--;
+	*d = 0;
+}
+
+/* from the first mark, which is half a second in */
+static const char *lock_ms(void) {
+	static char ms[16];
+	if (!locked)
+		return "never";
+	snprintf(ms, sizeof(ms), "%.0f", locked <= SIM_MS(500) ? 0.0 :
+		(double)(locked - SIM_MS(500)) / SIM_MS(1));
+	return ms;
+}
+
+static bool run_synth(uint8_t wpm, int snr, uint16_t hz,
+		const char *prefix, bool verbose) {
+	char name[256];
+	unsigned errors;
+	double wall, cer;
+
+	make_audio(wpm, snr, hz);
+	if (prefix) {
+		snprintf(name, sizeof(name), "%s-%u-%u-%d.wav", prefix, wpm,
+			hz, snr);
+		write_wav(name);
+	}
+	wall = decode();
+	tidy(typed);
+	errors = sim_edit_distance(TEXT, typed);
+	cer = (double)errors / strlen(TEXT);
+	printf("  %3u %5u %5s %6zu %6u %6.1f %5u %5s %7.0f\n", wpm, hz,
+		snr < 99 ? (snprintf(name, sizeof(name), "%d", snr), name) :
+		"-", strlen(TEXT), errors, cer * 100, hops, lock_ms(),
+		audio_len / (double)audio_rate / wall);
+	if (verbose)
+		printf("        \"%s\"\n", typed);
+	return snr < RX_SNR_OK || cer <= RX_CER_LIMIT;
+}
+
+static bool run_file(const char *name) {
+	double wall;
+	if (!read_wav(name))
+		return false;
+	wall = decode();
+	printf("%s: %.1f s in %.3f s (%.0fx real time)\n  %s\n", name,
+		audio_len / (double)audio_rate, wall,
+		audio_len / (double)audio_rate / wall, typed);
+	return true;
+}
+
+/* a fresh process for each run, as in bench-timing */
+static bool fork_run(bool (*run)(void *), void *arg) {
+	int status;
+	pid_t pid;
+	fflush(stdout);
+	if ((pid = fork()) == 0)
+		exit(run(arg) ? 0 : 1);
+	return pid > 0 && waitpid(pid, &status, 0) >= 0 &&
+		WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+static const char *prefix;
+static bool verbose;
+
+#define SNRS (sizeof(snrs) / sizeof(snrs[0]))
+#define SPEED_CASES (sizeof(speeds) * SNRS)
+#define CASES (SPEED_CASES + sizeof(tones) / sizeof(tones[0]) * SNRS)
+
+static bool synth_case(void *arg) {
+	unsigned i = (uintptr_t)arg;
+	if (i < SPEED_CASES)
+		return run_synth(speeds[i / SNRS], snrs[i % SNRS], 700,
+			prefix, verbose);
+	i -= SPEED_CASES;
+	return run_synth(20, snrs[i % SNRS], tones[i / SNRS], prefix,
+		verbose);
+}
+
+/* one tone at 20 wpm and one snr, packed as tone * 100 + snr */
+static bool weak_case(void *arg) {
+	unsigned i = (uintptr_t)arg;
+	make_audio(20, i % 100, tones[i / 100]);
+	decode();
+	tidy(typed);
+	return sim_edit_distance(TEXT, typed) <=
+		RX_CER_LIMIT * strlen(TEXT);
+}
+
+/* the weakest snr each tone still decodes at, with every stronger one
+ * down to it decoding too */
+static void sensitivity(unsigned seed) {
+	unsigned t;
+	int snr;
+
+	printf("  weakest snr under %.0f%% cer, 20 wpm:", RX_CER_LIMIT * 100);
+	for (t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+		for (snr = WEAK_FROM; snr >= 0; snr--) {
+			srand(seed * 1000 + 500 + t * 100 + snr);
+			if (!fork_run(weak_case,
+					(void *)(uintptr_t)(t * 100 + snr)))
+				break;
+		}
+		if (snr == WEAK_FROM)
+			printf(" %uHz over %d dB", tones[t], WEAK_FROM);
+		else
+			printf(" %uHz %d dB", tones[t], snr + 1);
+	}
+	printf("\n");
+}
+
+static double cpu_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ten seconds of noise, a block at a time */
+static bool cpu_case(void *arg) {
+	unsigned blocks = 10 * RX_RATE / RX_BLOCK, b, i;
+	double isr = 0, bank = 0, t;
+
+	sim_boot(true, hid);
+	rx_init();
+	for (b = 0; b < blocks; b++) {
+		t = cpu_s();
+		for (i = 0; i < RX_BLOCK; i++) {
+			ADCH = rand();
+			ADC_vect();
+		}
+		isr += cpu_s() - t;
+		t = cpu_s();
+		rx_work();
+		bank += cpu_s() - t;
+	}
+	printf("  filter steps a block: %u at most, against %u for one "
+		"filter\n", RX_STEPS, RX_BLOCK);
+	printf("  host cpu per second of audio: isr %.0f us, bank %.0f us\n",
+		isr * 1e6 / 10, bank * 1e6 / 10);
+	return true;
+}
+
+static bool file_case(void *arg) {
+	return run_file(arg);
+}
+
+int main(int argc, char **argv) {
+	unsigned seed = 1, i;
+	bool ok = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vs:o:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = true; break;
+		case 's': seed = atoi(optarg); break;
+		case 'o': prefix = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-s seed] [-o prefix] "
+				"[file.wav]...\n", argv[0]);
+			return 2;
+		}
+	}
+	srand(seed);
+
+	if (optind < argc) {
+		for (i = optind; i < (unsigned)argc; i++)
+			ok &= fork_run(file_case, argv[i]);
+		return ok ? 0 : 1;
+	}
+
+	printf("%u bins %u-%u Hz, %u samples a block; snr in dB in 500Hz\n",
+		RX_BINS, RX_LOW, RX_HIGH, RX_BLOCK);
+	printf("  %3s %5s %5s %6s %6s %6s %5s %5s %7s\n", "wpm", "hz",
+		"snr", "chars", "errors", "cer%", "hops", "lock", "x-rt");
+	for (i = 0; i < CASES; i++) {
+		/* each run gets its own noise, whatever order they are in */
+		srand(seed * 1000 + i);
+		ok &= fork_run(synth_case, (void *)(uintptr_t)i);
+	}
+	sensitivity(seed);
+	fork_run(cpu_case, NULL);
+	if (!ok)
+		printf("  FAIL: over %.0f%% cer at %d dB or better\n",
+			RX_CER_LIMIT * 100, RX_SNR_OK);
+	if (RX_STEPS > RX_BLOCK) {
+		printf("  FAIL: more filter steps a block than one filter\n");
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
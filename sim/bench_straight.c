@@ -0,0 +1,364 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-straight: the straight key passthrough
+ *
+ * usage: bench-straight [-v] [-s seed]
+ *   -v  print what was sent and what was decoded for every run
+ *   -s  seed for the made up sending (default 1)
+ *
+ * In straight key mode a text is sent on the left contact by a hand
+ * with a little (or a lot of) jitter in every mark and space, at a few
+ * speeds, and once with contact bounce on every press.  For each run:
+ *
+ *   - every key output and sidetone edge has to come at the same
+ *     instant as the contact edge that caused it: the ones that don't
+ *     are counted as late
+ *   - every mark on the output has to be exactly as long as the press,
+ *     to the cycle (not with bounce, which goes straight through)
+ *   - the character error rate of what the decoder typed, the edit
+ *     distance to the text over its length, has to be under
+ *     STRAIGHT_CER_LIMIT
+ *
+ * Then, with text going out on the second radio, the key is pressed for
+ * the first one part way through a mark: the second radio's key has to
+ * be down whenever the first one's is up, and stay down.
+ *
+ * Last, with a PTT lead of PTT_LEAD ms, the text is sent once more at
+ * 20 wpm and a tail short enough to let PTT go between characters: the
+ * key output must never go on unless PTT has been on for the lead, a
+ * press with PTT off has to be keyed the lead (and at most a tick) into
+ * it, and every other edge has to come at the contact's.
+ *
+ * Code takes no time on the simulator, so this only shows the keying
+ * path defers nothing to a later tick; it is no measure of latency.
+ * How many cycles the pin takes after the contact on the avr is
+ * the straight scenario of isr-profile.  Each run boots a fresh
+ * firmware.
+ * The exit status is 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "cw.h"
+#include "sim.h"
+
+#define TEXT "CQ TEST DE N7OH K 5NN TU THE QUICK BROWN FOX 73"
+#define MAX_TYPED 128
+#define MAX_EDGES 1024
+#define STRAIGHT_CER_LIMIT 0.05
+#define PTT_LEAD 20
+
+static const uint8_t speeds[] = { 12, 20, 30 };
+static const double jitters[] = { 0, 0.05, 0.1 };
+
+struct run {
+	char typed[MAX_TYPED + 1];
+	unsigned n_typed;
+	uint64_t press[MAX_EDGES], out[MAX_EDGES];
+	bool led[MAX_EDGES];  /* a press that found ptt off */
+	unsigned n_press, n_out;
+	uint64_t last_edge;   /* the last contact edge */
+	unsigned late;        /* output edges that came after it */
+	unsigned n_tone;      /* sidetone edges */
+	bool key[CW_RADIOS];  /* the keyer outputs, for the so2r run */
+	uint64_t key_edge;    /* when the last of them changed */
+	uint64_t both;        /* how long both of them were keyed */
+	bool ptt;             /* the ptt output, for the lead run */
+	uint64_t ptt_edge;    /* when it went on */
+	unsigned hot;         /* key edges up with ptt off or too new */
+};
+
+static struct run *cur;
+
+static void hid(uint8_t c) {
+	if (cur->n_typed < MAX_TYPED)
+		cur->typed[cur->n_typed++] = c;
+}
+
+static void watch(enum sim_signal sig, uint16_t v) {
+	if (sig == SIM_PTT) {
+		cur->ptt = v;
+		cur->ptt_edge = sim_now;
+	}
+	if (sig == SIM_KEY && v && (!cur->ptt ||
+			sim_now - cur->ptt_edge < SIM_MS(PTT_LEAD)))
+		cur->hot++;
+	if (sig == SIM_KEY || sig == SIM_KEY2) {
+		/* both pins change in the same isr show up one after
+		 * the other, at the same time */
+		if (cur->key[0] && cur->key[1])
+			cur->both += sim_now - cur->key_edge;
+		cur->key[sig == SIM_KEY2] = v;
+		cur->key_edge = sim_now;
+	}
+	if (sig != SIM_KEY && sig != SIM_TONE)
+		return;
+	if (sim_now != cur->last_edge)
+		cur->late++;
+	if (sig == SIM_TONE)
+		cur->n_tone++;
+	else if (cur->n_out < MAX_EDGES)
+		cur->out[cur->n_out++] = sim_now;
+}
+
+/* gaussian noise, Box-Muller */
+static double gauss(void) {
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static uint64_t vary(double jitter, double ms) {
+	double x = ms * (1 + jitter * gauss());
+	return SIM_US((x < 2 ? 2 : x) * 1000);
+}
+
+static void contact(bool down) {
+	cur->last_edge = sim_now;
+	if (cur->n_press < MAX_EDGES) {
+		cur->led[cur->n_press] = down && !cur->ptt;
+		cur->press[cur->n_press++] = sim_now;
+	}
+	sim_paddle(0, down);
+}
+
+/* a press with the contacts chattering for the first ms or so */
+static void bounce(void) {
+	unsigned i;
+	for (i = 0; i < 3; i++) {
+		contact(true);
+		sim_run(sim_now + SIM_US(100 + rand() % 200));
+		contact(false);
+		sim_run(sim_now + SIM_US(50 + rand() % 200));
+	}
+}
+
+static void send_one(struct run *r, uint8_t wpm, double jitter,
+		bool bouncy, uint8_t lead) {
+	double u = 1200.0 / wpm;
+	const char *t, *m;
+
+	memset(r, 0, sizeof(*r));
+	cur = r;
+	sim_watch = watch;
+	sim_boot(false, hid);
+	cw_set_keying_mode(keying_mode_straight);
+	cw_set_speed(wpm, true);
+	cw_set_ptt(lead, 5, false);
+	cw_enable_outputs(CW_ENABLE_PTT);
+	sim_run(sim_now + SIM_MS(1500));
+	/* just what the key says from here on */
+	r->n_typed = r->n_out = r->n_tone = 0;
+	r->late = r->hot = 0;
+	r->last_edge = sim_now;
+	for (t = TEXT; *t; t++) {
+		if (*t == ' ') {
+			sim_run(sim_now + vary(jitter, 4 * u));
+			continue;
+		}
+		for (m = sim_morse[(uint8_t)*t]; m && *m; m++) {
+			if (bouncy)
+				bounce();
+			contact(true);
+			sim_run(sim_now + vary(jitter, *m == '.' ? u : 3 * u));
+			contact(false);
+			sim_run(sim_now + vary(jitter, m[1] ? u : 3 * u));
+		}
+	}
+	sim_run(sim_now + SIM_MS(20 * u));
+	r->typed[r->n_typed] = 0;
+}
+
+/* radio 2 is sending text when the key is pressed for radio 1 */
+static void so2r_one(struct run *r) {
+	memset(r, 0, sizeof(*r));
+	cur = r;
+	sim_watch = watch;
+	sim_boot(false, hid);
+	cw_set_keying_mode(keying_mode_straight);
+	cw_set_speed(20, true);
+	cw_set_radio(1);
+	cw_string("TTTT");
+	sim_sync();
+	sim_run(sim_now + SIM_MS(50));
+	cw_set_radio(0);
+	contact(true);
+	sim_run(sim_now + SIM_MS(100));
+	contact(false);
+	sim_run(sim_now + SIM_MS(100));
+	while (cw_busy())
+		sim_run(sim_now + SIM_MS(10));
+}
+
+static bool so2r_bench(struct run *r) {
+	int status;
+	pid_t pid;
+	bool ok;
+
+	fflush(stdout);
+	if ((pid = fork()) == 0) {
+		so2r_one(r);
+		exit(0);
+	}
+	ok = pid > 0 && waitpid(pid, &status, 0) >= 0 &&
+		WIFEXITED(status) && !WEXITSTATUS(status);
+	ok = ok && !r->both && !r->key[0] && !r->key[1];
+	printf("so2r: both keyed for %.1f us, %s%s\n",
+		(double)r->both / SIM_US(1),
+		r->key[0] || r->key[1] ? "left keyed" : "both up at the end",
+		ok ? "" : "  FAIL");
+	return ok;
+}
+
+/* the text once more with ptt switched over ahead of the key */
+static bool ptt_bench(struct run *r) {
+	unsigned i, wrong = 0, n_led = 0;
+	uint64_t d, most = 0;
+	int status;
+	pid_t pid;
+	bool ok;
+
+	fflush(stdout);
+	if ((pid = fork()) == 0) {
+		send_one(r, 20, 0, false, PTT_LEAD);
+		exit(0);
+	}
+	ok = pid > 0 && waitpid(pid, &status, 0) >= 0 &&
+		WIFEXITED(status) && !WEXITSTATUS(status) &&
+		r->n_out == r->n_press;
+	if (!ok) {
+		printf("ptt: %u output edges for %u contact edges  FAIL\n",
+			r->n_out, r->n_press);
+		return false;
+	}
+	for (i = 0; i < r->n_out; i++) {
+		d = r->out[i] - r->press[i];
+		if (!r->led[i]) {
+			wrong += d != 0;
+			continue;
+		}
+		n_led++;
+		if (d > most)
+			most = d;
+		wrong += d < SIM_MS(PTT_LEAD) || d > SIM_MS(PTT_LEAD + 1);
+	}
+	ok = n_led && !r->hot && !wrong;
+	printf("ptt: lead %u ms, %u presses led by up to %.2f ms, "
+		"%u hot, %u wrong%s\n", PTT_LEAD, n_led,
+		(double)most / SIM_MS(1), r->hot, wrong, ok ? "" : "  FAIL");
+	return ok;
+}
+
+/* each run in a process of its own, so the firmware starts from its
+ * power on state every time; the results come back in shared memory */
+static bool bench(struct run *r, uint8_t wpm, double jitter, bool bouncy,
+		bool verbose) {
+	char want[sizeof(TEXT)], *p;
+	unsigned errors, i, wrong = 0;
+	double cer;
+	bool ok;
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	if ((pid = fork()) == 0) {
+		send_one(r, wpm, jitter, bouncy, 0);
+		exit(0);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+			!WIFEXITED(status) || WEXITSTATUS(status)) {
+		printf("%4u %6.0f%% %-6s run failed\n", wpm, jitter * 100,
+			bouncy ? "bounce" : "");
+		return false;
+	}
+	/* the keyboard types lower case, and the last space is still to
+	 * come when the run ends */
+	strcpy(want, TEXT);
+	for (p = want; *p; p++)
+		*p = tolower(*p);
+	while (r->n_typed && r->typed[r->n_typed - 1] == ' ')
+		r->typed[--r->n_typed] = 0;
+	errors = sim_edit_distance(want, r->typed);
+	cer = (double)errors / strlen(want);
+	/* with no bounce, the output is the contact, edge for edge */
+	if (!bouncy) {
+		if (r->n_out != r->n_press)
+			wrong = r->n_press;
+		for (i = 0; i < r->n_out && i < r->n_press; i++)
+			wrong += r->out[i] != r->press[i];
+	}
+	ok = cer <= STRAIGHT_CER_LIMIT && !r->late && !wrong &&
+		r->n_tone == r->n_out;
+	printf("%4u %6.0f%% %-6s %5u %5u %6u %6u %6.1f%s\n", wpm,
+		jitter * 100, bouncy ? "bounce" : "", r->n_out, r->late,
+		wrong, errors, cer * 100,
+		ok ? "" : "  FAIL");
+	if (verbose || !ok)
+		printf("    sent:  %s\n    typed: %s\n", want, r->typed);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	struct run *r;
+	unsigned i, j, fails = 0, seed = 1;
+	bool verbose = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vs:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-s seed]\n", argv[0]);
+			return 2;
+		}
+	}
+	r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (r == MAP_FAILED) {
+		perror("mmap");
+		return 2;
+	}
+
+	printf(" wpm jitter        edges  late  wrong errors   cer%%\n");
+	for (i = 0; i < sizeof(speeds); i++) {
+		for (j = 0; j < sizeof(jitters) / sizeof(jitters[0]); j++) {
+			srand(seed * 100 + i * 10 + j);
+			fails += !bench(r, speeds[i], jitters[j], false,
+				verbose);
+		}
+		srand(seed * 100 + i * 10 + 9);
+		fails += !bench(r, speeds[i], 0.1, true, verbose);
+	}
+	fails += !so2r_bench(r);
+	fails += !ptt_bench(r);
+	printf("%u failed\n", fails);
+	return fails != 0;
+}
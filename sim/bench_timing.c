@@ -0,0 +1,219 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* bench-timing: keying accuracy of the cw sender across its speed range
+ *
+ * usage: bench-timing [-v] [-l limit%] [-w wpm] [-g weight] [-c comp]
+ *   -v  print every speed, not just the ones over the limit
+ *   -l  largest error allowed, in percent (default 1)
+ *   -w  only this speed
+ *   -g  mark weight, 50 (the default) for even
+ *   -c  keying compensation in 0.1ms
+ *
+ * Each text is sent at every speed from 3 to 99 wpm on the simulator,
+ * and the keyer output is split into elements and gaps.  Their mean
+ * lengths are compared against the ideal 1:3 (dit:dah) and 1:3:7
+ * (element, character and word gaps) in units of 1200/wpm ms, and the
+ * time from the first key down to the last key up gives the effective
+ * speed.  The exit status is 1 if the speed or any of the mean lengths
+ * is off by more than the limit, or if what was keyed does not match
+ * the text.  Each element is a whole number of ticks, so when the unit
+ * is not, a mean within a tick of ideal is as good as it gets and always
+ * passes.
+ *
+ * With a weight or compensation, every mark should be longer by
+ * (weight - 50) / 50 units plus comp / 10 ms, and the gap after it
+ * shorter by as much, which leaves the effective speed where it was.
+ * That is keyed in whole ticks as well, so means within two ticks pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cw.h"
+#include "sim.h"
+
+#define MAX_EDGES 4096
+/* ms; see above */
+#define TICK_MS 1.0
+
+static const struct {
+	const char *name;
+	const char *text;
+} texts[] = {
+	{ "paris", "PARIS PARIS PARIS" },
+	{ "codex", "CODEX CODEX CODEX" },
+	{ "contest", "TU 5NN 05 OR" },
+};
+
+/* what gets measured, and its length in units */
+enum element { DIT_ON, DAH_ON, ELEMENT_GAP, CHAR_GAP, WORD_GAP, ELEMENTS };
+static const char *element_name[ELEMENTS] = {
+	"dit", "dah", "gap", "char", "word",
+};
+static const uint8_t element_units[ELEMENTS] = { 1, 3, 1, 3, 7 };
+static uint8_t weight = 50;
+static int comp;
+
+static uint64_t edges[MAX_EDGES];
+static unsigned nedges;
+
+static void watch(enum sim_signal sig, uint16_t v) {
+	/* edges alternate, starting with a key down */
+	if (sig == SIM_KEY && nedges < MAX_EDGES && (nedges & 1) == !v)
+		edges[nedges++] = sim_now;
+}
+
+static void hid(uint8_t c) {
+}
+
+/* the elements the text should key as, without the trailing gap */
+static unsigned expect(const char *text, enum element *out, unsigned max) {
+	unsigned n = 0;
+	const char *m;
+	for (; *text && n < max; text++) {
+		if (*text == ' ') {
+			out[n - 1] = WORD_GAP;
+			continue;
+		}
+		for (m = sim_morse[(uint8_t)*text]; *m && n + 1 < max; m++) {
+			out[n++] = *m == '.' ? DIT_ON : DAH_ON;
+			out[n++] = ELEMENT_GAP;
+		}
+		out[n - 1] = CHAR_GAP;
+	}
+	return n ? n - 1 : 0;
+}
+
+/* send text at wpm and check it; prints a line if it is off by more
+ * than limit (or always if verbose), and returns false if it was */
+static bool bench(const char *name, const char *text, uint8_t wpm,
+		double limit, bool verbose) {
+	static enum element want[MAX_EDGES];
+	double sum[ELEMENTS] = { 0 }, ratio[ELEMENTS], unit, span;
+	double len[ELEMENTS], ext, slack;
+	unsigned count[ELEMENTS] = { 0 }, ideal = 0, n, i;
+	double err, worst = 0, eff;
+	bool ok = true;
+
+	nedges = 0;
+	sim_watch = watch;
+	sim_boot(false, hid);
+	cw_set_speed(wpm, true);
+	cw_set_weighting(weight, comp);
+	cw_string(text);
+	sim_sync();
+	while (cw_busy())
+		sim_run(sim_now + SIM_MS(10));
+
+	n = expect(text, want, MAX_EDGES);
+	if (nedges != n + 1) {
+		printf("%-8s %2u wpm: keyed %u edges, expected %u\n",
+			name, wpm, nedges, n + 1);
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		sum[want[i]] += (double)(edges[i + 1] - edges[i]) / SIM_US(1);
+		count[want[i]]++;
+		ideal += element_units[want[i]];
+	}
+
+	unit = 1200000.0 / wpm;
+	/* in units; marks gain it and the gaps after them lose it, but
+	 * neither is left with less than a tick */
+	ext = (weight - 50) / 50.0 + comp * 100.0 / unit;
+	ext = fmin(ext, (floor(unit / 1000) - TICK_MS) * 1000 / unit);
+	ext = fmax(ext, -(floor(unit / 1000) - TICK_MS) * 1000 / unit);
+	for (i = 0; i < ELEMENTS; i++)
+		len[i] = element_units[i] + (i <= DAH_ON ? ext : -ext);
+	/* the last mark has no gap after it to even it out */
+	span = (double)(edges[n] - edges[0]) / SIM_US(1);
+	eff = wpm * (ideal + ext) * unit / span;
+	/* the weighting is only keyed in whole ticks too */
+	slack = ext ? 2 * TICK_MS : TICK_MS;
+	worst = fabs(eff / wpm - 1);
+	for (i = 0; i < ELEMENTS; i++) {
+		if (!count[i])
+			continue;
+		ratio[i] = sum[i] / count[i] / unit;
+		err = fabs(ratio[i] / len[i] - 1);
+		if (err > worst && fabs(ratio[i] - len[i]) *
+				unit / 1000 > slack)
+			worst = err;
+	}
+	ok = worst * 100 <= limit;
+	if (!ok || verbose) {
+		printf("%-8s %2u wpm: %7.2f ms", name, wpm, unit / 1000);
+		for (i = 0; i < ELEMENTS; i++)
+			if (count[i])
+				printf(" %s %5.3f", element_name[i], ratio[i]);
+		printf("  %6.2f wpm (%+.2f%%)%s\n", eff,
+			(eff / wpm - 1) * 100, ok ? "" : "  FAIL");
+	}
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	double limit = 1.0;
+	bool verbose = false, ok = true;
+	uint8_t wpm, lo = 3, hi = 99;
+	unsigned t, runs = 0, failed = 0;
+	int opt, status;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "vl:w:g:c:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = true; break;
+		case 'l': limit = atof(optarg); break;
+		case 'w': lo = hi = atoi(optarg); break;
+		case 'g': weight = atoi(optarg); break;
+		case 'c': comp = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-v] [-l limit%%] [-w wpm] "
+				"[-g weight] [-c comp]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (verbose)
+		printf("lengths are in units, ideal: dit 1, dah 3, gap 1, "
+			"char 3, word 7 (give or take the weighting)\n");
+	for (t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+		for (wpm = lo; wpm <= hi; wpm++) {
+			/* a fresh process for each run, so the firmware
+			 * starts from its power on state every time */
+			fflush(stdout);
+			if ((pid = fork()) == 0)
+				exit(bench(texts[t].name, texts[t].text, wpm,
+					limit, verbose) ? 0 : 1);
+			if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+					!WIFEXITED(status) ||
+					WEXITSTATUS(status)) {
+				ok = false;
+				failed++;
+			}
+			runs++;
+		}
+	}
+	printf("%u of %u runs within %.2f%%\n", runs - failed, runs, limit);
+	return ok ? 0 : 1;
+}
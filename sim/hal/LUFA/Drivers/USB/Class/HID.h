@@ -0,0 +1,54 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* just enough of LUFA for cw-kbd.h and descriptors.h to parse */
+#ifndef _SIM_LUFA_HID_H_
+#define _SIM_LUFA_HID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	struct {
+		uint8_t InterfaceNumber;
+		uint8_t ReportINEndpointNumber;
+		uint16_t ReportINEndpointSize;
+		bool ReportINEndpointDoubleBank;
+		void *PrevReportINBuffer;
+		uint8_t PrevReportINBufferSize;
+	} Config;
+} USB_ClassInfo_HID_Device_t;
+
+typedef struct {
+	uint8_t Modifier;
+	uint8_t Reserved;
+	uint8_t KeyCode[6];
+} USB_KeyboardReport_Data_t;
+
+#define HID_KEYBOARD_MODIFER_LEFTSHIFT (1 << 1)
+#define HID_KEYBOARD_LED_NUMLOCK       (1 << 0)
+#define HID_KEYBOARD_LED_CAPSLOCK      (1 << 1)
+#define HID_KEYBOARD_LED_SCROLLLOCK    (1 << 2)
+
+void HID_Device_MillisecondElapsed(USB_ClassInfo_HID_Device_t *iface);
+void HID_Device_USBTask(USB_ClassInfo_HID_Device_t *iface);
+bool HID_Device_ConfigureEndpoints(USB_ClassInfo_HID_Device_t *iface);
+void HID_Device_ProcessControlRequest(USB_ClassInfo_HID_Device_t *iface);
+
+#endif /* _SIM_LUFA_HID_H_ */
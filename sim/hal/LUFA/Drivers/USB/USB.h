@@ -0,0 +1,43 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* just enough of LUFA for cw-kbd.h and descriptors.h to parse */
+#ifndef _SIM_LUFA_USB_H_
+#define _SIM_LUFA_USB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATTR_WARN_UNUSED_RESULT
+#define ATTR_NON_NULL_PTR_ARG(...)
+
+typedef struct { uint8_t d; } USB_Descriptor_Configuration_Header_t;
+typedef struct { uint8_t d; } USB_Descriptor_Interface_t;
+typedef struct { uint8_t d; } USB_Descriptor_Interface_Association_t;
+typedef struct { uint8_t d; } USB_Descriptor_Endpoint_t;
+typedef struct { uint8_t d; } USB_HID_Descriptor_t;
+typedef uint8_t USB_Descriptor_HIDReport_Datatype_t;
+#define CDC_FUNCTIONAL_DESCRIPTOR(N) struct { uint8_t d[N]; }
+
+extern bool USB_IsInitialized;
+void USB_Init(void);
+void USB_USBTask(void);
+void USB_ShutDown(void);
+
+#endif /* _SIM_LUFA_USB_H_ */
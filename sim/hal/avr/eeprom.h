@@ -0,0 +1,51 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* host stand-in for <avr/eeprom.h>: EEMEM objects live in their own
+ * section, which is the simulated EEPROM.  EE_ADDR turns a pointer into
+ * one of them back into the 16 bit address the hardware would use.
+ */
+#ifndef _SIM_AVR_EEPROM_H_
+#define _SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <avr/io.h>
+
+#define EEMEM __attribute__((section("sim_eeprom"), aligned(1)))
+
+extern uint8_t __start_sim_eeprom[];
+extern uint8_t __stop_sim_eeprom[];
+
+#define EE_ADDR(P) ((uint16_t)((const uint8_t *)(P) - __start_sim_eeprom))
+
+#define eeprom_is_ready() (!(EECR & _BV(EEPE)))
+/* the simulator lets the time pass, rather than be polled */
+void sim_ee_wait(void);
+#define eeprom_busy_wait() sim_ee_wait()
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+uint16_t eeprom_read_word(const uint16_t *p);
+uint32_t eeprom_read_dword(const uint32_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_byte(uint8_t *p, uint8_t v);
+void eeprom_update_dword(uint32_t *p, uint32_t v);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif /* _SIM_AVR_EEPROM_H_ */
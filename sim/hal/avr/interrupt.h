@@ -0,0 +1,54 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* host stand-in for <avr/interrupt.h>: an ISR is a plain function that
+ * the simulator calls with the I bit cleared, just like the hardware.
+ */
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define sei() do { SREG |= 0x80; } while (0)
+#define cli() do { SREG &= ~0x80; } while (0)
+
+#define ISR(V) void V(void); void V(void)
+
+#define INT0_vect          sim_vect_int0
+#define INT1_vect          sim_vect_int1
+#define INT6_vect          sim_vect_int6
+#define TIMER0_OVF_vect    sim_vect_timer0_ovf
+#define TIMER0_COMPA_vect  sim_vect_timer0_compa
+#define TIMER0_COMPB_vect  sim_vect_timer0_compb
+#define TIMER1_CAPT_vect   sim_vect_timer1_capt
+#define TIMER1_COMPA_vect  sim_vect_timer1_compa
+#define TIMER1_COMPB_vect  sim_vect_timer1_compb
+#define TIMER1_OVF_vect    sim_vect_timer1_ovf
+#define TIMER3_CAPT_vect   sim_vect_timer3_capt
+#define TIMER3_COMPA_vect  sim_vect_timer3_compa
+#define TIMER3_COMPB_vect  sim_vect_timer3_compb
+#define TIMER3_COMPC_vect  sim_vect_timer3_compc
+#define TIMER3_OVF_vect    sim_vect_timer3_ovf
+#define EE_READY_vect      sim_vect_ee_ready
+#define ADC_vect           sim_vect_adc
+#define USART1_RX_vect     sim_vect_usart1_rx
+#define USART1_UDRE_vect   sim_vect_usart1_udre
+#define USART1_TX_vect     sim_vect_usart1_tx
+
+#endif /* _SIM_AVR_INTERRUPT_H_ */
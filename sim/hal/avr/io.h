@@ -0,0 +1,216 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* host stand-in for <avr/io.h>: the atmega32u4 data space is a plain
+ * array and the registers we touch are named slots in it, at their real
+ * addresses.  A couple of registers with side effects (the EEPROM control
+ * and data registers) go through the simulator so it can see them.
+ */
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#ifndef _BV
+#define _BV(B) (1 << (B))
+#endif
+
+extern volatile uint8_t sim_io[0x100];
+volatile uint8_t *sim_eecr(void);
+volatile uint8_t *sim_eedr(void);
+
+#define _SFR8(A)  (sim_io[(A)])
+#define _SFR16(A) (*(volatile uint16_t *)&sim_io[(A)])
+
+#define PINB   _SFR8(0x23)
+#define DDRB   _SFR8(0x24)
+#define PORTB  _SFR8(0x25)
+#define PINC   _SFR8(0x26)
+#define DDRC   _SFR8(0x27)
+#define PORTC  _SFR8(0x28)
+#define PIND   _SFR8(0x29)
+#define DDRD   _SFR8(0x2A)
+#define PORTD  _SFR8(0x2B)
+#define PINE   _SFR8(0x2C)
+#define DDRE   _SFR8(0x2D)
+#define PORTE  _SFR8(0x2E)
+#define PINF   _SFR8(0x2F)
+#define DDRF   _SFR8(0x30)
+#define PORTF  _SFR8(0x31)
+#define TIFR0  _SFR8(0x35)
+#define TIFR1  _SFR8(0x36)
+#define TIFR3  _SFR8(0x38)
+#define EIFR   _SFR8(0x3C)
+#define EIMSK  _SFR8(0x3D)
+#define EECR   (*sim_eecr())
+#define EEDR   (*sim_eedr())
+#define EEAR   _SFR16(0x41)
+#define TCCR0A _SFR8(0x44)
+#define TCCR0B _SFR8(0x45)
+#define TCNT0  _SFR8(0x46)
+#define OCR0A  _SFR8(0x47)
+#define OCR0B  _SFR8(0x48)
+#define MCUSR  _SFR8(0x54)
+#define MCUCR  _SFR8(0x55)
+#define SP     _SFR16(0x5D)
+#define SREG   _SFR8(0x5F)
+#define WDTCSR _SFR8(0x60)
+#define CLKPR  _SFR8(0x61)
+#define EICRA  _SFR8(0x69)
+#define EICRB  _SFR8(0x6A)
+#define TIMSK0 _SFR8(0x6E)
+#define TIMSK1 _SFR8(0x6F)
+#define TIMSK3 _SFR8(0x71)
+#define ADC    _SFR16(0x78)
+#define ADCL   _SFR8(0x78)
+#define ADCH   _SFR8(0x79)
+#define ADCSRA _SFR8(0x7A)
+#define ADCSRB _SFR8(0x7B)
+#define ADMUX  _SFR8(0x7C)
+#define DIDR0  _SFR8(0x7E)
+#define TCCR1A _SFR8(0x80)
+#define TCCR1B _SFR8(0x81)
+#define TCCR1C _SFR8(0x82)
+#define TCNT1  _SFR16(0x84)
+#define ICR1   _SFR16(0x86)
+#define OCR1A  _SFR16(0x88)
+#define OCR1B  _SFR16(0x8A)
+#define OCR1C  _SFR16(0x8C)
+#define TCCR3A _SFR8(0x90)
+#define TCCR3B _SFR8(0x91)
+#define TCCR3C _SFR8(0x92)
+#define TCNT3  _SFR16(0x94)
+#define ICR3   _SFR16(0x96)
+#define OCR3A  _SFR16(0x98)
+#define OCR3B  _SFR16(0x9A)
+#define OCR3C  _SFR16(0x9C)
+#define UCSR1A _SFR8(0xC8)
+#define UCSR1B _SFR8(0xC9)
+#define UCSR1C _SFR8(0xCA)
+#define UBRR1L _SFR8(0xCC)
+#define UBRR1H _SFR8(0xCD)
+#define UDR1   _SFR8(0xCE)
+
+/* port bits */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define DDD0 0
+#define DDD1 1
+#define PE2 2
+#define PE6 6
+#define PF0 0
+#define PF1 1
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+
+/* external interrupts */
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define ISC60 4
+#define ISC61 5
+#define INT0 0
+#define INT1 1
+#define INT6 6
+#define INTF0 0
+#define INTF1 1
+#define INTF6 6
+
+/* eeprom */
+#define EERE  0
+#define EEPE  1
+#define EEMPE 2
+#define EERIE 3
+#define E2END 0x3FF
+
+/* mcu control */
+#define IVCE  0
+#define IVSEL 1
+#define JTD   7
+#define WDRF  3
+
+/* timers */
+#define OCIE0A 1
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE3A 1
+#define OCF0A  1
+#define OCF3A  1
+#define OCF1A  1
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define WGM12  3
+
+/* adc */
+#define MUX0  0
+#define MUX1  1
+#define MUX2  2
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE  3
+#define ADIF  4
+#define ADATE 5
+#define ADSC  6
+#define ADEN  7
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define ADC0D 0
+#define ADC1D 1
+
+/* usart */
+#define RXC1  7
+#define TXC1  6
+#define UDRE1 5
+#define U2X1  1
+#define RXCIE1 7
+#define TXCIE1 6
+#define UDRIE1 5
+#define RXEN1 4
+#define TXEN1 3
+#define UCSZ10 1
+#define USBS1 3
+#define UPM10 4
+
+#define RAMSTART 0x100
+#define RAMEND   0xAFF
+
+#endif /* _SIM_AVR_IO_H_ */
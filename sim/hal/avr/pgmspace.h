@@ -0,0 +1,43 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* host stand-in for <avr/pgmspace.h>: flash is just const data */
+#ifndef _SIM_AVR_PGMSPACE_H_
+#define _SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(S) (S)
+#define PGM_P const char *
+
+typedef char prog_char;
+typedef uint8_t prog_uint8_t;
+typedef uint16_t prog_uint16_t;
+
+#define pgm_read_byte(A)  (*(const uint8_t *)(A))
+#define pgm_read_word(A)  (*(const uint16_t *)(A))
+#define pgm_read_dword(A) (*(const uint32_t *)(A))
+#define pgm_read_ptr(A)   (*(void * const *)(A))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif /* _SIM_AVR_PGMSPACE_H_ */
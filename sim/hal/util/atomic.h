@@ -0,0 +1,41 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* host stand-in for <util/atomic.h>, same cleanup trick as avr-libc */
+#ifndef _SIM_UTIL_ATOMIC_H_
+#define _SIM_UTIL_ATOMIC_H_
+
+#include <avr/io.h>
+
+static inline uint8_t __sim_iCliRetVal(void) {
+	SREG &= ~0x80;
+	return 1;
+}
+
+static inline void __sim_iRestore(const uint8_t *s) {
+	SREG = *s;
+}
+
+#define ATOMIC_RESTORESTATE \
+	uint8_t sreg_save __attribute__((__cleanup__(__sim_iRestore))) = SREG
+
+#define ATOMIC_BLOCK(TYPE) \
+	for (TYPE, __ToDo = __sim_iCliRetVal(); __ToDo; __ToDo = 0)
+
+#endif /* _SIM_UTIL_ATOMIC_H_ */
@@ -0,0 +1,518 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* isr-profile: cycle cost of the interrupt handlers on the real firmware
+ *
+ * usage: isr-profile [cw-kbd.elf]
+ *
+ * Unlike cw-sim this runs the avr build itself, instruction by
+ * instruction under simavr (it links against libsimavr, see the
+ * Makefile), with no usb host attached.  A few scenarios are played
+ * against the pins:
+ *
+ *   tick    nothing at all; the ms tick and whatever it keeps running
+ *   paddle  each paddle held for a while, then both squeezed, sidetone
+ *           and all
+ *   button  the command mode button pressed (in), then pressed again
+ *           (out)
+ *   serial  bytes at the debug console (USART1_RX only exists in the
+ *           debug build)
+ *   straight  the left contact keyed in straight key mode (set in the
+ *           eeprom, then a reset), with the cycles from each contact
+ *           edge to the keyer pin following it; ptt has no lead out
+ *           of a fresh eeprom, so every edge is timed
+ *   rx      a 700Hz tone keyed at the audio input (the ADC only runs
+ *           in the RX build), with the cycles rx_work takes over each
+ *           block from the main loop, less the isrs that cut into it
+ *
+ * and for each one every vector that ran is listed with its calls, the
+ * cycles from taking the vector to its reti (min, mean and max), and
+ * its share of the cpu over the scenario.  Cycles spent in an isr that
+ * interrupted another are only counted against the inner one.  The
+ * exit status is 1 if the ADC isr ever took more than RX_SAMPLE_CYCLES,
+ * rx_work more than RX_WORK_CYCLES for a block, or the straight key
+ * pin ever lagged its contact by more than STRAIGHT_LAG_CYCLES.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_interrupts.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_uart.h"
+#include "avr_adc.h"
+#include "avr_eeprom.h"
+
+#define MCU "atmega32u4"
+#define F_CPU 16000000UL
+#include "../rx.h"
+#define MS(N) ((avr_cycle_count_t)(N) * (F_CPU / 1000))
+#define US(N) ((avr_cycle_count_t)(N) * (F_CPU / 1000000))
+
+/* presets[0].keying_mode in the eeprom: after the signature, the log
+ * header, current_preset and wpm (see settings.h) */
+#define EE_KEYING_MODE (4 + 3 + 1 + 1)
+#define KEYING_MODE_STRAIGHT 1
+/* the keyer output is PF7 */
+#define CW_PORT_LETTER 'F'
+#define CW_BIT_NUMBER 7
+/* the most a contact edge may take to get to the pin, even when it
+ * lands in the middle of another isr: 100us */
+#define STRAIGHT_LAG_CYCLES 1600
+
+/* the stack pointer */
+#define SPL_ADDR 0x5d
+#define SPH_ADDR 0x5e
+/* a call to rx_work that takes longer than this had a block to do */
+#define RX_WORK_IDLE 500
+
+/* PLLCSR and its lock bit */
+#define PLLCSR_ADDR 0x49
+#define PLOCK 0
+
+/* vector numbers from the atmega32u4 data sheet */
+#define VECTORS 43
+static const char *vector_name[VECTORS] = {
+	[1] = "INT0",          [2] = "INT1",          [3] = "INT2",
+	[4] = "INT3",          [7] = "INT6",          [9] = "PCINT0",
+	[10] = "USB_GEN",      [11] = "USB_COM",      [12] = "WDT",
+	[16] = "TIMER1_CAPT",  [17] = "TIMER1_COMPA", [18] = "TIMER1_COMPB",
+	[19] = "TIMER1_COMPC", [20] = "TIMER1_OVF",   [21] = "TIMER0_COMPA",
+	[22] = "TIMER0_COMPB", [23] = "TIMER0_OVF",   [24] = "SPI_STC",
+	[25] = "USART1_RX",    [26] = "USART1_UDRE",  [27] = "USART1_TX",
+	[28] = "ANALOG_COMP",  [29] = "ADC",          [30] = "EE_READY",
+	[31] = "TIMER3_CAPT",  [32] = "TIMER3_COMPA", [33] = "TIMER3_COMPB",
+	[34] = "TIMER3_COMPC", [35] = "TIMER3_OVF",   [36] = "TWI",
+	[37] = "SPM_READY",    [38] = "TIMER4_COMPA", [39] = "TIMER4_COMPB",
+	[40] = "TIMER4_COMPD", [41] = "TIMER4_OVF",   [42] = "TIMER4_FPF",
+};
+#define ADC_VECTOR 29
+/* always listed, even when they did not run */
+static const uint8_t watched[] = { 21, 32, 1, 2, 7, 25, ADC_VECTOR };
+
+static struct {
+	uint32_t calls;
+	avr_cycle_count_t min, max, total;
+} stats[VECTORS];
+
+/* isrs in progress, innermost last */
+static struct {
+	uint8_t v;
+	avr_cycle_count_t start, inner;
+} running[8];
+static uint8_t depth;
+/* cycles in isrs, all told */
+static avr_cycle_count_t isr_spent;
+
+static avr_t *avr;
+
+/* rx_work from when it is called until it returns */
+static uint32_t work_pc;
+static struct {
+	bool in;
+	uint16_t sp;
+	avr_cycle_count_t start, isr;
+	uint32_t blocks;
+	avr_cycle_count_t max, total;
+} work;
+
+static void isr_running(struct avr_irq_t *irq, uint32_t value, void *param) {
+	uint8_t v = (uintptr_t)param;
+	avr_cycle_count_t self;
+
+	if (value) {
+		if (depth < sizeof(running) / sizeof(running[0])) {
+			running[depth].v = v;
+			running[depth].start = avr->cycle;
+			running[depth].inner = 0;
+		}
+		depth++;
+		return;
+	}
+	if (!depth || --depth >= sizeof(running) / sizeof(running[0]))
+		return;
+	self = avr->cycle - running[depth].start;
+	if (depth)
+		running[depth - 1].inner += self;
+	else
+		isr_spent += self;
+	self -= running[depth].inner;
+	v = running[depth].v;
+	if (!stats[v].calls || self < stats[v].min)
+		stats[v].min = self;
+	if (self > stats[v].max)
+		stats[v].max = self;
+	stats[v].total += self;
+	stats[v].calls++;
+}
+
+/* there is no usb pll to wait for; say it locked so USB_Init returns */
+static void pll_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v,
+		void *param) {
+	avr->data[addr] = v | (1 << PLOCK);
+}
+
+/* the byte address of a function in the elf, or 0 */
+static uint32_t elf_func(const char *file, const char *name) {
+	Elf *e;
+	Elf_Scn *scn = NULL;
+	GElf_Shdr sh;
+	GElf_Sym sym;
+	Elf_Data *data;
+	uint32_t addr = 0;
+	size_t i;
+	int fd;
+
+	if (elf_version(EV_CURRENT) == EV_NONE ||
+			(fd = open(file, O_RDONLY)) < 0)
+		return 0;
+	e = elf_begin(fd, ELF_C_READ, NULL);
+	while (e && !addr && (scn = elf_nextscn(e, scn))) {
+		if (!gelf_getshdr(scn, &sh) || sh.sh_type != SHT_SYMTAB)
+			continue;
+		data = elf_getdata(scn, NULL);
+		for (i = 0; data && i < sh.sh_size / sh.sh_entsize; i++) {
+			if (gelf_getsym(data, i, &sym) &&
+					GELF_ST_TYPE(sym.st_info) == STT_FUNC &&
+					!strcmp(elf_strptr(e, sh.sh_link,
+						sym.st_name), name)) {
+				addr = sym.st_value;
+				break;
+			}
+		}
+	}
+	if (e)
+		elf_end(e);
+	close(fd);
+	return addr;
+}
+
+static inline uint16_t sp(void) {
+	return avr->data[SPL_ADDR] | avr->data[SPH_ADDR] << 8;
+}
+
+/* from the call to rx_work to its ret, which is the first time the
+ * stack is back above where it was on the way in */
+static void work_step(void) {
+	avr_cycle_count_t self;
+	if (!work.in) {
+		if (avr->pc != work_pc)
+			return;
+		work.in = true;
+		work.sp = sp();
+		work.start = avr->cycle;
+		work.isr = isr_spent;
+		return;
+	}
+	if (sp() <= work.sp)
+		return;
+	work.in = false;
+	self = avr->cycle - work.start - (isr_spent - work.isr);
+	if (self < RX_WORK_IDLE)
+		return;
+	work.blocks++;
+	work.total += self;
+	if (self > work.max)
+		work.max = self;
+}
+
+static void run_until(avr_cycle_count_t until) {
+	int state;
+	while (avr->cycle < until) {
+		state = avr_run(avr);
+		if (work_pc)
+			work_step();
+		if (state == cpu_Done || state == cpu_Crashed) {
+			fprintf(stderr, "firmware stopped at %llu cycles\n",
+				(unsigned long long)avr->cycle);
+			exit(1);
+		}
+	}
+}
+
+static void run_for(uint32_t ms) {
+	run_until(avr->cycle + MS(ms));
+}
+
+static void pin(char port, uint8_t bit, bool high) {
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit),
+		high);
+}
+
+static void scenario_tick(void) {
+	run_for(2000);
+}
+
+/* left is PD0, right is PD1, both active low */
+static void scenario_paddle(void) {
+	pin('D', 0, false);
+	run_for(1000);
+	pin('D', 0, true);
+	run_for(200);
+	pin('D', 1, false);
+	run_for(1000);
+	pin('D', 1, true);
+	run_for(200);
+	pin('D', 0, false);
+	pin('D', 1, false);
+	run_for(1000);
+	pin('D', 0, true);
+	pin('D', 1, true);
+	run_for(500);
+}
+
+/* the button is PE6, active low, and needs 10ms to count */
+static void scenario_button(void) {
+	pin('E', 6, false);
+	run_for(100);
+	pin('E', 6, true);
+	run_for(500);
+	pin('E', 6, false);
+	run_for(100);
+	pin('E', 6, true);
+	run_for(500);
+}
+
+/* a byte every 100us is about as fast as 115200 baud goes */
+static void scenario_serial(void) {
+	avr_irq_t *rx = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('1'),
+		UART_IRQ_INPUT);
+	uint8_t i;
+	for (i = 0; i < 64; i++) {
+		avr_raise_irq(rx, 'x');
+		run_until(avr->cycle + US(100));
+	}
+	run_for(100);
+}
+
+/* the input sits at half of the 5V reference, and the tone swings a
+ * quarter of full scale either side of it; it is moved on every 25us,
+ * well inside the 104us between conversions */
+static avr_irq_t *adc0;
+static bool tone_on;
+
+static avr_cycle_count_t tone_step(avr_t *avr, avr_cycle_count_t when,
+		void *param) {
+	double t = (double)when / F_CPU;
+	uint32_t mv = 2500;
+	if (tone_on)
+		mv += 1250 * sin(2 * M_PI * 700 * t);
+	avr_raise_irq(adc0, mv);
+	return when + US(25);
+}
+
+/* from each contact edge to the output, in cycles */
+static bool key_watch;
+static avr_cycle_count_t key_edge;
+static struct {
+	uint32_t n;
+	avr_cycle_count_t min, max, total;
+} key_lag;
+
+static void key_out(struct avr_irq_t *irq, uint32_t value, void *param) {
+	avr_cycle_count_t lag;
+	if (!key_watch)
+		return;
+	key_watch = false;
+	lag = avr->cycle - key_edge;
+	if (!key_lag.n || lag < key_lag.min)
+		key_lag.min = lag;
+	if (lag > key_lag.max)
+		key_lag.max = lag;
+	key_lag.total += lag;
+	key_lag.n++;
+}
+
+static void key_contact(bool down) {
+	key_edge = avr->cycle;
+	key_watch = true;
+	pin('D', 0, !down);
+}
+
+/* the firmware only looks at the keying mode as it boots */
+static void straight_boot(void) {
+	uint8_t mode = KEYING_MODE_STRAIGHT;
+	avr_eeprom_desc_t ee = {
+		.ee = &mode, .offset = EE_KEYING_MODE, .size = 1,
+	};
+	avr_ioctl(avr, AVR_IOCTL_EEPROM_SET, &ee);
+	avr_reset(avr);
+	depth = 0;
+	pin('D', 0, true);
+	pin('D', 1, true);
+	pin('E', 6, true);
+	run_for(3000);
+}
+
+/* dits and dahs at 20wpm */
+static void scenario_straight(void) {
+	uint8_t i;
+	memset(&key_lag, 0, sizeof(key_lag));
+	for (i = 0; i < 20; i++) {
+		key_contact(true);
+		run_for(i & 1 ? 180 : 60);
+		key_contact(false);
+		run_for(60);
+	}
+	run_for(500);
+}
+
+/* a dit at 20wpm is 60ms */
+static void scenario_rx(void) {
+	uint8_t i;
+	avr->avcc = 5000;
+	adc0 = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0);
+	avr_cycle_timer_register_usec(avr, 25, tone_step, NULL);
+	for (i = 0; i < 10; i++) {
+		tone_on = true;
+		run_for(i & 1 ? 180 : 60);
+		tone_on = false;
+		run_for(60);
+	}
+	run_for(500);
+	avr_cycle_timer_cancel(avr, tone_step, NULL);
+}
+
+static void report(const char *name, void (*scenario)(void)) {
+	avr_cycle_count_t start = avr->cycle, span;
+	uint8_t v, i;
+	bool shown;
+
+	memset(stats, 0, sizeof(stats));
+	scenario();
+	span = avr->cycle - start;
+	printf("%s: %.0f ms\n", name, (double)span * 1000 / F_CPU);
+	printf("  %-14s %7s %7s %7s %7s %7s\n", "isr", "calls", "min",
+		"mean", "max", "cpu%");
+	for (v = 1; v < VECTORS; v++) {
+		shown = false;
+		for (i = 0; i < sizeof(watched); i++)
+			shown |= watched[i] == v;
+		if (!stats[v].calls) {
+			if (shown)
+				printf("  %-14s %7u %7s %7s %7s %7s\n",
+					vector_name[v], 0, "-", "-", "-", "-");
+			continue;
+		}
+		printf("  %-14s %7u %7llu %7.1f %7llu %7.3f\n",
+			vector_name[v] ? vector_name[v] : "?",
+			stats[v].calls, (unsigned long long)stats[v].min,
+			(double)stats[v].total / stats[v].calls,
+			(unsigned long long)stats[v].max,
+			(double)stats[v].total * 100 / span);
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *elf = argc > 1 ? argv[1] : "../cw-kbd.elf";
+	elf_firmware_t fw;
+	uint32_t flags = 0;
+	avr_irq_t *irq;
+	uint8_t v;
+
+	memset(&fw, 0, sizeof(fw));
+	work_pc = elf_func(elf, "rx_work");
+	if (elf_read_firmware(elf, &fw)) {
+		fprintf(stderr, "can't load %s\n", elf);
+		return 1;
+	}
+	avr = avr_make_mcu_by_name(MCU);
+	if (!avr) {
+		fprintf(stderr, "simavr has no %s\n", MCU);
+		return 1;
+	}
+	avr_init(avr);
+	avr->frequency = F_CPU;
+	avr_load_firmware(avr, &fw);
+	avr_register_io_write(avr, PLLCSR_ADDR, pll_write, NULL);
+
+	/* keep the debug console off our stdout */
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('1'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('1'), &flags);
+
+	for (v = 1; v < VECTORS; v++) {
+		irq = avr_get_interrupt_irq(avr, v);
+		if (irq)
+			avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING,
+				isr_running, (void *)(uintptr_t)v);
+	}
+
+	/* paddles and button idle high */
+	pin('D', 0, true);
+	pin('D', 1, true);
+	pin('E', 6, true);
+	/* boot, and let "hi" go out */
+	run_for(3000);
+
+	report("tick", scenario_tick);
+	report("paddle", scenario_paddle);
+	report("button", scenario_button);
+	report("serial", scenario_serial);
+	avr_irq_register_notify(avr_io_getirq(avr,
+		AVR_IOCTL_IOPORT_GETIRQ(CW_PORT_LETTER), CW_BIT_NUMBER),
+		key_out, NULL);
+	straight_boot();
+	report("straight", scenario_straight);
+	if (key_lag.n)
+		printf("  contact to pin: %u edges, min %llu mean %.0f "
+			"max %llu cycles (max %.1f us)\n", key_lag.n,
+			(unsigned long long)key_lag.min,
+			(double)key_lag.total / key_lag.n,
+			(unsigned long long)key_lag.max,
+			(double)key_lag.max * 1e6 / F_CPU);
+	else
+		printf("  contact to pin: the pin never moved\n");
+	memset(&work, 0, sizeof(work));
+	report("rx", scenario_rx);
+	if (work.blocks)
+		printf("  rx_work: %u blocks, mean %.0f max %llu cycles "
+			"(%u filter steps)\n", work.blocks,
+			(double)work.total / work.blocks,
+			(unsigned long long)work.max, RX_STEPS);
+	else
+		printf("  rx_work: %s\n", work_pc ? "never had a block" :
+			"not in the elf");
+	if (stats[ADC_VECTOR].max > RX_SAMPLE_CYCLES) {
+		printf("ADC isr over its budget of %u cycles\n",
+			RX_SAMPLE_CYCLES);
+		return 1;
+	}
+	if (work.max > RX_WORK_CYCLES) {
+		printf("rx_work over its budget of %u cycles a block\n",
+			RX_WORK_CYCLES);
+		return 1;
+	}
+	if (!key_lag.n || key_lag.max > STRAIGHT_LAG_CYCLES) {
+		printf("straight key output over its budget of %u cycles\n",
+			STRAIGHT_LAG_CYCLES);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+/* cw-sim: run the keyer core against a script
+ *
+ * usage: cw-sim [-e] [script]
+ *   -e  start from a blank eeprom (first boot) instead of the .eep image
+ *
+ * The script (stdin if none is given) is one command per line, and
+ * everything after a '#' is ignored:
+ *
+ *   wait <ms>         let time pass
+ *   at <ms>           let time pass up to an absolute time
+ *   left <1|0>        press or release the left (INT0) paddle
+ *   right <1|0>       same for the right (INT1) paddle
+ *   speed <wpm>
+ *   mode <a|b|c|p|s|u> keyer mode, same letters as the 'k' command
+ *   tone <hz/10>
+ *   beeper <1|0>
+ *   autospace <1|0>
+ *   ptt <lead> <tail> ptt lead in ms and tail in 10ms, as the 'w' command
+ *   weight <w> <comp> mark weight (50 even) and 0.1ms compensation, as
+ *                     the 'g' command
+ *   radio <1|2> [m|w] send on radio 1 or 2, taking turns at the end of
+ *                     each message or word, as the 'o' command
+ *   lane <r|t>        send goes to the reply lane, which cuts in at the
+ *                     next character, or back to text (as command mode
+ *                     does); only the lane's own sending is echoed
+ *   send <text>       queue text to be sent
+ *   memory <n> <text> save a message memory
+ *   call <callsign>   the callsign memories expand their call token to
+ *   serial <n> [<w>]  contest serial number, zero padded to w digits
+ *   cuts [<digits>]   the digits sent as cut numbers, none if not given
+ *   play <n>          send a message memory
+ *   stop              drop everything queued to send, as switching in
+ *                     or out of command mode does
+ *   eeprom            print whether eeprom writes are still queued (busy)
+ *                     or not (idle)
+ *   idle [ms]         run until nothing is left to send (at most ms,
+ *                     a minute by default)
+ *   stack             print the deepest the (host) stack has been at
+ *                     each stack_mark site so far
+ *
+ * The output is one line per change: the time in ms, then what changed;
+ * key (the keyer output), dit and dah (the paddle echo pins), tone (the
+ * sidetone in Hz, 0 when off), ptt, key2 and ptt2 (the second radio)
+ * and hid (a decoded character that would have been typed).  The exit
+ * status is 1 if the firmware waited on the eeprom in an interrupt, or
+ * with interrupts off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "settings.h"
+#include "cw.h"
+#include "memory.h"
+#include "eeq.h"
+#include "stack.h"
+#include "sim.h"
+
+static const char *signal_name[] = {
+	[SIM_KEY] = "key",
+	[SIM_DIT] = "dit",
+	[SIM_DAH] = "dah",
+	[SIM_TONE] = "tone",
+	[SIM_PTT] = "ptt",
+	[SIM_KEY2] = "key2",
+	[SIM_PTT2] = "ptt2",
+};
+
+static void print_time(void) {
+	printf("%10.3f ", (double)sim_now / SIM_US(1) / 1000.0);
+}
+
+static void watch(enum sim_signal sig, uint16_t v) {
+	print_time();
+	printf("%s %u\n", signal_name[sig], v);
+}
+
+static void hid(uint8_t c) {
+	print_time();
+	if (isprint(c))
+		printf("hid '%c'\n", c);
+	else
+		printf("hid %#x\n", c);
+}
+
+#define STACK_SITE_NAME(ID, C) #ID,
+static const char *stack_site_name[] = {
+	STACK_SITES(STACK_SITE_NAME)
+};
+
+static void print_stack(void) {
+	uint8_t i;
+	for (i = 0; i < STACK_SITE_COUNT; i++) {
+		print_time();
+		printf("stack %s %u\n", stack_site_name[i], stack_deepest[i]);
+	}
+}
+
+static void run_idle(uint32_t ms) {
+	uint64_t end = sim_now + SIM_MS(ms);
+	while (cw_busy() && sim_now < end)
+		sim_run(sim_now + SIM_MS(1));
+}
+
+static int run_line(char *line, unsigned lineno) {
+	char *cmd, *arg, *p;
+	long n;
+
+	if ((p = strchr(line, '#')))
+		*p = 0;
+	cmd = strtok(line, " \t\r\n");
+	if (!cmd)
+		return 0;
+	arg = strtok(NULL, "\r\n");
+	while (arg && isspace((unsigned char)*arg))
+		arg++;
+	n = arg ? strtol(arg, NULL, 0) : 0;
+
+	if (!strcmp(cmd, "wait")) {
+		sim_run(sim_now + SIM_MS(n));
+	} else if (!strcmp(cmd, "at")) {
+		if (SIM_MS(n) > sim_now)
+			sim_run(SIM_MS(n));
+	} else if (!strcmp(cmd, "left") || !strcmp(cmd, "right")) {
+		sim_paddle(cmd[0] == 'r', n != 0);
+	} else if (!strcmp(cmd, "speed")) {
+		cw_set_speed(n, true);
+	} else if (!strcmp(cmd, "mode")) {
+		keying_mode_t m = keying_mode_unset;
+		switch (arg ? arg[0] : 0) {
+			case 'a': m = keying_mode_iambic_a; break;
+			case 'b': m = keying_mode_iambic_b; break;
+			case 'c': m = keying_mode_bug; break;
+			case 'p': m = keying_mode_paddle; break;
+			case 's': m = keying_mode_straight; break;
+			case 'u': m = keying_mode_ultimatic; break;
+		}
+		if (m == keying_mode_unset)
+			goto bad;
+		cw_set_keying_mode(m);
+	} else if (!strcmp(cmd, "tone")) {
+		cw_set_frequency(n);
+	} else if (!strcmp(cmd, "beeper")) {
+		cw_set_beeper(n != 0);
+	} else if (!strcmp(cmd, "autospace")) {
+		cw_set_word_space(n != 0, true);
+	} else if (!strcmp(cmd, "ptt")) {
+		/* ptt <lead> <tail> */
+		p = NULL;
+		if (arg)
+			strtol(arg, &p, 0);
+		cw_set_ptt(n, p && *p ? strtol(p, NULL, 0) : 0, true);
+	} else if (!strcmp(cmd, "weight")) {
+		/* weight <weight> <comp> */
+		p = NULL;
+		if (arg)
+			strtol(arg, &p, 0);
+		cw_set_weighting(n, p && *p ? strtol(p, NULL, 0) : 0);
+	} else if (!strcmp(cmd, "radio")) {
+		/* radio <1|2> [m|w] */
+		if (n < 1 || n > CW_RADIOS)
+			goto bad;
+		cw_set_radio(n - 1);
+		p = arg ? strpbrk(arg, " \t") : NULL;
+		if (p && (p = strpbrk(p, "mw")))
+			cw_set_so2r_policy(*p == 'w' ? so2r_word : so2r_message);
+	} else if (!strcmp(cmd, "lane")) {
+		if (!arg || (*arg != 'r' && *arg != 't'))
+			goto bad;
+		cw_set_lane(*arg == 'r' ? cw_lane_reply : cw_lane_text);
+	} else if (!strcmp(cmd, "send")) {
+		if (!arg)
+			goto bad;
+		cw_string(arg);
+	} else if (!strcmp(cmd, "memory")) {
+		if (!arg || !(p = strpbrk(arg, " \t")))
+			goto bad;
+		/* as the operator would, try again once the last save is
+		 * out of the way */
+		while (!memory_save(n, p + 1)) {
+			if (!eeq_busy()) {
+				fprintf(stderr, "%u: memory %ld does not fit\n",
+					lineno, n);
+				break;
+			}
+			sim_run(sim_now + SIM_MS(1));
+		}
+	} else if (!strcmp(cmd, "call")) {
+		if (!arg)
+			goto bad;
+		settings_set_callsign(arg);
+	} else if (!strcmp(cmd, "serial")) {
+		/* serial <n> [<width>] */
+		p = NULL;
+		if (arg)
+			strtol(arg, &p, 0);
+		settings_set_serial(n, p && *p ? strtol(p, NULL, 0) : 0);
+	} else if (!strcmp(cmd, "cuts")) {
+		/* cuts [<digits>] */
+		uint16_t cuts = 0;
+		for (p = arg; p && *p; p++)
+			if (*p >= '0' && *p <= '9')
+				cuts |= 1 << (*p - '0');
+		settings_set_cuts(cuts);
+	} else if (!strcmp(cmd, "play")) {
+		cw_play(n);
+	} else if (!strcmp(cmd, "stop")) {
+		cw_clear_queues();
+	} else if (!strcmp(cmd, "eeprom")) {
+		print_time();
+		printf("eeprom %s\n", eeq_busy() ? "busy" : "idle");
+	} else if (!strcmp(cmd, "idle")) {
+		run_idle(arg ? n : 60000);
+	} else if (!strcmp(cmd, "stack")) {
+		print_stack();
+	} else {
+		goto bad;
+	}
+	sim_sync();
+	return 0;
+bad:
+	fprintf(stderr, "%u: bad command '%s'\n", lineno, cmd);
+	return -1;
+}
+
+int main(int argc, char **argv) {
+	char line[256];
+	unsigned lineno = 0;
+	bool erase = false;
+	FILE *script = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "e")) != -1) {
+		switch (opt) {
+		case 'e': erase = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-e] [script]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind < argc && !(script = fopen(argv[optind], "r"))) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	sim_watch = watch;
+	sim_boot(erase, hid);
+
+	while (fgets(line, sizeof(line), script)) {
+		if (run_line(line, ++lineno))
+			return 1;
+	}
+	if (sim_stalled) {
+		printf("# %.3f ms stalled on the eeprom\n",
+			(double)sim_stalled / SIM_US(1) / 1000.0);
+	}
+	if (sim_isr_stalled) {
+		printf("# %.3f ms of it with interrupts off\n",
+			(double)sim_isr_stalled / SIM_US(1) / 1000.0);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "settings.h"
+#include "cw.h"
+#include "timer.h"
+#include "tick.h"
+#include "memory.h"
+#include "trace.h"
+#include "stack.h"
+#include "sim.h"
+
+/* an eeprom byte write takes 3.4ms */
+#define SIM_EE_WRITE SIM_US(3400)
+
+volatile uint8_t sim_io[0x100];
+uint64_t sim_now;
+uint64_t sim_stalled, sim_isr_stalled;
+sim_watch_t sim_watch;
+sim_trace_t sim_trace;
+sim_adc_t sim_adc;
+sim_loop_t sim_loop;
+
+const char *sim_morse[128] = {
+	['A'] = ".-",    ['B'] = "-...",  ['C'] = "-.-.",  ['D'] = "-..",
+	['E'] = ".",     ['F'] = "..-.",  ['G'] = "--.",   ['H'] = "....",
+	['I'] = "..",    ['J'] = ".---",  ['K'] = "-.-",   ['L'] = ".-..",
+	['M'] = "--",    ['N'] = "-.",    ['O'] = "---",   ['P'] = ".--.",
+	['Q'] = "--.-",  ['R'] = ".-.",   ['S'] = "...",   ['T'] = "-",
+	['U'] = "..-",   ['V'] = "...-",  ['W'] = ".--",   ['X'] = "-..-",
+	['Y'] = "-.--",  ['Z'] = "--..",
+	['0'] = "-----", ['1'] = ".----", ['2'] = "..---", ['3'] = "...--",
+	['4'] = "....-", ['5'] = ".....", ['6'] = "-....", ['7'] = "--...",
+	['8'] = "---..", ['9'] = "----.",
+};
+
+/* the vectors the simulator knows how to raise */
+void INT0_vect(void);
+void INT1_vect(void);
+void TIMER0_COMPA_vect(void);
+void ADC_vect(void);
+void EE_READY_vect(void);
+
+static const uint16_t sim_prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+/* timer0, only in ctc mode as tick.c uses it */
+static struct {
+	uint16_t prescale;   /* 0 while stopped */
+	uint8_t top;         /* OCR0A and TCNT0 as last seen */
+	uint8_t tcnt;
+	uint64_t zero;       /* when the count was last 0 */
+	uint64_t period;
+	uint64_t next;       /* next compare match */
+} t0;
+
+/* the adc, single conversions or free running */
+static struct {
+	bool busy;
+	uint64_t done;       /* when the conversion under way finishes */
+	bool flag;           /* ADIF */
+	uint8_t mux;         /* the input, taken as the conversion starts */
+} adc;
+
+uint8_t sim_eeprom[E2END + 1];
+static uint8_t ee_cr, ee_dr;
+static bool ee_busy;
+static uint64_t ee_done;
+
+/* pending interrupt flags; the register slots are write-one-to-clear */
+static uint8_t sim_eifr, sim_tifr0;
+
+/* outputs as last reported */
+static uint8_t out_key, out_dit, out_dah, out_ptt, out_key2, out_ptt2;
+static uint16_t out_tone;
+
+static uint8_t sim_depth;
+
+static void t0_refresh(void) {
+	if (t0.prescale)
+		TCNT0 = ((sim_now - t0.zero) / t0.prescale) % (t0.top + 1);
+	t0.tcnt = TCNT0;
+}
+
+/* pick up a firmware start, stop or reload of timer0 */
+static void t0_sync(void) {
+	uint16_t p = sim_prescale[TCCR0B & 0x7];
+	if (p == t0.prescale && OCR0A == t0.top && TCNT0 == t0.tcnt)
+		return;
+	t0.prescale = p;
+	t0.top = OCR0A;
+	t0.tcnt = TCNT0;
+	if (!p)
+		return;
+	t0.period = (uint64_t)(t0.top + 1) * p;
+	t0.zero = sim_now - (uint64_t)t0.tcnt * p;
+	t0.next = t0.zero + (uint64_t)t0.top * p;
+	while (t0.next <= sim_now)
+		t0.next += t0.period;
+}
+
+/* start a conversion when the firmware sets ADSC; the first one after
+ * ADEN takes 25 adc clocks, the rest 13 */
+static void adc_sync(void) {
+	uint16_t p = 1 << (ADCSRA & 0x7);
+	if (!(ADCSRA & _BV(ADEN))) {
+		adc.busy = false;
+		return;
+	}
+	if (adc.busy || !(ADCSRA & _BV(ADSC)))
+		return;
+	adc.busy = true;
+	adc.mux = ADMUX & 0x1f;
+	adc.done = sim_now + (uint64_t)(p < 2 ? 2 : p) * 25;
+}
+
+static void adc_step(void) {
+	uint16_t p = 1 << (ADCSRA & 0x7), v;
+	if (!adc.busy || sim_now < adc.done)
+		return;
+	v = sim_adc ? sim_adc(adc.mux) & 0x3ff : 0;
+	ADC = (ADMUX & _BV(ADLAR)) ? v << 6 : v;
+	adc.flag = true;
+	if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 0x7) == 0) {
+		/* free running, the next one starts as this one ends */
+		adc.mux = ADMUX & 0x1f;
+		adc.done += (uint64_t)(p < 2 ? 2 : p) * 13;
+	} else {
+		adc.busy = false;
+		ADCSRA &= ~_BV(ADSC);
+	}
+}
+
+static void sim_ee_step(void) {
+	uint16_t addr = EEAR & E2END;
+	if (ee_cr & _BV(EERE)) {
+		ee_dr = sim_eeprom[addr];
+		ee_cr &= ~_BV(EERE);
+	}
+	if (ee_busy && sim_now >= ee_done) {
+		ee_busy = false;
+		ee_cr &= ~_BV(EEPE);
+	}
+	if ((ee_cr & _BV(EEPE)) && !ee_busy) {
+		sim_eeprom[addr] = ee_dr;
+		ee_cr &= ~_BV(EEMPE);
+		ee_busy = true;
+		ee_done = sim_now + SIM_EE_WRITE;
+	}
+}
+
+volatile uint8_t *sim_eecr(void) {
+	sim_ee_step();
+	return &ee_cr;
+}
+
+void sim_ee_wait(void) {
+	for (sim_ee_step(); ee_busy; sim_ee_step()) {
+		/* the firmware is spinning on EEPE, so let the time pass;
+		 * interrupts still get taken if they are enabled, and one
+		 * of them may start another write */
+		sim_stalled += ee_done - sim_now;
+		if (sim_depth || !(SREG & 0x80))
+			sim_isr_stalled += ee_done - sim_now;
+		if ((SREG & 0x80) && sim_depth == 0)
+			sim_run(ee_done);
+		else
+			sim_now = ee_done;
+		t0_refresh();
+	}
+}
+
+volatile uint8_t *sim_eedr(void) {
+	sim_ee_step();
+	return &ee_dr;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p) {
+	return sim_eeprom[EE_ADDR(p) & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t *p) {
+	uint16_t v;
+	eeprom_read_block(&v, p, sizeof(v));
+	return v;
+}
+
+uint32_t eeprom_read_dword(const uint32_t *p) {
+	uint32_t v;
+	eeprom_read_block(&v, p, sizeof(v));
+	return v;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	while (n--)
+		*d++ = eeprom_read_byte(s++);
+}
+
+void eeprom_update_byte(uint8_t *p, uint8_t v) {
+	sim_eeprom[EE_ADDR(p) & E2END] = v;
+}
+
+void eeprom_update_dword(uint32_t *p, uint32_t v) {
+	eeprom_update_block(&v, p, sizeof(v));
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+	const uint8_t *s = src;
+	uint8_t *d = dst;
+	while (n--)
+		eeprom_update_byte(d++, *s++);
+}
+
+static uint16_t sim_tone(void) {
+	uint16_t p = sim_prescale[TCCR3B & 0x7];
+	if (!p || !(TIMSK3 & _BV(OCIE3A)))
+		return 0;
+	/* toggle_bit flips the pin on every compare match */
+	return F_CPU / (2UL * p * (OCR3A + 1UL));
+}
+
+static void sim_outputs(void) {
+	uint8_t v;
+	uint16_t tone;
+	if (!sim_watch)
+		return;
+	v = (CW_DDR & CW_BIT) && (CW_PORT & CW_BIT);
+	if (v != out_key)
+		sim_watch(SIM_KEY, out_key = v);
+	v = (DIT_DDR & DIT_BIT) && (DIT_PORT & DIT_BIT);
+	if (v != out_dit)
+		sim_watch(SIM_DIT, out_dit = v);
+	v = (DAH_DDR & DAH_BIT) && (DAH_PORT & DAH_BIT);
+	if (v != out_dah)
+		sim_watch(SIM_DAH, out_dah = v);
+	tone = sim_tone();
+	if (tone != out_tone)
+		sim_watch(SIM_TONE, out_tone = tone);
+	v = (PTT_DDR & PTT_BIT) && (PTT_PORT & PTT_BIT);
+	if (v != out_ptt)
+		sim_watch(SIM_PTT, out_ptt = v);
+	v = (CW2_DDR & CW2_BIT) && (CW2_PORT & CW2_BIT);
+	if (v != out_key2)
+		sim_watch(SIM_KEY2, out_key2 = v);
+	v = (PTT2_DDR & PTT2_BIT) && (PTT2_PORT & PTT2_BIT);
+	if (v != out_ptt2)
+		sim_watch(SIM_PTT2, out_ptt2 = v);
+}
+
+/* the firmware clears a flag by writing a one to it */
+static void sim_flags(void) {
+	sim_eifr &= ~EIFR;
+	sim_tifr0 &= ~TIFR0;
+	EIFR = 0;
+	TIFR0 = 0;
+}
+
+/* the firmware is built with TRACE; the records go to sim_trace
+ * instead of the ring in trace.c */
+void _trace(enum trace_event id, uint8_t a, uint8_t b) {
+	if (sim_trace)
+		sim_trace(id, a, b);
+}
+
+void sim_sync(void) {
+	sim_flags();
+	adc_sync();
+	t0_sync();
+	t0_refresh();
+	sim_outputs();
+}
+
+static void sim_isr(void (*vect)(void)) {
+	t0_refresh();
+	SREG &= ~0x80;
+	vect();
+	SREG |= 0x80;
+	sim_sync();
+}
+
+/* take pending interrupts in vector order until there are none left */
+static void sim_dispatch(void) {
+	uint16_t guard = 1000;
+	while ((SREG & 0x80) && guard--) {
+		sim_ee_step();
+		if ((sim_eifr & _BV(INTF0)) && (EIMSK & _BV(INT0))) {
+			sim_eifr &= ~_BV(INTF0);
+			sim_isr(INT0_vect);
+		} else if ((sim_eifr & _BV(INTF1)) && (EIMSK & _BV(INT1))) {
+			sim_eifr &= ~_BV(INTF1);
+			sim_isr(INT1_vect);
+		} else if ((sim_tifr0 & _BV(OCF0A)) && (TIMSK0 & _BV(OCIE0A))) {
+			sim_tifr0 &= ~_BV(OCF0A);
+			sim_isr(TIMER0_COMPA_vect);
+		} else if (adc.flag && (ADCSRA & _BV(ADIE))) {
+			adc.flag = false;
+			sim_isr(ADC_vect);
+		} else if ((ee_cr & _BV(EERIE)) && !(ee_cr & _BV(EEPE))) {
+			/* level triggered: fires for as long as it is enabled */
+			sim_isr(EE_READY_vect);
+		} else {
+			break;
+		}
+	}
+}
+
+void sim_run(uint64_t until) {
+	uint64_t next;
+	sim_depth++;
+	sim_sync();
+	for (;;) {
+		sim_dispatch();
+		if (sim_loop) {
+			sim_loop();
+			sim_sync();
+		}
+		next = UINT64_MAX;
+		if (t0.prescale)
+			next = t0.next;
+		if (ee_busy && ee_done < next)
+			next = ee_done;
+		if (adc.busy && adc.done < next)
+			next = adc.done;
+		if (next > until)
+			break;
+		if (next > sim_now)
+			sim_now = next;
+		/* several matches may have gone by while interrupts were
+		 * off; like the hardware, they only leave one flag */
+		while (t0.prescale && t0.next <= sim_now) {
+			sim_tifr0 |= _BV(OCF0A);
+			t0.next += t0.period;
+		}
+		sim_ee_step();
+		adc_step();
+		t0_refresh();
+	}
+	if (sim_now < until)
+		sim_now = until;
+	t0_refresh();
+	sim_depth--;
+}
+
+void sim_paddle(uint8_t right, bool down) {
+	uint8_t bit = right ? PD1 : PD0;
+	uint8_t isc = (EICRA >> (right ? ISC10 : ISC00)) & 0x3;
+	bool high = !down;
+
+	if (!!(PIND & _BV(bit)) == high)
+		return;
+	if (high)
+		PIND |= _BV(bit);
+	else
+		PIND &= ~_BV(bit);
+	/* 01: any edge, 10: falling, 11: rising */
+	if (isc == 1 || (isc == 2 && !high) || (isc == 3 && high))
+		sim_eifr |= right ? _BV(INTF1) : _BV(INTF0);
+	t0_refresh();
+	sim_dispatch();
+}
+
+void sim_init(bool erase) {
+	size_t n = __stop_sim_eeprom - __start_sim_eeprom;
+	memset((void *)sim_io, 0, sizeof(sim_io));
+	memset(&t0, 0, sizeof(t0));
+	memset(&adc, 0, sizeof(adc));
+	memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+	if (!erase)
+		memcpy(sim_eeprom, __start_sim_eeprom,
+			n < sizeof(sim_eeprom) ? n : sizeof(sim_eeprom));
+	ee_cr = ee_dr = 0;
+	ee_busy = false;
+	sim_eifr = sim_tifr0 = 0;
+	sim_now = sim_stalled = sim_isr_stalled = 0;
+	out_key = out_dit = out_dah = out_ptt = out_key2 = out_ptt2 = 0;
+	out_tone = 0;
+	/* paddles idle high on their pull-ups */
+	PIND = _BV(PD0) | _BV(PD1);
+	SREG = 0x80;
+}
+
+/* stack_mark on the host: bytes of host stack below sim_boot's frame */
+static uintptr_t sim_stack_top;
+
+__attribute__((noinline)) uint16_t sim_stack_depth(void) {
+	uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+	return sp < sim_stack_top ? sim_stack_top - sp : 0;
+}
+
+void sim_boot(bool erase, void (*hid)(uint8_t c)) {
+	sim_stack_top = (uintptr_t)__builtin_frame_address(0);
+	sim_init(erase);
+	stack_init();
+	settings_init();
+	ms_tick_init();
+	cw_init(settings_get_wpm(), hid);
+	cw_set_source(memory_src_open, memory_src_next);
+	sim_sync();
+}
+
+unsigned sim_edit_distance(const char *a, const char *b) {
+	size_t la = strlen(a), lb = strlen(b), i, j;
+	unsigned *row = malloc((lb + 1) * sizeof(*row)), diag, up, r;
+	for (j = 0; j <= lb; j++)
+		row[j] = j;
+	for (i = 1; i <= la; i++) {
+		diag = row[0];
+		row[0] = i;
+		for (j = 1; j <= lb; j++) {
+			up = row[j];
+			r = diag + (a[i - 1] != b[j - 1]);
+			if (up + 1 < r)
+				r = up + 1;
+			if (row[j - 1] + 1 < r)
+				r = row[j - 1] + 1;
+			row[j] = r;
+			diag = up;
+		}
+	}
+	r = row[lb];
+	free(row);
+	return r;
+}
@@ -0,0 +1,106 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace.h"
+
+/* host simulator for the keyer core
+ *
+ * The firmware sources are built for the host against the headers in
+ * sim/hal, where the i/o registers are an array.  Time is virtual and
+ * counted in cpu cycles; firmware code takes no time at all, and the
+ * simulator steps from one hardware event (timer0 compare, end of an
+ * eeprom write or an adc conversion, a scripted paddle edge) to the
+ * next, calling the isrs the way the avr would, and then sim_loop as
+ * the main loop would be.  Adc inputs come from sim_adc.  Outputs are
+ * watched after each step and reported through sim_watch, and the
+ * firmware is built with TRACE so its trace points can be followed
+ * through sim_trace.
+ */
+
+#define SIM_CYCLES_PER_US (F_CPU / 1000000UL)
+#define SIM_US(US) ((uint64_t)(US) * SIM_CYCLES_PER_US)
+#define SIM_MS(MS) SIM_US((uint64_t)(MS) * 1000)
+
+enum sim_signal {
+	SIM_KEY,    /* keyer output */
+	SIM_DIT,    /* paddle echo outputs */
+	SIM_DAH,
+	SIM_TONE,   /* sidetone frequency in Hz, 0 when off */
+	SIM_PTT,    /* push to talk output */
+	SIM_KEY2,   /* the second radio's key and ptt */
+	SIM_PTT2,
+};
+
+typedef void (*sim_watch_t)(enum sim_signal sig, uint16_t value);
+/* a trace() point in the firmware was passed, see trace.h */
+typedef void (*sim_trace_t)(enum trace_event id, uint8_t a, uint8_t b);
+/* the voltage on adc input mux (the MUX bits of ADMUX) at sim_now, as
+ * a 10 bit conversion result */
+typedef uint16_t (*sim_adc_t)(uint8_t mux);
+/* the firmware's main loop, for one pass; it is run whenever the avr
+ * would have woken up from idle, after the interrupts that woke it */
+typedef void (*sim_loop_t)(void);
+
+/* virtual time in cpu cycles */
+extern uint64_t sim_now;
+/* cycles spent spinning on the eeprom inside firmware code, and how
+ * many of them were in an interrupt or with interrupts off, which
+ * should never wait on it */
+extern uint64_t sim_stalled, sim_isr_stalled;
+extern sim_watch_t sim_watch;
+extern sim_trace_t sim_trace;
+extern sim_adc_t sim_adc;
+extern sim_loop_t sim_loop;
+
+/* the eeprom contents: sim_init loads them, and a bench can change them
+ * before settings_init sees them */
+extern uint8_t sim_eeprom[];
+
+/* morse for the letters and digits as '.' and '-' */
+extern const char *sim_morse[128];
+
+/* reset the registers and load the eeprom with the EEMEM image; erase
+ * starts from a blank (0xff) eeprom instead */
+void sim_init(bool erase);
+
+/* sim_init followed by the keyer half of hw_init/sw_init: settings,
+ * the tick and cw, with decoded characters going to hid */
+void sim_boot(bool erase, void (*hid)(uint8_t c));
+
+/* call after running firmware code from outside an isr, so changes it
+ * made to the timers and outputs are picked up */
+void sim_sync(void);
+
+/* run until the given time, firing whatever falls due on the way */
+void sim_run(uint64_t until);
+
+/* press (true) or release one of the paddles; left is INT0 on PD0 and
+ * right is INT1 on PD1, both active low */
+void sim_paddle(uint8_t right, bool down);
+
+/* the fewest characters to insert, drop or change to turn a into b,
+ * for the character error rate of the benches */
+unsigned sim_edit_distance(const char *a, const char *b);
+
+#endif /* _SIM_H_ */
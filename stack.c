@@ -0,0 +1,171 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include "stack.h"
+
+#define STACK_SITE_CHAR(ID, C) C,
+static const char stack_site_char[STACK_SITE_COUNT] = {
+	STACK_SITES(STACK_SITE_CHAR)
+};
+
+uint16_t stack_deepest[STACK_SITE_COUNT];
+
+/* set on the way down through the watchdog and read at the next boot,
+ * so they must survive the reset */
+#define STACK_TRIP_MAGIC 0x57ac
+static uint16_t stack_trip_magic __attribute__((section(".noinit")));
+static uint8_t stack_trip_site __attribute__((section(".noinit")));
+/* the site that tripped before the last reset, plus one */
+static uint8_t stack_tripped;
+
+#ifdef SIM
+
+/* the host has no painted ram; this is only there so the sites can be
+ * compared, and it is far more than the host stack ever gets near */
+uint16_t stack_size(void) {
+	return RAMEND + 1 - 0x100;
+}
+
+uint16_t stack_unused(void) {
+	uint16_t deepest = 0;
+	uint8_t i;
+	for (i = 0; i < STACK_SITE_COUNT; i++)
+		if (stack_deepest[i] > deepest)
+			deepest = stack_deepest[i];
+	return stack_size() - deepest;
+}
+
+#else
+
+/* from the linker: the end of .bss (where the heap would start) and the
+ * top of ram */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/* runs from .init1, before the stack pointer and r1 are set up, so it
+ * has to be written without any help from the compiler */
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+void stack_paint(void) {
+	__asm__ volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (STACK_PAINT));
+}
+
+/* after a trip the watchdog is still running when we come back up,
+ * and hw_init is a long way off; turn it off first thing */
+void stack_wdt_off(void) __attribute__((naked, used, section(".init3")));
+void stack_wdt_off(void) {
+	MCUSR = 0;
+	wdt_disable();
+}
+
+uint16_t stack_size(void) {
+	return &__stack - &_end + 1;
+}
+
+uint16_t stack_unused(void) {
+	const uint8_t *p = &_end;
+	while (p <= &__stack && *p == STACK_PAINT)
+		p++;
+	return p - &_end;
+}
+
+#endif /* SIM */
+
+static void stack_trip(enum stack_site site) {
+	cli();
+	stack_trip_site = site;
+	stack_trip_magic = STACK_TRIP_MAGIC;
+#ifdef SIM
+	abort();
+#else
+	/* the reset puts every pin back to an input, so the key and
+	 * sidetone are let go along with everything else */
+	wdt_enable(WDTO_15MS);
+	for (;;);
+#endif
+}
+
+void stack_deeper(enum stack_site site, uint16_t depth) {
+	stack_deepest[site] = depth;
+	if (depth > stack_size() - STACK_TRIP)
+		stack_trip(site);
+}
+
+void stack_init(void) {
+	if (stack_trip_magic == STACK_TRIP_MAGIC &&
+			stack_trip_site < STACK_SITE_COUNT)
+		stack_tripped = stack_trip_site + 1;
+	stack_trip_magic = 0;
+}
+
+/* v in decimal at buf, if it fits in len (with the nul); returns
+ * the number of digits written */
+static uint8_t stack_num(char *buf, uint8_t len, uint16_t v) {
+	char num[5];
+	uint8_t n = 0, i;
+	do {
+		num[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	if (n >= len)
+		return 0;
+	for (i = 0; i < n; i++)
+		buf[i] = num[n - 1 - i];
+	buf[n] = 0;
+	return n;
+}
+
+void stack_report(char *buf, uint8_t len) {
+	uint16_t size = stack_size();
+	uint8_t i, l, n;
+
+	l = stack_num(buf, len, stack_unused());
+	for (i = 0; i < STACK_SITE_COUNT && l + 2 < len; i++) {
+		if (!stack_deepest[i])
+			continue;
+		n = stack_num(buf + l + 2, len - l - 2,
+			size - stack_deepest[i]);
+		if (!n)
+			break;
+		buf[l++] = ' ';
+		buf[l++] = stack_site_char[i];
+		l += n;
+	}
+	buf[l] = 0;
+	if (stack_tripped && l + 3 < len) {
+		buf[l++] = ' ';
+		buf[l++] = '!';
+		buf[l++] = stack_site_char[stack_tripped - 1];
+		buf[l] = 0;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _STACK_H_
+#define _STACK_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/* stack painting
+ *
+ * Before anything else runs, everything between the end of .bss and
+ * the top of ram is filled with STACK_PAINT.  Whatever the stack has
+ * ever reached has been written over, so counting the paint still left
+ * above .bss tells how close it has come.
+ *
+ * That says nothing about who got it there, so the deep spots also
+ * call stack_mark with their site, which keeps the deepest the stack
+ * has been at each one.  A site that finds less than STACK_TRIP bytes
+ * left resets through the watchdog before it can run into .bss, and
+ * the next boot remembers which site it was.
+ */
+
+#define STACK_PAINT 0xc5
+/* bytes that must be left below the deepest mark */
+#define STACK_TRIP 48
+
+/* the letters are what the 'h' command reports them as */
+#define STACK_SITES(E) \
+	E(STACK_TICK,    't') /* ms_tick, from the timer0 isr */ \
+	E(STACK_PADDLE,  'p') /* the paddle isrs */ \
+	E(STACK_USB,     'u') /* usb_work */ \
+	E(STACK_COMMAND, 'c') /* command_mode_cb */ \
+	E(STACK_DEBUG,   'd') /* _debug and its buffer */ \
+	E(STACK_ULOG,    'l') /* _ulog and its buffer */
+
+#define STACK_SITE_ID(ID, C) ID,
+enum stack_site {
+	STACK_SITES(STACK_SITE_ID)
+	STACK_SITE_COUNT
+} __attribute__((packed));
+
+/* bytes on the stack right now; the host build measures its own */
+#ifdef SIM
+uint16_t sim_stack_depth(void);
+#define stack_depth() sim_stack_depth()
+#else
+#define stack_depth() ((uint16_t)(RAMEND - SP))
+#endif
+
+/* the deepest the stack has been at each site */
+extern uint16_t stack_deepest[STACK_SITE_COUNT];
+void stack_deeper(enum stack_site site, uint16_t depth);
+
+static inline void stack_mark(enum stack_site site) {
+	uint16_t depth = stack_depth();
+	if (depth > stack_deepest[site])
+		stack_deeper(site, depth);
+}
+
+/* pick up a trip from before the last reset; call once at boot */
+void stack_init(void);
+
+/* bytes between .bss and the top of ram, the most the stack can have */
+uint16_t stack_size(void);
+
+/* bytes the stack has never touched since reset */
+uint16_t stack_unused(void);
+
+/* write "<unused> <site><free>..." into buf for the sites that have
+ * been marked, then "!<site>" if a trip caused the last reset */
+void stack_report(char *buf, uint8_t len);
+
+#endif /* _STACK_H_ */
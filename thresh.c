@@ -0,0 +1,91 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cw.h"
+#include "trace.h"
+#include "thresh.h"
+
+static uint16_t thresh_short, thresh_long; /* typical dit and dah */
+static uint16_t thresh_d;
+static uint8_t thresh_spaces; /* SPACEs decoded since the last element */
+/* the space so far, and what of it came before a noise spike */
+static uint16_t thresh_space, thresh_base;
+
+void thresh_init(uint16_t dit) {
+	thresh_d = dit;
+	thresh_short = dit;
+	thresh_long = 3 * dit;
+	thresh_spaces = 2;
+	thresh_space = thresh_base = 0;
+}
+
+/* pull a typical mark length toward l: quickly when l is beyond it on
+ * its own side, slowly otherwise */
+static uint16_t thresh_follow(uint16_t t, uint16_t l, bool up) {
+	int16_t d = l - t;
+	if ((d > 0) == up)
+		return t + d / 2;
+	return t + d / 8;
+}
+
+void thresh_mark(uint16_t len) {
+	/* too short to be anything but a noise spike, which is part of
+	 * the space it is in */
+	if (len * 3 < thresh_d) {
+		thresh_base = thresh_space + len;
+		return;
+	}
+	/* or too long to be a dah at any speed we follow (not just ours,
+	 * or a run of noise spikes pulling the dit down could lock the
+	 * real dahs out) */
+	if (len > 3 * THRESH_DIT_MAX)
+		return;
+	/* so a sender well away from our own speed is picked up within a
+	 * character or two */
+	if (len < (thresh_short + thresh_long) / 2)
+		didah_decode(DIT);
+	else
+		didah_decode(DAH);
+	thresh_short = thresh_follow(thresh_short, len, false);
+	thresh_long = thresh_follow(thresh_long, len, true);
+	thresh_d = thresh_long / 3;
+	if (thresh_d < THRESH_DIT_MIN)
+		thresh_d = THRESH_DIT_MIN;
+	else if (thresh_d > THRESH_DIT_MAX)
+		thresh_d = THRESH_DIT_MAX;
+	thresh_spaces = 0;
+	thresh_base = 0;
+	trace(TR_RX_MARK, len / 4, thresh_d);
+}
+
+void thresh_quiet(uint16_t len) {
+	len += thresh_base;
+	thresh_space = len;
+	if ((thresh_spaces == 0 && len >= 2 * thresh_d) ||
+			(thresh_spaces == 1 && len >= 5 * thresh_d)) {
+		didah_decode(SPACE);
+		thresh_spaces++;
+	}
+}
+
+uint16_t thresh_dit(void) {
+	return thresh_d;
+}
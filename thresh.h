@@ -0,0 +1,51 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _THRESH_H_
+#define _THRESH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* threshold timing decoder
+ *
+ * Turns the lengths of marks and spaces, in ms, into DIT, DAH and
+ * SPACE for didah_decode.  A mark is a dit or a dah by which side it
+ * falls of halfway between the shortest and longest recent marks, and
+ * the dit length that the spaces are timed against follows the dahs.
+ * Like the paddles, a SPACE goes out halfway into a character gap and
+ * another halfway into a word gap, as the space goes on.
+ */
+
+#define THRESH_DIT_MIN 12  /* 100 wpm */
+#define THRESH_DIT_MAX 240 /* 5 wpm */
+
+/* start over, expecting dits of dit ms */
+void thresh_init(uint16_t dit);
+
+/* a mark of len ms has ended */
+void thresh_mark(uint16_t len);
+
+/* the space since the last mark has gone on for len ms */
+void thresh_quiet(uint16_t len);
+
+/* the dit length we are going by, in ms */
+uint16_t thresh_dit(void);
+
+#endif /* _THRESH_H_ */
@@ -25,6 +25,7 @@
 #include "util.h"
 #include "timer.h"
 #include "tick.h"
+#include "stack.h"
 
 
 volatile uint16_t millis;
@@ -76,9 +77,20 @@ void ms_tick_unregister(enum tick_events prio) {
 	}
 }
 
+/* change the period of a registered event, counting from now; unlike
+ * ms_tick_register this is quiet and cheap enough to call every time
+ * the event fires */
+void ms_tick_set_freq(enum tick_events prio, uint16_t freq) {
+	uint8_t iv = rcli();
+	tick_q[prio].freq = freq;
+	tick_q[prio].next_fire = millis + freq;
+	sreg(iv);
+}
+
 static void ms_tick(void) {
 	enum tick_events i;
 	uint16_t pre_ms;
+	stack_mark(STACK_TICK);
 	millis++;
 	pre_ms = millis;
 
@@ -107,6 +119,8 @@ void ms_tick_start(void) {
 	ulog("ms_tick_start\r");
 	timer0_set_compa_callback(&ms_tick);
 	timer0_init(t8_divide_by_64, T8_CTC_MODE, T8_INT_OCA);
-	timer0_set_top(250); // (16e6 / 64) / 250 == 1000 Hz
+	/* ctc counts 0..top, so top+1 counts a period:
+	 * (16e6 / 64) / 250 == 1000 Hz */
+	timer0_set_top(249);
 }
 
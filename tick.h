@@ -41,8 +41,9 @@ enum tick_events {
 	TICK_CW_ADVANCE,
 	TICK_USB_WORK,
 	TICK_TOGGLE_LED,
-	TICK_INJECT_STR,
+	TICK_SCHED,
 	TICK_FAUX_WDT,
+	TICK_RX,
 	TICK_EVENTS
 } __attribute__((packed));
 
@@ -50,6 +51,7 @@ int16_t delta_millis(uint16_t latter, uint16_t former);
 uint8_t ms_tick_registered(enum tick_events prio);
 void ms_tick_register(tick_callback_t work, enum tick_events prio, uint16_t freq);
 void ms_tick_unregister(enum tick_events prio);
+void ms_tick_set_freq(enum tick_events prio, uint16_t freq);
 void ms_tick_init(void);
 void ms_tick_start(void);
 void ms_tick_stop(void);
@@ -0,0 +1,89 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#include <avr/io.h>
+#include "util.h"
+#include "timer.h"
+#include "tick.h"
+#include "trace.h"
+
+struct trace_rec {
+	enum trace_event id;
+	uint16_t ms;
+	uint8_t us;
+	uint8_t a, b;
+};
+
+static struct trace_rec trace_ring[TRACE_LEN];
+/* free running; only the low bits index the ring */
+static uint8_t trace_in, trace_out;
+static uint8_t trace_lost;
+
+/* keep this short, it is called from the keying isrs.  When the ring
+ * is full the new record is dropped (and counted) so that what is left
+ * is an unbroken run up to the overflow. */
+void _trace(enum trace_event id, uint8_t a, uint8_t b) {
+	struct trace_rec *r;
+	uint8_t iv = rcli();
+	if ((uint8_t)(trace_in - trace_out) == TRACE_LEN) {
+		if (trace_lost < 0xff)
+			trace_lost++;
+	} else {
+		r = &trace_ring[trace_in++ & (TRACE_LEN - 1)];
+		r->id = id;
+		r->ms = millis;
+		r->us = get_micros();
+		r->a = a;
+		r->b = b;
+	}
+	sreg(iv);
+}
+
+bool trace_pop(uint8_t *frame) {
+	struct trace_rec r;
+	uint8_t i, sum;
+	uint8_t iv = rcli();
+	if (trace_in != trace_out) {
+		r = trace_ring[trace_out++ & (TRACE_LEN - 1)];
+	} else if (trace_lost) {
+		/* report the gap once everything before it is out */
+		r.id = TR_LOST;
+		r.ms = millis;
+		r.us = get_micros();
+		r.a = trace_lost;
+		r.b = 0;
+		trace_lost = 0;
+	} else {
+		sreg(iv);
+		return false;
+	}
+	sreg(iv);
+
+	frame[0] = 0xff;
+	frame[1] = r.id;
+	frame[2] = r.ms & 0xff;
+	frame[3] = r.ms >> 8;
+	frame[4] = r.us;
+	frame[5] = r.a;
+	frame[6] = r.b;
+	for (i = 1, sum = 0; i < TRACE_FRAME_LEN - 1; i++)
+		sum += frame[i];
+	frame[TRACE_FRAME_LEN - 1] = sum;
+	return true;
+}
@@ -0,0 +1,91 @@
+/*
+ * ex: set syntax=c tabstop=8 noexpandtab shiftwidth=8:
+ *
+ * cw-kbd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as  published
+ * by the Free Software Foundation, either version 3 of the License, or (at
+ * your option) any later version.
+ *
+ * cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright © 2009-2010, Vernon Mauery (N7OH)
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* binary event trace
+ *
+ * debug() formats on the spot and pushes the text out over usb, which
+ * is far too slow for the keying path.  trace() instead stores a six
+ * byte record (event, millis, micros/4 and two byte args) in a ram ring
+ * that usb_work drains later.  trace_decode.py turns the records back
+ * into text using the format strings below, which never make it into
+ * the firmware.
+ *
+ * In the formats {a} and {b} are the args and {ab} is b:a as a 16 bit
+ * value.  Any python format spec can follow a colon; ':enum name' looks
+ * the value up in that enum in the source, ':c' prints it as a char.
+ * Only add to the end of the list, the decoder numbers them in order.
+ */
+#define TRACE_EVENTS(E) \
+	E(TR_LOST,       "trace ring overflowed, {a} events lost") \
+	E(TR_KEY_LEFT,   "left paddle {a:enum keying_transition_events} (pind {b:#04x})") \
+	E(TR_KEY_RIGHT,  "right paddle {a:enum keying_transition_events} (pind {b:#04x})") \
+	E(TR_KEY_IDLE,   "cw_in: skipped {ab} tick events") \
+	E(TR_KEY_STATE,  "cw_in: state {a:enum keying_state} ({b:enum keying_transition_events})") \
+	E(TR_KEY_BAD,    "cw_in: BAD!!! {b:enum keying_transition_events} in {a:enum keying_state}") \
+	E(TR_KEY_UP,     "cw_in: release, mode {a} last keyed {b:enum didah_queue_t}") \
+	E(TR_DIDAH_NQ,   "enqueue {a:enum didah_queue_t} keyed {b}") \
+	E(TR_DIDAH_DQ,   "dequeue {a:enum didah_queue_t} keyed {b}") \
+	E(TR_BITS,       "bits = {ab:#x}") \
+	E(TR_DECODE,     "decode: {b:#x} -> {a:c}") \
+	E(TR_PROSIGN,    "prosign: bits = {ab:#b}") \
+	E(TR_CW_STATE,   "cw_out: state {a:enum cw_state}") \
+	E(TR_CW_BYTE,    "cw_out: byte {a} ({a:c})") \
+	E(TR_HID_NQ,     "hid: queue {a:c}") \
+	E(TR_HID_KEY,    "hid: report {a:c} as {b:#04x}") \
+	E(TR_RX_MARK,    "decode: mark of {a}*4 ms, dit {b} ms") \
+	E(TR_RX_BIN,     "rx: following bin {a}, {b}0Hz") \
+	E(TR_POT,        "pot: {a} wpm") \
+	E(TR_KEY_STRAIGHT, "straight key {a} (pind {b:#04x})") \
+	E(TR_PTT,        "cw_out: ptt {a} (radio {b})") \
+	E(TR_CW_RADIO,   "cw_out: on radio {a}")
+
+#define TRACE_EVENT_ID(ID, FMT) ID,
+enum trace_event {
+	TRACE_EVENTS(TRACE_EVENT_ID)
+	TRACE_EVENT_COUNT
+} __attribute__((packed));
+
+/* records held in ram, must be a power of two */
+#define TRACE_LEN 32
+/* bytes per record on the wire: 0xff, id, ms (lo, hi), us, a, b, sum */
+#define TRACE_FRAME_LEN 8
+
+#ifdef TRACE
+
+void _trace(enum trace_event id, uint8_t a, uint8_t b);
+#define trace(ID, A, B) _trace(ID, (uint8_t)(A), (uint8_t)(B))
+#define trace16(ID, AB) _trace(ID, (uint8_t)(AB), (uint8_t)((AB) >> 8))
+
+/* take the oldest record off the ring as a wire frame */
+bool trace_pop(uint8_t *frame);
+
+#else
+
+#define trace(ID, A, B) do {} while(0)
+#define trace16(ID, AB) do {} while(0)
+
+#endif /* TRACE */
+
+#endif /* _TRACE_H_ */
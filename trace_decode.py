@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#
+# cw-kbd is free software: you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as  published
+# by the Free Software Foundation, either version 3 of the License, or (at
+# your option) any later version.
+#
+# cw-kbd is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+# License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with cw-kbd.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Copyright © 2009-2010, Vernon Mauery (N7OH)
+#
+# decode the binary trace records from the debug serial port
+#
+# usage: trace_decode.py [/dev/ttyACM0 | capture-file]
+#
+# The event list and formats come from trace.h and enum names from the
+# rest of the source, so this always matches the tree it sits in (and
+# the firmware has to be built from that same tree).  Plain debug()
+# text is passed through as it is.
+
+import glob
+import os
+import re
+import sys
+
+SRC = os.path.dirname(os.path.abspath(__file__))
+FRAME_LEN = 8
+
+
+def load_events():
+	text = open(os.path.join(SRC, 'trace.h')).read()
+	return re.findall(r'^\s*E\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text, re.M)
+
+
+def load_enums():
+	enums = {}
+	for f in glob.glob(os.path.join(SRC, '*.[ch]')):
+		text = re.sub(r'/\*.*?\*/', '', open(f).read(), flags=re.S)
+		for m in re.finditer(r'enum\s*(\w*)\s*\{(.*?)\}\s*'
+				r'(?:__attribute__\(\(\w+\)\))?\s*(\w*)\s*;',
+				text, re.S):
+			tag, body, name = m.groups()
+			values, v = {}, 0
+			for item in body.split(','):
+				item = item.strip()
+				if not item or item.startswith('#'):
+					continue
+				if '=' in item:
+					item, val = [x.strip() for x in item.split('=', 1)]
+					try:
+						v = int(val, 0)
+					except ValueError:
+						pass
+				values[v] = item
+				v += 1
+			for key in (tag, name):
+				if key:
+					enums[key] = values
+	return enums
+
+
+EVENTS = load_events()
+ENUMS = load_enums()
+
+
+def field(m, rec):
+	name, spec = m.group(1), m.group(2)
+	v = {'a': rec[4], 'b': rec[5], 'ab': rec[4] | rec[5] << 8}[name]
+	if not spec:
+		return str(v)
+	if spec.startswith('enum '):
+		return ENUMS.get(spec[5:], {}).get(v, str(v))
+	if spec == 'c':
+		return chr(v) if 32 <= v < 127 else '\\x%02x' % v
+	return format(v, spec)
+
+
+def expand(rec):
+	eid = rec[0]
+	if eid >= len(EVENTS):
+		return 'unknown event %d (%d, %d)' % (eid, rec[4], rec[5])
+	name, fmt = EVENTS[eid]
+	return re.sub(r'\{(ab|a|b)(?::([^}]*))?\}', lambda m: field(m, rec), fmt)
+
+
+def main():
+	f = open(sys.argv[1] if len(sys.argv) > 1 else '/dev/ttyACM0', 'rb', 0)
+	buf = bytearray()
+	ms_hi, last_ms = 0, None
+	text = bytearray()
+	while True:
+		data = f.read(64)
+		if not data:
+			break
+		buf += data
+		while buf:
+			if buf[0] != 0xff:
+				text.append(buf.pop(0))
+				if text.endswith(b'\n'):
+					sys.stdout.write(text.decode('latin-1'))
+					text = bytearray()
+				continue
+			if len(buf) < FRAME_LEN:
+				break
+			rec = buf[1:FRAME_LEN - 1]
+			if sum(rec) & 0xff != buf[FRAME_LEN - 1]:
+				# not a frame after all, resync on the next byte
+				text.append(buf.pop(0))
+				continue
+			del buf[:FRAME_LEN]
+			# millis is 16 bits on the device
+			ms = rec[1] | rec[2] << 8
+			if last_ms is not None and ms < last_ms:
+				ms_hi += 0x10000
+			last_ms = ms
+			print('%8d.%03d %s' % (ms_hi + ms, rec[3] * 4, expand(rec)))
+			sys.stdout.flush()
+
+
+if __name__ == '__main__':
+	try:
+		main()
+	except KeyboardInterrupt:
+		pass
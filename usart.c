@@ -26,11 +26,16 @@
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "cw-kbd.h"
+#include "ringbuffer.h"
 #include "usart.h"
 
 static usart_read_callback_t usart_read_callback_;
 static usart_write_callback_t usart_write_callback_;
 
+/* bytes waiting for the transmitter, drained by USART1_UDRE */
+DECLARE_RINGBUFFER(usart_tx_q, USART_TX_LEN);
+static uint16_t usart_dropped_;
+
 #define min(A,B) ((A)<(B)?(A):(B))
 #define max(A,B) ((A)>(B)?(A):(B))
 
@@ -42,6 +47,14 @@ ISR(USART1_RX_vect)
 	if (usart_read_callback_) usart_read_callback_(data);
 }
 
+ISR(USART1_UDRE_vect)
+{
+	if (ringbuffer_empty(&usart_tx_q))
+		UCSR1B &= ~_BV(UDRIE1);
+	else
+		UDR1 = ringbuffer_pop(&usart_tx_q);
+}
+
 void usart_init(uint32_t baud)
 {
 	uint8_t sreg = SREG;
@@ -123,8 +136,49 @@ void usart_read_byte(uint8_t* data)
 
 void usart_write_byte(uint8_t data)
 {
-	while (!(UCSR1A & _BV(UDRE1)));
-	UDR1 = data;
+	uint8_t sreg = SREG;
+	cli();
+	if (ringbuffer_empty(&usart_tx_q) && (UCSR1A & _BV(UDRE1))) {
+		/* transmitter is idle, skip the queue */
+		UDR1 = data;
+	} else if (ringbuffer_full(&usart_tx_q)) {
+		/* never wait for the line; the log is not worth a late dit */
+		if (usart_dropped_ < 0xffff)
+			usart_dropped_++;
+	} else {
+		ringbuffer_push(&usart_tx_q, data);
+		UCSR1B |= _BV(UDRIE1);
+	}
+	SREG = sreg;
+}
+
+uint16_t usart_dropped(void)
+{
+	uint16_t dropped;
+	uint8_t sreg = SREG;
+	cli();
+	dropped = usart_dropped_;
+	usart_dropped_ = 0;
+	SREG = sreg;
+	return dropped;
+}
+
+void usart_flush(void)
+{
+	bool sent = false;
+	uint8_t sreg = SREG;
+	cli();
+	UCSR1B &= ~_BV(UDRIE1);
+	while (!ringbuffer_empty(&usart_tx_q)) {
+		while (!(UCSR1A & _BV(UDRE1)));
+		/* writing a one clears it, so TXC1 marks the last byte out */
+		UCSR1A |= _BV(TXC1);
+		UDR1 = ringbuffer_pop(&usart_tx_q);
+		sent = true;
+	}
+	if (sent)
+		while (!(UCSR1A & _BV(TXC1)));
+	SREG = sreg;
 }
 
 void usart_read(uint8_t* data, uint16_t len)
@@ -67,11 +67,23 @@ void usart_tx_interrupt(bool val);
  */
 void usart_read_byte(uint8_t* data);
 
-/* write a byte to the usart
+/* bytes of transmit buffering */
+#define USART_TX_LEN 128
+
+/* queue a byte for the usart; this never waits, if the transmit buffer
+ * is full the byte is dropped and counted
  * data: the byte to write
  */
 void usart_write_byte(uint8_t data);
 
+/* return the number of bytes dropped since the last call */
+uint16_t usart_dropped(void);
+
+/* send everything queued, polling the transmitter; safe with interrupts
+ * disabled, so it can be used on the way down
+ */
+void usart_flush(void);
+
 /* read a series of bytes from the usart
  * (buffer must be at least len bytes long)
  * data: the buffer to store the bytes
@@ -98,7 +98,7 @@ static inline void sreg(uint8_t v) {
     uint8_t sreg;       \
     uint16_t i;         \
     sreg = SREG;        \
-    __asm__ ("cli");    \
+    cli();              \
     i = REG;            \
     SREG = sreg;        \
     i;\
@@ -108,7 +108,7 @@ static inline void sreg(uint8_t v) {
 ({                          \
     uint8_t sreg;           \
     sreg = SREG;            \
-    __asm__ ("cli");        \
+    cli();                  \
     REG = VAL;              \
     SREG = sreg;            \
 })